@@ -88,11 +88,16 @@ CONFIG(debug, debug|release) {
 SOURCES += \
         src/main.cpp \
         src/pdf/pdfdoc.cpp \
+        src/pdf/fingerprintthread.cpp \
         src/pdf/externalrenderer.cpp \
         src/pdf/basicrenderer.cpp \
-        src/pdf/singlerenderer.cpp \
+        src/pdf/tilerenderer.cpp \
+        src/pdf/thumbnailrenderer.cpp \
         src/pdf/cachemap.cpp \
         src/pdf/cachethread.cpp \
+        src/pdf/renderpool.cpp \
+        src/pdf/diskcache.cpp \
+        src/pdf/renderstats.cpp \
         src/screens/controlscreen.cpp \
         src/screens/presentationscreen.cpp \
         src/slide/previewslide.cpp \
@@ -101,6 +106,9 @@ SOURCES += \
         src/slide/presentationslide.cpp \
         src/draw/pathoverlay.cpp \
         src/draw/drawpath.cpp \
+        src/draw/pathindex.cpp \
+        src/draw/autosavethread.cpp \
+        src/draw/gzipdevice.cpp \
         src/gui/timer.cpp \
         src/gui/pagenumberedit.cpp \
         src/gui/toolbutton.cpp \
@@ -116,11 +124,16 @@ HEADERS += \
         src/enumerates.h \
         src/names.h \
         src/pdf/pdfdoc.h \
+        src/pdf/fingerprintthread.h \
         src/pdf/externalrenderer.h \
         src/pdf/basicrenderer.h \
-        src/pdf/singlerenderer.h \
+        src/pdf/tilerenderer.h \
+        src/pdf/thumbnailrenderer.h \
         src/pdf/cachemap.h \
         src/pdf/cachethread.h \
+        src/pdf/renderpool.h \
+        src/pdf/diskcache.h \
+        src/pdf/renderstats.h \
         src/screens/controlscreen.h \
         src/screens/presentationscreen.h \
         src/slide/previewslide.h \
@@ -129,6 +142,10 @@ HEADERS += \
         src/slide/presentationslide.h \
         src/draw/pathoverlay.h \
         src/draw/drawpath.h \
+        src/draw/drawoperation.h \
+        src/draw/pathindex.h \
+        src/draw/autosavethread.h \
+        src/draw/gzipdevice.h \
         src/gui/timer.h \
         src/gui/pagenumberedit.h \
         src/gui/toolbutton.h \
@@ -151,6 +168,8 @@ FORMS += \
 unix {
     INCLUDEPATH += /usr/include/poppler/qt5
     LIBS += -L /usr/lib/ -lpoppler-qt5
+    # zlib is used for reading and writing compressed Xournal(++) files.
+    LIBS += -lz
 }
 macx {
     ## Please configure this according to your poppler installation.
@@ -162,6 +181,8 @@ win32 {
     ## The configuration will probably have the following form:
     #INCLUDEPATH += C:\...\poppler-0.??.?-win??
     #LIBS += -LC:\...\poppler-0.??.?-win?? -lpoppler-qt5
+    ## zlib is required for compressed Xournal(++) files:
+    #LIBS += -LC:\...\zlib -lz
 }
 
 unix {
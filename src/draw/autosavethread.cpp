@@ -0,0 +1,97 @@
+/*
+ * This file is part of BeamerPresenter.
+ * Copyright (C) 2020  stiglers-eponym
+
+ * BeamerPresenter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * BeamerPresenter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with BeamerPresenter. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <QSaveFile>
+#include <QDataStream>
+#include "autosavethread.h"
+
+AutosaveThread::~AutosaveThread()
+{
+    wait();
+}
+
+void AutosaveThread::submit(QByteArray const& header, QList<PathOverlay::PageSnapshot> const& pages, bool const complete)
+{
+    QMutexLocker locker(&mutex);
+    snapshots.append({header, pages, complete});
+    if (active)
+        return;
+    active = true;
+    locker.unlock();
+    // run() might have finished its work, but not have returned yet.
+    wait();
+    start(QThread::LowPriority);
+}
+
+void AutosaveThread::run()
+{
+    while (true) {
+        Snapshot snapshot;
+        {
+            QMutexLocker locker(&mutex);
+            if (snapshots.isEmpty()) {
+                active = false;
+                return;
+            }
+            snapshot = snapshots.takeFirst();
+        }
+#ifdef DEBUG_DRAWING
+        qDebug() << "Autosave" << snapshot.pages.length() << "pages, complete:" << snapshot.complete;
+#endif
+        if (!(snapshot.complete ? writeComplete(snapshot) : append(snapshot))) {
+            qWarning() << "Autosave failed: could not write to" << filename;
+            emit failed();
+        }
+    }
+}
+
+bool AutosaveThread::writeComplete(Snapshot const& snapshot) const
+{
+    // QSaveFile writes to a temporary file and replaces the autosave file only if writing succeeded.
+    QSaveFile file(filename);
+    if (!file.open(QIODevice::WriteOnly))
+        return false;
+    QDataStream stream(&file);
+    stream.setByteOrder(QDataStream::LittleEndian);
+    stream.writeRawData(snapshot.header.constData(), snapshot.header.size());
+    for (auto const& page : snapshot.pages) {
+        QByteArray const chunk = PathOverlay::encodePage(page, true);
+        stream << quint32(chunk.size());
+        stream.writeRawData(chunk.constData(), chunk.size());
+    }
+    return stream.status() == QDataStream::Ok && file.commit();
+}
+
+bool AutosaveThread::append(Snapshot const& snapshot) const
+{
+    QFile file(filename);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Append))
+        return false;
+    QDataStream stream(&file);
+    stream.setByteOrder(QDataStream::LittleEndian);
+    for (auto const& page : snapshot.pages) {
+        QByteArray const chunk = PathOverlay::encodePage(page, true);
+        stream << quint32(chunk.size());
+        stream.writeRawData(chunk.constData(), chunk.size());
+    }
+    // Hand the data to the operating system immediately.
+    file.flush();
+    bool const success = stream.status() == QDataStream::Ok;
+    file.close();
+    return success;
+}
@@ -0,0 +1,72 @@
+/*
+ * This file is part of BeamerPresenter.
+ * Copyright (C) 2020  stiglers-eponym
+
+ * BeamerPresenter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * BeamerPresenter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with BeamerPresenter. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef AUTOSAVETHREAD_H
+#define AUTOSAVETHREAD_H
+
+#include <QThread>
+#include <QMutex>
+#include "pathoverlay.h"
+
+/// Thread writing snapshots of drawings to an autosave file.
+/// The file has the binary format of PathOverlay::saveBinary without the end marker.
+/// A complete snapshot is written to a temporary file, which then replaces the autosave file.
+/// Further snapshots only containing changed pages are appended to the file. When loading
+/// the file, later versions of a page replace earlier ones. If writing is interrupted,
+/// only the last appended page is lost.
+class AutosaveThread : public QThread
+{
+    Q_OBJECT
+
+public:
+    /// Constructor: filename is the path of the autosave file.
+    explicit AutosaveThread(QString const& filename, QObject* parent = nullptr) : QThread(parent), filename(filename) {}
+    /// Destructor: wait until all snapshots have been written.
+    ~AutosaveThread() override;
+    /// Write pages to the autosave file in this thread. Snapshots are written in the order in which they are submitted.
+    /// If complete is true, the file is replaced by header and pages. Otherwise the pages are appended.
+    void submit(QByteArray const& header, QList<PathOverlay::PageSnapshot> const& pages, bool const complete);
+    /// Write all submitted snapshots.
+    void run() override;
+
+private:
+    /// Snapshot of the drawings which should be written.
+    struct Snapshot {
+        QByteArray header;
+        QList<PathOverlay::PageSnapshot> pages;
+        bool complete;
+    };
+    /// Path of the autosave file.
+    QString const filename;
+    /// Protects snapshots and active.
+    QMutex mutex;
+    /// Snapshots which have not been written yet.
+    QList<Snapshot> snapshots;
+    /// True while run() is processing snapshots.
+    bool active = false;
+    /// Replace the autosave file by snapshot.
+    bool writeComplete(Snapshot const& snapshot) const;
+    /// Append the pages of snapshot to the autosave file.
+    bool append(Snapshot const& snapshot) const;
+
+signals:
+    /// Writing a snapshot failed. The autosave file might not contain all pages of this snapshot.
+    void failed();
+};
+
+#endif // AUTOSAVETHREAD_H
@@ -0,0 +1,56 @@
+/*
+ * This file is part of BeamerPresenter.
+ * Copyright (C) 2020  stiglers-eponym
+
+ * BeamerPresenter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * BeamerPresenter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with BeamerPresenter. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef DRAWOPERATION_H
+#define DRAWOPERATION_H
+
+#include <QList>
+#include "drawpath.h"
+
+/// Incremental change of the list of paths on one page.
+/// When drawing or erasing on one PathOverlay, the changes are sent to the other PathOverlays as a
+/// list of DrawOperations. Applying these only touches the changed paths instead of comparing
+/// the complete lists of paths.
+///
+/// The paths in an operation are given in the coordinates of the sender. They are copies of the
+/// sender's paths, which share the node data with the original paths (QVector is implicitly shared).
+struct DrawOperation
+{
+    enum Type {
+        /// Insert paths at index.
+        AddPaths,
+        /// Append the nodes of paths.first() to the path at index, which must be a beginning of paths.first().
+        AppendNodes,
+        /// Replace the path at index by paths.first() (e.g. after simplifying a stroke).
+        ReplacePath,
+        /// Remove count paths starting at index.
+        RemovePaths
+    };
+    Type type;
+    /// Index of the first affected path in the list of paths of the page.
+    int index;
+    /// Number of removed paths (only used for RemovePaths).
+    int count;
+    /// New or changed paths.
+    QList<DrawPath> paths;
+
+    DrawOperation(Type const type = AddPaths, int const index = 0, int const count = 0) : type(type), index(index), count(count) {}
+    DrawOperation(Type const type, int const index, DrawPath const& path) : type(type), index(index), count(0) {paths.append(path);}
+};
+
+#endif // DRAWOPERATION_H
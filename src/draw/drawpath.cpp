@@ -16,6 +16,7 @@
  * along with BeamerPresenter. If not, see <https://www.gnu.org/licenses/>.
  */
 #include <cmath>
+#include <QAtomicInteger>
 
 #include "drawpath.h"
 
@@ -24,60 +25,107 @@ qreal square(qreal const a)
     return a*a;
 }
 
-DrawPath::DrawPath(FullDrawTool const& tool, QPointF const& start) :
+/// Hash contribution of a node. Used in DrawPath::append and DrawPath::updateHash.
+static inline quint32 nodeHash(float const x, float const y, quint32 const hash)
+{
+    return quint32(std::hash<double>{}(x + 1e5*double(y))) + (hash << 6) + (hash >> 2);
+}
+
+/// Minimal pressure used for pressure sensitive strokes. This avoids invisible parts of strokes.
+static float const minPressure = 0.1f;
+
+/// Restrict pressure to the range used for drawing.
+static inline float boundPressure(float const pressure)
+{
+    return pressure < minPressure ? minPressure : (pressure > 1.f ? 1.f : pressure);
+}
+
+DrawPath::DrawPath(FullDrawTool const& tool, QPointF const& start, float const pressure) :
     tool(tool)
 {
-    path.append(start);
+    xs.append(float(start.x()));
+    ys.append(float(start.y()));
+    if (pressure >= 0.f)
+        pressures.append(boundPressure(pressure));
     outer = QRectF(start.x(), start.y(), 0, 0);
     updateHash();
 }
 
 DrawPath::DrawPath(FullDrawTool const& tool, QPointF const* const points, int const number) :
-    path(QVector<QPointF>(number)),
+    xs(QVector<float>(number)),
+    ys(QVector<float>(number)),
     tool(tool)
 {
     if (number == 0)
         return;
-    double left=points[0].x(), right=points[0].x(), top=points[0].y(), bottom=points[0].y();
     for (int i=0; i<number; i++) {
-        path[i] = points[i];
-        if (left > points[i].x())
-            left = points[i].x();
-        else if (right < points[i].x())
-            right = points[i].x();
-        if (bottom < points[i].y())
-            bottom = points[i].y();
-        else if (top > points[i].y())
-            top = points[i].y();
+        xs[i] = float(points[i].x());
+        ys[i] = float(points[i].y());
     }
-    outer = QRectF(left, top, right-left, bottom-top);
+    updateOuter();
+    updateHash();
+}
+
+DrawPath::DrawPath(FullDrawTool const& tool, float const* const x, float const* const y, int const number) :
+    xs(QVector<float>(number)),
+    ys(QVector<float>(number)),
+    tool(tool)
+{
+    if (number == 0)
+        return;
+    std::copy(x, x+number, xs.begin());
+    std::copy(y, y+number, ys.begin());
+    updateOuter();
     updateHash();
 }
 
 DrawPath::DrawPath(DrawPath const& old, QPointF const shift, double const scale) :
-    path(QVector<QPointF>(old.path.length())),
+    xs(QVector<float>(old.xs.length())),
+    ys(QVector<float>(old.ys.length())),
+    pressures(old.pressures),
     tool({old.tool.tool, old.tool.color, scale*old.tool.size, old.tool.extras}),
     hash(old.hash)
 {
-    for (int i=0; i<old.path.length(); i++)
-        path[i] = scale*old.path[i] + shift;
+    for (int i=0; i<old.xs.length(); i++) {
+        xs[i] = float(scale*old.xs[i] + shift.x());
+        ys[i] = float(scale*old.ys[i] + shift.y());
+    }
     outer = QRectF(scale*old.outer.topLeft() + shift, scale*old.outer.bottomRight() + shift);
 }
 
+quint32 DrawPath::nextVersion()
+{
+    // Paths can be copied in the autosave thread.
+    static QAtomicInteger<quint32> counter;
+    return counter.fetchAndAddRelaxed(1) + 1;
+}
+
 QRect const DrawPath::update(DrawPath const& new_path, QPointF const shift, double const scale)
 {
-    if (new_path.tool.tool != tool.tool || new_path.tool.color != tool.color || new_path.path.length() < path.length())
+    if (new_path.tool.tool != tool.tool || new_path.tool.color != tool.color || new_path.xs.length() < xs.length())
         return QRect(0,0,-1,-1);
-    if (new_path.path.length() == path.length() + 1) {
-        path.append(scale*new_path.path.last() + shift);
+    // Pressure is independent of the scale. Only the values of new nodes are appended:
+    // sharing the data with new_path would copy all values whenever one of the paths grows.
+    if (new_path.pressures.isEmpty())
+        pressures.clear();
+    else {
+        // Values of existing nodes are only taken over if they are missing.
+        if (pressures.length() != xs.length())
+            pressures.clear();
+        for (int i=pressures.length(); i<new_path.pressures.length(); i++)
+            pressures.append(new_path.pressures[i]);
+    }
+    outline.clear();
+    if (new_path.xs.length() == xs.length() + 1) {
+        xs.append(float(scale*new_path.xs.last() + shift.x()));
+        ys.append(float(scale*new_path.ys.last() + shift.y()));
         outer = QRectF(scale*new_path.outer.topLeft() + shift, scale*new_path.outer.bottomRight() + shift);
         hash = new_path.hash;
-        return QRectF(path.last(), *(path.cend()-2)).normalized()
-                .adjusted(-tool.size/2-.5, -tool.size/2-.5, tool.size/2+.5, tool.size/2+.5)
-                .toAlignedRect();
+        return getOuterLast();
     }
-    for (QVector<QPointF>::const_iterator it = new_path.path.cbegin() + path.length(); it != new_path.path.cend();) {
-        path.append(scale*(*it++) + shift);
+    for (int i=xs.length(); i<new_path.xs.length(); i++) {
+        xs.append(float(scale*new_path.xs[i] + shift.x()));
+        ys.append(float(scale*new_path.ys[i] + shift.y()));
     }
     outer = QRectF(scale*new_path.outer.topLeft() + shift, scale*new_path.outer.bottomRight() + shift);
     hash = new_path.hash;
@@ -85,7 +133,10 @@ QRect const DrawPath::update(DrawPath const& new_path, QPointF const shift, doub
 }
 
 DrawPath::DrawPath(DrawPath const& old) :
-    path(old.path),
+    xs(old.xs),
+    ys(old.ys),
+    pressures(old.pressures),
+    outline(old.outline),
     outer(old.outer),
     tool(old.tool),
     hash(old.hash)
@@ -93,13 +144,17 @@ DrawPath::DrawPath(DrawPath const& old) :
 
 void DrawPath::transform(QPointF const& shift, const double scale)
 {
-    for (int i=0; i<path.length(); i++)
-        path[i] = scale*path[i] + shift;
+    for (int i=0; i<xs.length(); i++) {
+        xs[i] = float(scale*xs[i] + shift.x());
+        ys[i] = float(scale*ys[i] + shift.y());
+    }
     outer = QRectF(scale*outer.topLeft() + shift, scale*outer.bottomRight() + shift);
     tool.size *= scale;
+    outline.clear();
+    version = nextVersion();
 }
 
-void DrawPath::append(QPointF const& point)
+void DrawPath::append(QPointF const& point, float const pressure)
 {
     if (point.x() < outer.left())
         outer.setLeft(point.x());
@@ -109,8 +164,13 @@ void DrawPath::append(QPointF const& point)
         outer.setTop(point.y());
     else if (point.y() > outer.bottom())
         outer.setBottom(point.y());
-    path.append(point);
-    hash ^= quint32(std::hash<double>{}(point.x() + 1e5*point.y())) + (hash << 6) + (hash >> 2);
+    xs.append(float(point.x()));
+    ys.append(float(point.y()));
+    if (!pressures.isEmpty()) {
+        pressures.append(boundPressure(pressure));
+        outline.clear();
+    }
+    hash ^= nodeHash(xs.last(), ys.last(), hash);
 }
 
 QVector<int> DrawPath::intersects(QPointF const& point, const qreal eraser_size) const
@@ -118,10 +178,12 @@ QVector<int> DrawPath::intersects(QPointF const& point, const qreal eraser_size)
     if (!(outer.adjusted(-eraser_size, -eraser_size, eraser_size, eraser_size).contains(point)))
         return QVector<int>();
     QVector<int> vec = QVector<int>();
-    for (int i=0; i<path.length(); i++) {
-        if (std::abs(point.x() - path[i].x()) < eraser_size
-                && std::abs(point.y() - path[i].y()) < eraser_size
-                && square(point.x() - path[i].x()) + square(point.y() - path[i].y()) < square(eraser_size))
+    float const* const x = xs.constData();
+    float const* const y = ys.constData();
+    for (int i=0; i<xs.length(); i++) {
+        if (std::abs(point.x() - x[i]) < eraser_size
+                && std::abs(point.y() - y[i]) < eraser_size
+                && square(point.x() - x[i]) + square(point.y() - y[i]) < square(eraser_size))
             vec.append(i);
     }
     return vec;
@@ -130,13 +192,16 @@ QVector<int> DrawPath::intersects(QPointF const& point, const qreal eraser_size)
 DrawPath* DrawPath::split(int start, int end)
 {
     if (start < 0) {
-        if (end >= path.length())
+        if (end >= xs.length())
             return this;
         start = 0;
     }
-    if (end > path.length())
-        end = path.length();
-    return new DrawPath(tool, path.data()+start, end-start);
+    if (end > xs.length())
+        end = xs.length();
+    DrawPath* path = new DrawPath(tool, xs.constData()+start, ys.constData()+start, end-start);
+    if (!pressures.isEmpty())
+        path->setPressures(pressures.mid(start, end-start));
+    return path;
 }
 
 void DrawPath::updateHash()
@@ -146,54 +211,256 @@ void DrawPath::updateHash()
     hash ^= quint32(tool.color.green()) + (hash << 6) + (hash >> 2);
     hash ^= quint32(tool.color.blue())  + (hash << 6) + (hash >> 2);
     hash ^= quint32(tool.color.alpha()) + (hash << 6) + (hash >> 2);
-    for (auto& p : path)
-        hash ^= quint32(std::hash<double>{}(p.x() + 1e5*p.y())) + (hash << 6) + (hash >> 2);
+    for (int i=0; i<xs.length(); i++)
+        hash ^= nodeHash(xs[i], ys[i], hash);
 }
 
 void DrawPath::toText(QStringList &stringList, QPoint const shift, qreal const scale) const
 {
-    for (auto point : path) {
-        stringList << QString::number((point.x() - shift.x())*scale);
-        stringList << QString::number((point.y() - shift.y())*scale);
+    for (int i=0; i<xs.length(); i++) {
+        stringList << QString::number((xs[i] - shift.x())*scale);
+        stringList << QString::number((ys[i] - shift.y())*scale);
     }
 }
 
+void DrawPath::toPolyline(QVector<QPointF>& polyline) const
+{
+    polyline.resize(xs.length());
+    for (int i=0; i<xs.length(); i++)
+        polyline[i] = QPointF(xs[i], ys[i]);
+}
+
 DrawPath::DrawPath(FullDrawTool const& tool, QStringList const& stringList, QPoint const shift, qreal const scale) :
     tool({tool.tool, tool.color, scale*tool.size, tool.extras})
 {
     if (stringList.size() % 2 != 0 || stringList.size() < 2)
         return;
-    double x = shift.x() + scale*stringList[0].toDouble();
-    double y = shift.y() + scale*stringList[1].toDouble();
-    double left=x, right=x, top=y, bottom=y;
-    path.append(QPointF(x, y));
-    for (QStringList::const_iterator it=stringList.cbegin()+2; it != stringList.cend();) {
-        x = shift.x() + scale*(it++)->toDouble();
-        y = shift.y() + scale*(it++)->toDouble();
-        path.append(QPointF(x, y));
-        if (left > x)
-            left = x;
-        else if (right < x)
-            right = x;
-        if (bottom < y)
-            bottom = y;
-        else if (top > y)
-            top = y;
+    xs.reserve(stringList.size()/2);
+    ys.reserve(stringList.size()/2);
+    for (QStringList::const_iterator it=stringList.cbegin(); it != stringList.cend();) {
+        xs.append(float(shift.x() + scale*(it++)->toDouble()));
+        ys.append(float(shift.y() + scale*(it++)->toDouble()));
     }
-    outer = QRectF(left, top, right-left, bottom-top);
+    updateOuter();
+    updateHash();
+}
+
+void DrawPath::endDrawing(qreal const tolerance, bool const smooth)
+{
+    if (xs.length() == 1) {
+        // The offset must be representable in single precision.
+        xs.append(xs[0] + 1e-3f);
+        ys.append(ys[0]);
+        if (!pressures.isEmpty())
+            pressures.append(pressures[0]);
+        outline.clear();
+        return;
+    }
+    if (tolerance <= 0. || xs.length() < 3)
+        return;
+#ifdef DEBUG_DRAWING
+    int const oldLength = xs.length();
+#endif
+    simplify(tolerance);
+    if (smooth)
+        // Steps of a few pixels are enough for a smooth curve.
+        smoothen(2*tolerance > 2. ? 2*tolerance : 2.);
+    updateOuter();
     updateHash();
+    outline.clear();
+#ifdef DEBUG_DRAWING
+    qDebug() << "Simplified path:" << oldLength << "->" << xs.length() << "nodes";
+#endif
+}
+
+/// Squared distance of point from the line segment from start to end.
+static qreal segmentDistanceSquared(QPointF const& point, QPointF const& start, QPointF const& end)
+{
+    QPointF const direction = end - start;
+    qreal const length2 = QPointF::dotProduct(direction, direction);
+    qreal t = length2 > 0. ? QPointF::dotProduct(point - start, direction) / length2 : 0.;
+    if (t < 0.)
+        t = 0.;
+    else if (t > 1.)
+        t = 1.;
+    QPointF const diff = point - start - t*direction;
+    return QPointF::dotProduct(diff, diff);
+}
+
+void DrawPath::simplify(qreal const tolerance)
+{
+    int const length = xs.length();
+    QVector<bool> keep(length, false);
+    keep[0] = true;
+    keep[length-1] = true;
+    qreal const tolerance2 = square(tolerance);
+    // Ranges (start, end) of nodes which still need to be checked. A stack is used instead of recursion.
+    QVector<QPair<int, int>> stack;
+    stack.append(qMakePair(0, length-1));
+    while (!stack.isEmpty()) {
+        QPair<int, int> const range = stack.takeLast();
+        QPointF const start = node(range.first), end = node(range.second);
+        qreal maxDistance2 = 0.;
+        int index = -1;
+        for (int i=range.first+1; i<range.second; i++) {
+            qreal const distance2 = segmentDistanceSquared(node(i), start, end);
+            if (distance2 > maxDistance2) {
+                maxDistance2 = distance2;
+                index = i;
+            }
+        }
+        if (index >= 0 && maxDistance2 > tolerance2) {
+            keep[index] = true;
+            stack.append(qMakePair(range.first, index));
+            stack.append(qMakePair(index, range.second));
+        }
+    }
+    // Compact the arrays in place.
+    int kept = 0;
+    for (int i=0; i<length; i++) {
+        if (keep[i]) {
+            xs[kept] = xs[i];
+            ys[kept] = ys[i];
+            if (!pressures.isEmpty())
+                pressures[kept] = pressures[i];
+            kept++;
+        }
+    }
+    xs.resize(kept);
+    ys.resize(kept);
+    if (!pressures.isEmpty())
+        pressures.resize(kept);
+    if (kept < length)
+        version = nextVersion();
+}
+
+void DrawPath::smoothen(qreal const step)
+{
+    int const length = xs.length();
+    if (length < 3)
+        return;
+    QVector<QPointF> smooth;
+    smooth.append(node(0));
+    // Pressure is interpolated linearly.
+    QVector<float> smoothPressures;
+    if (!pressures.isEmpty())
+        smoothPressures.append(pressures[0]);
+    for (int i=0; i<length-1; i++) {
+        // Catmull-Rom spline through p1 and p2 with tangents defined by p0 and p3.
+        QPointF const p0 = node(i > 0 ? i-1 : 0);
+        QPointF const p1 = node(i);
+        QPointF const p2 = node(i+1);
+        QPointF const p3 = node(i+2 < length ? i+2 : length-1);
+        int pieces = int((p2 - p1).manhattanLength() / step);
+        if (pieces < 1)
+            pieces = 1;
+        else if (pieces > 16)
+            pieces = 16;
+        for (int j=1; j<pieces; j++) {
+            qreal const t = qreal(j)/pieces, t2 = t*t, t3 = t2*t;
+            smooth.append(0.5 * (2*p1 + (p2 - p0)*t + (2*p0 - 5*p1 + 4*p2 - p3)*t2 + (3*p1 - p0 - 3*p2 + p3)*t3));
+            if (!pressures.isEmpty())
+                smoothPressures.append(float(pressures[i] + (pressures[i+1] - pressures[i])*t));
+        }
+        smooth.append(p2);
+        if (!pressures.isEmpty())
+            smoothPressures.append(pressures[i+1]);
+    }
+    setNodes(smooth);
+    pressures = smoothPressures;
+}
+
+void DrawPath::setNodes(QVector<QPointF> const& nodes)
+{
+    xs.resize(nodes.length());
+    ys.resize(nodes.length());
+    for (int i=0; i<nodes.length(); i++) {
+        xs[i] = float(nodes[i].x());
+        ys[i] = float(nodes[i].y());
+    }
+    version = nextVersion();
 }
 
-void DrawPath::endDrawing()
+void DrawPath::updateOuter()
 {
-    if (path.length() == 1)
-        path.append(path[0] + QPointF(1e-6, 0));
+    if (xs.isEmpty()) {
+        outer = QRectF();
+        return;
+    }
+    float left=xs[0], right=xs[0], top=ys[0], bottom=ys[0];
+    for (int i=1; i<xs.length(); i++) {
+        if (left > xs[i])
+            left = xs[i];
+        else if (right < xs[i])
+            right = xs[i];
+        if (bottom < ys[i])
+            bottom = ys[i];
+        else if (top > ys[i])
+            top = ys[i];
+    }
+    outer = QRectF(left, top, right-left, bottom-top);
 }
 
 QRect const DrawPath::getOuterLast() const
 {
-    return QRectF(path.last(), *(path.cend()-2))
+    int const n = xs.length();
+    return QRectF(QPointF(xs[n-1], ys[n-1]), QPointF(xs[n-2], ys[n-2]))
             .normalized()
             .adjusted(-tool.size/2-.5, -tool.size/2-.5, tool.size/2+.5, tool.size/2+.5)
             .toAlignedRect();
 }
+
+void DrawPath::setPressures(QVector<float> const& values)
+{
+    if (!values.isEmpty() && values.length() != xs.length())
+        return;
+    pressures = values;
+    for (auto& pressure : pressures)
+        pressure = boundPressure(pressure);
+    outline.clear();
+}
+
+QPolygonF const& DrawPath::getOutline() const
+{
+    int const n = xs.length();
+    if (!outline.isEmpty() || n == 0 || pressures.length() != n)
+        return outline;
+    // Number of segments used for the round caps at both ends.
+    int const capSteps = 8;
+    outline.reserve(2*n + 2*capSteps + 2);
+    // Left and right boundary of the stroke at each node. The normal at a node is perpendicular
+    // to the line connecting the neighbouring nodes.
+    QVector<QPointF> right(n);
+    QPointF normal(0., 1.);
+    for (int i=0; i<n; i++) {
+        QPointF const direction = node(i+1 < n ? i+1 : n-1) - node(i > 0 ? i-1 : 0);
+        qreal const length = std::sqrt(QPointF::dotProduct(direction, direction));
+        // Keep the previous normal if the neighbours coincide.
+        if (length > 0.)
+            normal = QPointF(-direction.y()/length, direction.x()/length);
+        QPointF const offset = (0.5*tool.size*pressures[i])*normal;
+        outline.append(node(i) + offset);
+        right[i] = node(i) - offset;
+    }
+    // Round cap at the end: half circle from the left to the right boundary.
+    {
+        QPointF const normalEnd = (outline.last() - right.last())/2;
+        QPointF const tangent(normalEnd.y(), -normalEnd.x());
+        for (int j=1; j<capSteps; j++) {
+            qreal const angle = M_PI*j/capSteps;
+            outline.append(node(n-1) + std::cos(angle)*normalEnd + std::sin(angle)*tangent);
+        }
+    }
+    for (int i=n-1; i>=0; i--)
+        outline.append(right[i]);
+    // Round cap at the start: half circle from the right to the left boundary.
+    {
+        QPointF const normalStart = (outline.first() - right.first())/2;
+        QPointF const tangent(-normalStart.y(), normalStart.x());
+        for (int j=1; j<capSteps; j++) {
+            qreal const angle = M_PI*j/capSteps;
+            outline.append(node(0) - std::cos(angle)*normalStart + std::sin(angle)*tangent);
+        }
+    }
+    return outline;
+}
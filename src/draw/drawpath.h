@@ -23,34 +23,57 @@
 #include <QVector>
 #include <QPointF>
 #include <QRectF>
+#include <QPolygonF>
 #include "../enumerates.h"
 
+/// Stroke drawn on a slide.
+/// The nodes are stored as separate arrays of x and y coordinates in single precision.
+/// This needs half the memory of a list of QPointF and keeps the coordinates contiguous
+/// for loops over all nodes (e.g. when erasing). Pixel coordinates do not need more precision.
 class DrawPath
 {
 private:
-    QVector<QPointF> path;
+    /// x coordinates of the nodes.
+    QVector<float> xs;
+    /// y coordinates of the nodes.
+    QVector<float> ys;
+    /// Pressure (between 0 and 1) at each node. Empty for strokes with constant width.
+    /// The width of a pressure sensitive stroke at a node is pressure times the size of the tool.
+    QVector<float> pressures;
+    /// Cached outline of a pressure sensitive stroke. Empty if it needs to be recalculated.
+    mutable QPolygonF outline;
     /// Rectangle containing all nodes of the path.
     QRectF outer = QRectF();
     FullDrawTool tool;
     quint32 hash = 0;
+    /// Identifies the current nodes of the path. Every path gets a new version when it is created
+    /// and whenever its existing nodes are changed. Appending nodes keeps the version.
+    quint32 version = nextVersion();
+    /// Unique number for a new version.
+    static quint32 nextVersion();
 
 public:
-    /// Created new empty path.
-    DrawPath(FullDrawTool const& tool, QPointF const& start);
+    /// Created new empty path. If pressure >= 0, the path is pressure sensitive.
+    DrawPath(FullDrawTool const& tool, QPointF const& start, float const pressure = -1.f);
     /// Create new path with given points.
     DrawPath(FullDrawTool const& tool, QPointF const* const points, int const number);
+    /// Create new path with given coordinates.
+    DrawPath(FullDrawTool const& tool, float const* const x, float const* const y, int const number);
     /// Read path from string list. Used in file loading function.
     DrawPath(FullDrawTool const& tool, QStringList const& stringList, QPoint const shift, qreal const scale);
     DrawPath(DrawPath const& old, QPointF const shift, double const scale);
     DrawPath(DrawPath const& old);
 
-    DrawPath operator=(DrawPath const& old) {path.clear(); return DrawPath(old);}
-    DrawPath operator=(DrawPath const&& old) {path.clear(); return DrawPath(old);}
+    DrawPath operator=(DrawPath const& old) {xs.clear(); ys.clear(); return DrawPath(old);}
+    DrawPath operator=(DrawPath const&& old) {xs.clear(); ys.clear(); return DrawPath(old);}
 
-    ~DrawPath() {path.clear();}
+    ~DrawPath() {xs.clear(); ys.clear();}
 
     /// Called when drawing ends: makes sure that a path contains at least two points such that it can be drawn.
-    void endDrawing();
+    /// If tolerance > 0, nodes which deviate less than tolerance (in pixels) from a straight line are removed
+    /// using the Ramer-Douglas-Peucker algorithm. If smooth is true, the remaining nodes are interpolated by a
+    /// Catmull-Rom spline.
+    void endDrawing(qreal const tolerance = 0., bool const smooth = false);
     /// Export path to list of strings representing numbers.
     /// The list contains (alternately) x and y coordinates in point (=inch/72).
     void toText(QStringList& stringList, QPoint const shift, qreal const scale) const;
@@ -60,11 +83,30 @@ public:
     void updateHash();
 
     quint32 getHash() const {return hash;}
-    bool isEmpty() const {return path.isEmpty();}
+    /// Version of the nodes, see version.
+    quint32 getVersion() const {return version;}
+    bool isEmpty() const {return xs.isEmpty();}
     /// Number of nodes in path.
-    int number() const {return path.length();}
+    int number() const {return xs.length();}
     FullDrawTool const& getTool() const {return tool;}
-    QPointF const* data() const {return path.constData();}
+    /// Node with index i.
+    QPointF const node(int const i) const {return QPointF(xs[i], ys[i]);}
+    /// x coordinates of all nodes.
+    float const* xData() const {return xs.constData();}
+    /// y coordinates of all nodes.
+    float const* yData() const {return ys.constData();}
+    /// Write all nodes to polyline as required for drawing. The memory of polyline is reused.
+    void toPolyline(QVector<QPointF>& polyline) const;
+    /// Does the width of this stroke depend on the pressure?
+    bool hasPressure() const {return !pressures.isEmpty();}
+    /// Pressure at all nodes or nullptr if the stroke has constant width.
+    float const* pressureData() const {return pressures.isEmpty() ? nullptr : pressures.constData();}
+    /// Set the pressure at all nodes. An empty vector makes the width constant.
+    /// Does nothing if the number of values does not match the number of nodes.
+    void setPressures(QVector<float> const& values);
+    /// Outline of a pressure sensitive stroke as polygon, which should be filled (with Qt::WindingFill).
+    /// The outline is calculated when it is needed and cached until the stroke changes.
+    QPolygonF const& getOutline() const;
     /// Rectangle containing all nodes.
     QRectF const& getOuter() const {return outer;}
     /// Rectangle containing all nodes plus a distance of the stroke width.
@@ -74,10 +116,20 @@ public:
     /// Return all nodes in this path which are nearer to the given point than eraser_size.
     QVector<int> intersects(QPointF const& point, qreal const eraser_size) const;
 
-    /// Append a new node to the path.
-    void append(QPointF const& point);
+    /// Append a new node to the path. pressure is ignored if the path has constant width.
+    void append(QPointF const& point, float const pressure = 1.f);
     /// Extract all nodes from index start to index end as a separate path.
     DrawPath* split(int start, int end);
+
+private:
+    /// Remove nodes which deviate less than tolerance from the simplified path (Ramer-Douglas-Peucker).
+    void simplify(qreal const tolerance);
+    /// Interpolate the nodes by a Catmull-Rom spline. Segments are divided in pieces of length of about step.
+    void smoothen(qreal const step);
+    /// Replace all nodes.
+    void setNodes(QVector<QPointF> const& nodes);
+    /// Recalculate outer from all nodes.
+    void updateOuter();
 };
 
 #endif // DRAWPATH_H
@@ -0,0 +1,84 @@
+/*
+ * This file is part of BeamerPresenter.
+ * Copyright (C) 2020  stiglers-eponym
+
+ * BeamerPresenter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * BeamerPresenter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with BeamerPresenter. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <climits>
+#include <algorithm>
+#include <zlib.h>
+#include <QFile>
+#include <QtDebug>
+#include "gzipdevice.h"
+
+bool GzipDevice::open(OpenMode mode)
+{
+    if (isOpen() || (mode & QIODevice::ReadWrite) == QIODevice::ReadWrite || mode & QIODevice::Append)
+        return false;
+    // Compression level 6 is the default of gzip.
+    file = gzopen(QFile::encodeName(filename).constData(), (mode & QIODevice::WriteOnly) ? "wb6" : "rb");
+    if (file == nullptr)
+        return false;
+    endReached = false;
+    return QIODevice::open(mode);
+}
+
+void GzipDevice::close()
+{
+    if (isOpen())
+        QIODevice::close();
+    if (file != nullptr) {
+        if (gzclose(file) != Z_OK)
+            qWarning() << "Error when closing compressed file" << filename;
+        file = nullptr;
+    }
+}
+
+bool GzipDevice::atEnd() const
+{
+    return endReached && QIODevice::atEnd();
+}
+
+qint64 GzipDevice::readData(char* data, qint64 maxSize)
+{
+    if (file == nullptr)
+        return -1;
+    int const bytes = gzread(file, data, unsigned(std::min<qint64>(maxSize, INT_MAX)));
+    if (bytes < 0) {
+        int error;
+        setErrorString(gzerror(file, &error));
+        return -1;
+    }
+    if (bytes == 0 && maxSize > 0)
+        endReached = true;
+    return bytes;
+}
+
+qint64 GzipDevice::writeData(char const* data, qint64 maxSize)
+{
+    if (file == nullptr)
+        return -1;
+    qint64 written = 0;
+    while (written < maxSize) {
+        int const bytes = gzwrite(file, data + written, unsigned(std::min<qint64>(maxSize - written, INT_MAX)));
+        if (bytes <= 0) {
+            int error;
+            setErrorString(gzerror(file, &error));
+            return -1;
+        }
+        written += bytes;
+    }
+    return written;
+}
@@ -0,0 +1,61 @@
+/*
+ * This file is part of BeamerPresenter.
+ * Copyright (C) 2020  stiglers-eponym
+
+ * BeamerPresenter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * BeamerPresenter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with BeamerPresenter. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef GZIPDEVICE_H
+#define GZIPDEVICE_H
+
+#include <QIODevice>
+#include <QString>
+
+struct gzFile_s;
+
+/// Sequential QIODevice reading or writing a gzip compressed file using zlib.
+/// The data is (de)compressed while it is read or written, such that files can be
+/// processed as a stream without keeping the complete file in memory.
+/// When reading, files which are not compressed are read unchanged.
+class GzipDevice : public QIODevice
+{
+    Q_OBJECT
+
+public:
+    /// Constructor: the file is opened when calling open().
+    explicit GzipDevice(QString const& filename, QObject* parent = nullptr) : QIODevice(parent), filename(filename) {}
+    /// Destructor: close the file.
+    ~GzipDevice() override {close();}
+    /// Open the file for reading or writing. Other open modes (like ReadWrite or Append) are not supported.
+    bool open(OpenMode mode) override;
+    /// Close the file. When writing, this writes the remaining compressed data.
+    void close() override;
+    bool isSequential() const override {return true;}
+    /// End of the decompressed data reached.
+    bool atEnd() const override;
+
+protected:
+    qint64 readData(char* data, qint64 maxSize) override;
+    qint64 writeData(char const* data, qint64 maxSize) override;
+
+private:
+    /// Path of the file.
+    QString const filename;
+    /// zlib handle of the open file or nullptr.
+    gzFile_s* file = nullptr;
+    /// Set when the end of the file has been reached.
+    bool endReached = false;
+};
+
+#endif // GZIPDEVICE_H
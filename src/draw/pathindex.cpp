@@ -0,0 +1,165 @@
+/*
+ * This file is part of BeamerPresenter.
+ * Copyright (C) 2020  stiglers-eponym
+
+ * BeamerPresenter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * BeamerPresenter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with BeamerPresenter. If not, see <https://www.gnu.org/licenses/>.
+ */
+#include <cmath>
+#include <algorithm>
+
+#include "pathindex.h"
+
+void PathIndex::clear()
+{
+    cells.clear();
+    indexed.clear();
+    totalEntries = 0;
+    staleEntries = 0;
+    maxStrokeWidth = 0.;
+}
+
+void PathIndex::sync(QList<DrawPath*> const& list)
+{
+    QSet<DrawPath const*> current;
+    for (auto const path : list) {
+        if (path == nullptr || path->isEmpty())
+            continue;
+        current.insert(path);
+        QHash<DrawPath const*, Info>::iterator it = indexed.find(path);
+        if (it != indexed.end()) {
+            if (it->version == path->getVersion() && path->number() >= it->nodes) {
+                // The path is known. Only index new nodes.
+                if (path->number() > it->nodes)
+                    insertNodes(path, *it, it->nodes);
+                continue;
+            }
+            // The nodes have been replaced or the memory of a deleted path has been reused for a new path.
+            staleEntries += it->entries;
+            indexed.erase(it);
+        }
+        Info info {nextGeneration++, 0, 0, path->getVersion()};
+        insertNodes(path, info, 0);
+        indexed.insert(path, info);
+    }
+    // Remove paths, which are not in list anymore.
+    for (QHash<DrawPath const*, Info>::iterator it = indexed.begin(); it != indexed.end();) {
+        if (current.contains(it.key()))
+            it++;
+        else {
+            staleEntries += it->entries;
+            it = indexed.erase(it);
+        }
+    }
+    // Drop stale entries if they make up a large part of the index.
+    if (staleEntries > 1024 && 2*staleEntries > totalEntries)
+        rebuild();
+}
+
+void PathIndex::insertNodes(DrawPath const* path, Info& info, int const from)
+{
+    float const* const xs = path->xData();
+    float const* const ys = path->yData();
+    int const number = path->number();
+    if (path->getTool().size > maxStrokeWidth)
+        maxStrokeWidth = path->getTool().size;
+    for (int i=from; i<number; i++) {
+        // Node i represents the segment from node i-1 to node i.
+        int const j = i > 0 ? i-1 : 0;
+        int const left = cellCoordinate(std::min(xs[j], xs[i]));
+        int const right = cellCoordinate(std::max(xs[j], xs[i]));
+        int const top = cellCoordinate(std::min(ys[j], ys[i]));
+        int const bottom = cellCoordinate(std::max(ys[j], ys[i]));
+        for (int x=left; x<=right; x++) {
+            for (int y=top; y<=bottom; y++) {
+                cells[cellKey(x, y)].append({path, info.generation, i});
+                info.entries++;
+                totalEntries++;
+            }
+        }
+    }
+    info.nodes = number;
+}
+
+void PathIndex::rebuild()
+{
+#ifdef DEBUG_DRAWING
+    qDebug() << "Rebuild path index:" << staleEntries << "of" << totalEntries << "entries are stale";
+#endif
+    cells.clear();
+    totalEntries = 0;
+    staleEntries = 0;
+    maxStrokeWidth = 0.;
+    for (QHash<DrawPath const*, Info>::iterator it = indexed.begin(); it != indexed.end(); it++) {
+        it->entries = 0;
+        insertNodes(it.key(), *it, 0);
+    }
+}
+
+bool PathIndex::isValid(Entry const& entry) const
+{
+    QHash<DrawPath const*, Info>::const_iterator const it = indexed.constFind(entry.path);
+    return it != indexed.cend() && it->generation == entry.generation && entry.node < it->nodes;
+}
+
+QHash<DrawPath const*, QVector<int>> const PathIndex::nodesNear(QPointF const& point, qreal const radius) const
+{
+    QHash<DrawPath const*, QVector<int>> result;
+    int const left = cellCoordinate(point.x() - radius);
+    int const right = cellCoordinate(point.x() + radius);
+    int const top = cellCoordinate(point.y() - radius);
+    int const bottom = cellCoordinate(point.y() + radius);
+    for (int x=left; x<=right; x++) {
+        for (int y=top; y<=bottom; y++) {
+            QHash<quint64, QVector<Entry>>::const_iterator const cell = cells.constFind(cellKey(x, y));
+            if (cell == cells.cend())
+                continue;
+            for (auto const& entry : *cell) {
+                if (!isValid(entry))
+                    continue;
+                qreal const dx = point.x() - entry.path->xData()[entry.node], dy = point.y() - entry.path->yData()[entry.node];
+                // Same condition as in DrawPath::intersects.
+                if (std::abs(dx) < radius && std::abs(dy) < radius && dx*dx + dy*dy < radius*radius)
+                    result[entry.path].append(entry.node);
+            }
+        }
+    }
+    // Nodes can be contained in several cells.
+    for (QHash<DrawPath const*, QVector<int>>::iterator it = result.begin(); it != result.end(); it++) {
+        std::sort(it->begin(), it->end());
+        it->erase(std::unique(it->begin(), it->end()), it->end());
+    }
+    return result;
+}
+
+QSet<DrawPath const*> const PathIndex::pathsNear(QRectF const& rect) const
+{
+    QSet<DrawPath const*> result;
+    qreal const margin = maxStrokeWidth/2 + 1.;
+    int const left = cellCoordinate(rect.left() - margin);
+    int const right = cellCoordinate(rect.right() + margin);
+    int const top = cellCoordinate(rect.top() - margin);
+    int const bottom = cellCoordinate(rect.bottom() + margin);
+    for (int x=left; x<=right; x++) {
+        for (int y=top; y<=bottom; y++) {
+            QHash<quint64, QVector<Entry>>::const_iterator const cell = cells.constFind(cellKey(x, y));
+            if (cell == cells.cend())
+                continue;
+            for (auto const& entry : *cell) {
+                if (!result.contains(entry.path) && isValid(entry))
+                    result.insert(entry.path);
+            }
+        }
+    }
+    return result;
+}
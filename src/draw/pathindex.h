@@ -0,0 +1,104 @@
+/*
+ * This file is part of BeamerPresenter.
+ * Copyright (C) 2020  stiglers-eponym
+
+ * BeamerPresenter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * BeamerPresenter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with BeamerPresenter. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef PATHINDEX_H
+#define PATHINDEX_H
+
+#include <cmath>
+#include <QHash>
+#include <QSet>
+#include <QVector>
+#include <QRectF>
+#include "drawpath.h"
+
+/// Spatial index of the strokes (DrawPaths) on one page.
+/// The page is divided into a uniform grid of square cells. Each cell stores the nodes of all
+/// strokes, for which the segment ending at this node overlaps with the cell.
+/// Like this erasing and repainting small regions only needs to check strokes close to that region.
+///
+/// The index does not own the paths. It is synchronized with the list of paths of a page
+/// by calling sync() before using it. Synchronizing only checks each path once and indexes
+/// new nodes of paths which have grown (e.g. while drawing) and new paths (e.g. after erasing).
+/// Paths of which existing nodes have changed (e.g. by simplifying a finished stroke) are
+/// recognized by their version and indexed again.
+/// Removed paths are marked as invalid and their entries are dropped when the index is rebuilt.
+class PathIndex
+{
+public:
+    /// Constructor: cellSize is the side length of the grid cells in pixels.
+    explicit PathIndex(qreal const cellSize = 32.) : cellSize(cellSize) {}
+
+    /// Update the index such that it contains exactly the paths in list.
+    void sync(QList<DrawPath*> const& list);
+    /// Remove all paths from the index. Must be called when paths are transformed.
+    void clear();
+
+    /// Return the indices of all nodes closer to point than radius, for each path containing such nodes.
+    /// This gives the same nodes as DrawPath::intersects. The indices are sorted.
+    QHash<DrawPath const*, QVector<int>> const nodesNear(QPointF const& point, qreal const radius) const;
+    /// Return all paths which have a segment (including the stroke width) overlapping with rect.
+    /// The result can contain some more paths close to rect.
+    QSet<DrawPath const*> const pathsNear(QRectF const& rect) const;
+
+private:
+    /// Entry in a grid cell: node of a path.
+    struct Entry {
+        DrawPath const* path;
+        /// Used to recognize entries of deleted paths, if the memory of the path has been reused.
+        quint32 generation;
+        int node;
+    };
+    /// Information about an indexed path.
+    struct Info {
+        quint32 generation;
+        /// Number of indexed nodes.
+        int nodes;
+        /// Number of entries in cells.
+        int entries;
+        /// DrawPath::getVersion() of the indexed nodes. Used to check whether the nodes or the path have been replaced.
+        quint32 version;
+    };
+
+    /// Side length of grid cells.
+    qreal const cellSize;
+    /// Grid cells. Keys are created from cell coordinates by cellKey.
+    QHash<quint64, QVector<Entry>> cells;
+    /// All indexed paths.
+    QHash<DrawPath const*, Info> indexed;
+    /// Generation assigned to the next indexed path.
+    quint32 nextGeneration = 0;
+    /// Total number of entries in all cells.
+    int totalEntries = 0;
+    /// Number of entries of paths which have been removed.
+    int staleEntries = 0;
+    /// Maximum stroke width of all indexed paths.
+    qreal maxStrokeWidth = 0.;
+
+    /// Add entries for all nodes of path starting from index from.
+    void insertNodes(DrawPath const* path, Info& info, int const from);
+    /// Rebuild the grid cells from all indexed paths. This drops all stale entries.
+    void rebuild();
+    /// Key of the grid cell with coordinates (x, y).
+    static quint64 cellKey(int const x, int const y) {return (quint64(quint32(x)) << 32) | quint32(y);}
+    /// Grid coordinate of a position.
+    int cellCoordinate(qreal const position) const {return int(std::floor(position/cellSize));}
+    /// Does entry belong to a path which is still indexed?
+    bool isValid(Entry const& entry) const;
+};
+
+#endif // PATHINDEX_H
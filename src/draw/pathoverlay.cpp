@@ -16,8 +16,14 @@
  * along with BeamerPresenter. If not, see <https://www.gnu.org/licenses/>.
  */
 #include <cmath>
+#include <algorithm>
+#include <QDataStream>
+#include <QXmlStreamReader>
+#include <QXmlStreamWriter>
 
 #include "pathoverlay.h"
+#include "autosavethread.h"
+#include "gzipdevice.h"
 #include "../slide/drawslide.h"
 #include "../names.h"
 
@@ -39,6 +45,29 @@ bool operator<(FullDrawTool tool1, FullDrawTool tool2)
 }
 
 
+qreal PathOverlay::strokeTolerance = 0.;
+bool PathOverlay::smoothStrokes = false;
+bool PathOverlay::pressureSensitive = true;
+
+/// Draw a single stroke with color and composition mode already set in painter.
+/// Pressure sensitive strokes are drawn by filling their outline, other strokes as polylines
+/// with a pen of constant width. polyline is only used as buffer.
+static void drawStroke(QPainter& painter, DrawPath const* path, QVector<QPointF>& polyline)
+{
+    FullDrawTool const& tool = path->getTool();
+    if (path->hasPressure()) {
+        painter.setPen(Qt::NoPen);
+        painter.setBrush(tool.color);
+        painter.drawPolygon(path->getOutline(), Qt::WindingFill);
+        painter.setBrush(Qt::NoBrush);
+    }
+    else {
+        painter.setPen(QPen(tool.color, tool.size, Qt::SolidLine, Qt::RoundCap, Qt::RoundJoin));
+        path->toPolyline(polyline);
+        painter.drawPolyline(polyline.constData(), polyline.length());
+    }
+}
+
 PathOverlay::PathOverlay(DrawSlide* parent) :
     QWidget(parent),
     master(parent)
@@ -52,8 +81,10 @@ PathOverlay::PathOverlay(DrawSlide* parent) :
 
 PathOverlay::~PathOverlay()
 {
+    // This waits until the autosave file has been written.
+    delete autosaveThread;
     clearAllAnnotations();
-    delete enlargedPageRenderer;
+    delete magnifierRenderer;
 }
 
 void PathOverlay::clearAllAnnotations()
@@ -61,22 +92,22 @@ void PathOverlay::clearAllAnnotations()
     for (QMap<QString, QList<DrawPath*>>::iterator it=paths.begin(); it!=paths.end(); it++) {
         qDeleteAll(*it);
         it->clear();
+        changedPages.insert(it.key());
     }
     paths.clear();
-    end_cache = -1;
-    if (!pixpaths.isNull())
-        pixpaths = QPixmap();
+    pathIndex.clear();
+    clearPathCache();
     update();
 }
 
 void PathOverlay::clearPageAnnotations()
 {
-    end_cache = -1;
-    if (!pixpaths.isNull())
-        pixpaths = QPixmap();
+    clearPathCache();
     if (master->page != nullptr && paths.contains(master->page->label())) {
         qDeleteAll(paths[master->page->label()]);
         paths[master->page->label()].clear();
+        pathIndex.remove(master->page->label());
+        changedPages.insert(master->page->label());
         update();
         updateEnlargedPage();
     }
@@ -91,12 +122,10 @@ void PathOverlay::paintEvent(QPaintEvent* event)
 #endif
     QPainter painter(this);
     painter.setCompositionMode(QPainter::CompositionMode_SourceOver);
-    if (end_cache >= 0)
-        painter.drawPixmap(0, 0, pixpaths);
     if (master->page == nullptr)
         return;
     painter.setRenderHint(QPainter::Antialiasing);
-    drawPaths(painter, master->page->label(), event->region());
+    drawCachedPaths(painter, event->region());
     if (!pointerPosition.isNull() || !stylusPosition.isNull()) {
         FullDrawTool const* thetool = &tool;
         QPointF const* position = &pointerPosition;
@@ -145,18 +174,8 @@ void PathOverlay::paintEvent(QPaintEvent* event)
             break;
         }
         case Magnifier:
-            if (!enlargedPage.isNull()) {
-                painter.setCompositionMode(QPainter::CompositionMode_SourceOver);
-                painter.setClipping(true);
-                QPainterPath path;
-                path.addEllipse(*position, thetool->size, thetool->size);
-                painter.setClipPath(path, Qt::ReplaceClip);
-                painter.drawPixmap(QRectF(position->x()-thetool->size, position->y()-thetool->size, 2*thetool->size, 2*thetool->size),
-                                  enlargedPage,
-                                  QRectF(thetool->extras.magnification*position->x() - thetool->size, thetool->extras.magnification*position->y() - thetool->size, 2*thetool->size, 2*thetool->size));
-                painter.setPen(QPen(thetool->color, 2));
-                painter.drawEllipse(*position, thetool->size, thetool->size);
-            }
+            if (magnifierRenderer != nullptr)
+                drawMagnifier(painter, *thetool, *position);
             break;
         default:
             break;
@@ -169,12 +188,13 @@ void PathOverlay::paintEvent(QPaintEvent* event)
 
 void PathOverlay::rescale(qint16 const oldshiftx, qint16 const oldshifty, double const oldRes)
 {
-    end_cache = -1;
-    enlargedPage = QPixmap();
-    delete enlargedPageRenderer;
-    enlargedPageRenderer = nullptr;
+    clearPathCache();
+    delete magnifierRenderer;
+    magnifierRenderer = nullptr;
     eraserSize *= master->getResolution()/oldRes;
     QPointF shift = QPointF(master->shiftx, master->shifty) - master->resolution/oldRes*QPointF(oldshiftx, oldshifty);
+    // All coordinates change. The spatial index is rebuilt when it is needed.
+    pathIndex.clear();
     for (QMap<QString, QList<DrawPath*>>::iterator page_it = paths.begin(); page_it != paths.end(); page_it++)
         for (QList<DrawPath*>::iterator path_it = page_it->begin(); path_it != page_it->end(); path_it++)
             (*path_it)->transform(shift, master->resolution/oldRes);
@@ -262,32 +282,145 @@ void PathOverlay::updatePathCache()
 {
     if (master->page == nullptr)
         return;
+    QString const label = master->page->label();
 #ifdef DEBUG_DRAWING
     qDebug() << "update path cache" << end_cache << this;
 #endif
-    if (paths[master->page->label()].isEmpty()) {
-        end_cache = -1;
-        if (!pixpaths.isNull())
-            pixpaths = QPixmap();
+    QList<DrawPath*> const list = paths.value(label);
+    if (list.isEmpty()) {
+        clearPathCache();
+        return;
     }
-    else {
-        if (pixpaths.isNull())
-            end_cache = -1;
-        if (end_cache == -1) {
-            pixpaths = QPixmap(size());
-            pixpaths.fill(QColor(0,0,0,0));
+    if (end_cache < 0 || end_cache > list.length() || tileColumns != (width()+tileSize-1)/tileSize || tileRows != (height()+tileSize-1)/tileSize) {
+        // Start a new cache. The tiles are rendered when they are needed.
+        clearPathCache();
+        tileColumns = (width()+tileSize-1)/tileSize;
+        tileRows = (height()+tileSize-1)/tileSize;
+        tiles = QVector<QPixmap>(tileColumns*tileRows);
+        liveTiles = QVector<bool>(tileColumns*tileRows, false);
+        end_cache = list.length();
+        return;
+    }
+    // Add the new paths to the tiles, which are already rendered.
+    for (int i=end_cache; i<list.length(); i++) {
+        QRect const outer = list[i]->getOuterDrawing().toAlignedRect();
+        int const right = std::min(outer.right()/tileSize, tileColumns-1);
+        int const bottom = std::min(outer.bottom()/tileSize, tileRows-1);
+        for (int x=std::max(outer.left()/tileSize, 0); x<=right; x++) {
+            for (int y=std::max(outer.top()/tileSize, 0); y<=bottom; y++) {
+                int const t = y*tileColumns + x;
+                if (liveTiles[t] || tiles[t].isNull())
+                    continue;
+                QRect const rect = tileRect(t);
+                if (list[i]->getTool().tool == Highlighter && hasVideoOverlap(outer & rect)) {
+                    tiles[t] = QPixmap();
+                    liveTiles[t] = true;
+                    continue;
+                }
+                QPainter painter(&tiles[t]);
+                painter.setRenderHint(QPainter::Antialiasing);
+                painter.translate(-rect.topLeft());
+                painter.setClipRect(rect);
+                drawPaths(painter, label, QRegion(rect), false, i, i+1);
+            }
+        }
+    }
+    end_cache = list.length();
+}
+
+void PathOverlay::clearPathCache()
+{
+    end_cache = -1;
+    tiles.clear();
+    liveTiles.clear();
+    tileColumns = 0;
+    tileRows = 0;
+}
+
+void PathOverlay::invalidateTiles(QRegion const& region)
+{
+    for (int t=0; t<tiles.size(); t++) {
+        if (region.intersects(tileRect(t))) {
+            tiles[t] = QPixmap();
+            liveTiles[t] = false;
+        }
+    }
+}
+
+void PathOverlay::updateCacheAfterChange(int const oldLength, int const newLength, QRegion const& changed)
+{
+    if (end_cache >= 0 && end_cache == oldLength) {
+        // The cache was complete. Only tiles containing changed paths must be rendered again.
+        invalidateTiles(changed);
+        end_cache = newLength;
+    }
+    else
+        clearPathCache();
+}
+
+void PathOverlay::renderTile(int const t)
+{
+    QRect const rect = tileRect(t);
+    QString const label = master->page->label();
+    // A highlighter drawn over a video cannot be cached, because the highlighter's background would hide the video.
+    if (hasVideoOverlap(rect)) {
+        QList<DrawPath*> const& list = paths[label];
+        for (int i=0; i<end_cache && i<list.length(); i++) {
+            if (list[i]->getTool().tool == Highlighter && hasVideoOverlap(list[i]->getOuterDrawing().toAlignedRect() & rect)) {
+#ifdef DEBUG_DRAWING
+                qDebug() << "Path cache tile cannot be cached:" << t << this;
+#endif
+                liveTiles[t] = true;
+                return;
+            }
         }
-        QPainter painter;
-        painter.begin(&pixpaths);
-        painter.setRenderHint(QPainter::Antialiasing);
-        drawPaths(painter, master->page->label(), QRegion(rect()), false, true);
     }
+    QPixmap tile(rect.size());
+    tile.fill(QColor(0,0,0,0));
+    QPainter painter(&tile);
+    painter.setRenderHint(QPainter::Antialiasing);
+    painter.translate(-rect.topLeft());
+    painter.setClipRect(rect);
+    drawPaths(painter, label, QRegion(rect), false, 0, end_cache);
+    painter.end();
+    tiles[t] = tile;
 }
 
-void PathOverlay::drawPaths(QPainter &painter, QString const& label, QRegion const& region, bool const plain, bool const toCache)
+void PathOverlay::drawCachedPaths(QPainter& painter, QRegion const& region)
+{
+    if (master->page == nullptr)
+        return;
+    QString const label = master->page->label();
+    if (end_cache <= 0) {
+        // Nothing is cached.
+        drawPaths(painter, label, region);
+        return;
+    }
+    // Draw the cached tiles and collect the tiles, which must be drawn directly.
+    QRegion liveRegion;
+    for (int t=0; t<tiles.size(); t++) {
+        QRect const rect = tileRect(t);
+        if (!region.intersects(rect))
+            continue;
+        if (!liveTiles[t] && tiles[t].isNull())
+            renderTile(t);
+        if (liveTiles[t])
+            liveRegion += rect;
+        else {
+            painter.setCompositionMode(QPainter::CompositionMode_SourceOver);
+            painter.drawPixmap(rect.topLeft(), tiles[t]);
+        }
+    }
+    if (!liveRegion.isEmpty())
+        drawPaths(painter, label, liveRegion & region, false, 0, end_cache);
+    // Draw the paths, which are not cached yet.
+    drawPaths(painter, label, region, false, end_cache);
+}
+
+void PathOverlay::drawPaths(QPainter &painter, QString const& label, QRegion const& region, bool const plain, int const first, int last)
 {
 #ifdef DEBUG_DRAWING
-    qDebug() << "draw paths" << label << plain << toCache << end_cache << this;
+    qDebug() << "draw paths" << label << plain << first << last << this;
 #endif
     // TODO: reorganize the different conditions (especially plain)
 
@@ -297,21 +430,28 @@ void PathOverlay::drawPaths(QPainter &painter, QString const& label, QRegion con
 
     // Draw the paths.
     if (paths.contains(label)) {
-        QList<DrawPath*>::const_iterator path_it = paths[label].cbegin();
-        if (!plain) {
-            // If end_cache >= 0: some paths have been drawn already. Skip them.
-            if (label == master->page->label() && end_cache > 0)
-                path_it += end_cache;
-        }
-        // Iterate over all remaining paths.
-        for (; path_it!=paths[label].cend(); path_it++) {
-            if (region.intersects((*path_it)->getOuterDrawing().toAlignedRect())) {
+        QList<DrawPath*> const& list = paths[label];
+        if (last < 0 || last > list.length())
+            last = list.length();
+        if (first >= last)
+            return;
+        // If only a small region needs to be drawn, use the spatial index to find the paths close to this region.
+        // Paths which only have a large bounding box overlapping with the region are skipped.
+        QRect const bounding = region.boundingRect();
+        bool const useIndex = 4*qint64(bounding.width())*bounding.height() < qint64(width())*height();
+        QSet<DrawPath const*> candidates;
+        if (useIndex)
+            candidates = indexedPaths(label).pathsNear(bounding);
+        // Buffer for the nodes of a path in the format required by QPainter.
+        QVector<QPointF> polyline;
+        // Iterate over all paths in the given range.
+        for (QList<DrawPath*>::const_iterator path_it = list.cbegin() + first; path_it!=list.cbegin() + last; path_it++) {
+            if ((!useIndex || candidates.contains(*path_it)) && region.intersects((*path_it)->getOuterDrawing().toAlignedRect())) {
                 FullDrawTool const& tool = (*path_it)->getTool();
                 switch (tool.tool) {
                 case Pen:
                     painter.setCompositionMode(QPainter::CompositionMode_SourceOver);
-                    painter.setPen(QPen(tool.color, tool.size, Qt::SolidLine, Qt::RoundCap, Qt::RoundJoin));
-                    painter.drawPolyline((*path_it)->data(), (*path_it)->number());
+                    drawStroke(painter, *path_it, polyline);
                     break;
                 case Highlighter:
                 {
@@ -320,16 +460,7 @@ void PathOverlay::drawPaths(QPainter &painter, QString const& label, QRegion con
                         // Drawing this background is only reasonable if there is no video widget in the background.
                         // Check this.
                         QRect const outer = (*path_it)->getOuterDrawing().toAlignedRect();
-                        if (hasVideoOverlap(outer)) {
-                            if (toCache) {
-                                end_cache = path_it - paths[label].cbegin();
-#ifdef DEBUG_DRAWING
-                                qDebug() << "Stopped caching paths:" << end_cache;
-#endif
-                                return;
-                            }
-                        }
-                        else {
+                        if (!hasVideoOverlap(outer)) {
                             // Draw the background form master->pixmap.
                             painter.setCompositionMode(QPainter::CompositionMode_DestinationOver);
                             painter.drawPixmap(outer, master->pixmap, outer.translated(-master->shiftx, -master->shifty));
@@ -343,8 +474,7 @@ void PathOverlay::drawPaths(QPainter &painter, QString const& label, QRegion con
                     }
                     // Draw the highlighter path.
                     painter.setCompositionMode(QPainter::CompositionMode_Darken);
-                    painter.setPen(QPen(tool.color, tool.size, Qt::SolidLine, Qt::RoundCap, Qt::RoundJoin));
-                    painter.drawPolyline((*path_it)->data(), (*path_it)->number());
+                    drawStroke(painter, *path_it, polyline);
                 }
                     break;
                 default:
@@ -353,8 +483,6 @@ void PathOverlay::drawPaths(QPainter &painter, QString const& label, QRegion con
             }
         }
     }
-    if (toCache)
-        end_cache = paths[master->page->label()].length();
 }
 
 bool PathOverlay::hasVideoOverlap(QRectF const& rect) const
@@ -411,7 +539,9 @@ bool PathOverlay::event(QEvent *event)
             case Highlighter:
                 if (!paths.contains(master->page->label()))
                     paths[master->page->label()] = QList<DrawPath*>();
-                paths[master->page->label()].append(new DrawPath(*tablettool, tabletEvent->posF()));
+                // Mouse events have no pressure. Only strokes drawn with a tablet are pressure sensitive.
+                paths[master->page->label()].append(new DrawPath(*tablettool, tabletEvent->posF(), pressureSensitive ? float(tabletEvent->pressure()) : -1.f));
+                sendOperations({DrawOperation(DrawOperation::AddPaths, paths[master->page->label()].length()-1, *paths[master->page->label()].last())});
                 break;
             case Eraser:
                 erase(tabletEvent->posF());
@@ -468,9 +598,9 @@ bool PathOverlay::event(QEvent *event)
             case Highlighter:
                 // TODO: handle pointer simultaneously
                 if (!paths[master->page->label()].isEmpty()) {
-                    paths[master->page->label()].last()->append(tabletEvent->posF());
+                    paths[master->page->label()].last()->append(tabletEvent->posF(), float(tabletEvent->pressure()));
                     update(paths[master->page->label()].last()->getOuterLast());
-                    emit pathsChangedQuick(master->page->label(), paths[master->page->label()], master->shiftx, master->shifty, master->resolution);
+                    sendOperations({DrawOperation(DrawOperation::AppendNodes, paths[master->page->label()].length()-1, *paths[master->page->label()].last())});
                 }
                 break;
             case Eraser:
@@ -557,8 +687,9 @@ bool PathOverlay::event(QEvent *event)
             case Highlighter:
                 if (!paths.contains(master->page->label()) || paths[master->page->label()].isEmpty())
                     return false;
-                paths[master->page->label()].last()->endDrawing();
-                emit pathsChangedQuick(master->page->label(), paths[master->page->label()], master->shiftx, master->shifty, master->resolution);
+                paths[master->page->label()].last()->endDrawing(strokeTolerance*master->resolution, smoothStrokes);
+                // Simplifying or smoothing the stroke can change all nodes.
+                sendOperations({DrawOperation(strokeTolerance > 0. || smoothStrokes ? DrawOperation::ReplacePath : DrawOperation::AppendNodes, paths[master->page->label()].length()-1, *paths[master->page->label()].last())});
                 update();
                 [[clang::fallthrough]];
             case Eraser:
@@ -614,6 +745,7 @@ void PathOverlay::mousePressEvent(QMouseEvent *event)
             if (!paths.contains(master->page->label()))
                 paths[master->page->label()] = QList<DrawPath*>();
             paths[master->page->label()].append(new DrawPath(tool, event->localPos()));
+            sendOperations({DrawOperation(DrawOperation::AddPaths, paths[master->page->label()].length()-1, *paths[master->page->label()].last())});
             break;
         case Eraser:
             erase(event->localPos());
@@ -681,8 +813,9 @@ void PathOverlay::mouseReleaseEvent(QMouseEvent *event)
         case Highlighter:
             if (!paths.contains(master->page->label()) || paths[master->page->label()].isEmpty())
                 break;
-            paths[master->page->label()].last()->endDrawing();
-            emit pathsChangedQuick(master->page->label(), paths[master->page->label()], master->shiftx, master->shifty, master->resolution);
+            paths[master->page->label()].last()->endDrawing(strokeTolerance*master->resolution, smoothStrokes);
+            // Simplifying or smoothing the stroke can change all nodes.
+            sendOperations({DrawOperation(strokeTolerance > 0. || smoothStrokes ? DrawOperation::ReplacePath : DrawOperation::AppendNodes, paths[master->page->label()].length()-1, *paths[master->page->label()].last())});
             update();
             [[clang::fallthrough]];
         case Eraser:
@@ -744,7 +877,7 @@ void PathOverlay::mouseMoveEvent(QMouseEvent* event)
             if (!paths[master->page->label()].isEmpty()) {
                 paths[master->page->label()].last()->append(event->localPos());
                 update(paths[master->page->label()].last()->getOuterLast());
-                emit pathsChangedQuick(master->page->label(), paths[master->page->label()], master->shiftx, master->shifty, master->resolution);
+                sendOperations({DrawOperation(DrawOperation::AppendNodes, paths[master->page->label()].length()-1, *paths[master->page->label()].last())});
             }
             break;
         case Eraser:
@@ -783,96 +916,185 @@ void PathOverlay::erase(const QPointF &point)
     if (master->page == nullptr || paths[master->page->label()].isEmpty())
         return;
     QList<DrawPath*>& path_list = paths[master->page->label()];
-    int const oldsize = path_list.size();
+    // Find the nodes close to point using the spatial index.
+    // This gives the same result as DrawPath::intersects for each path.
+    QHash<DrawPath const*, QVector<int>> near = indexedPaths(master->page->label()).nodesNear(point, tool.tool == Eraser ? tool.size : eraserSize);
+    int const oldLength = path_list.size();
     QRegion updateRegion;
-    for (int i=0; i<oldsize; i++) {
-        QVector<int> splits = path_list[i]->intersects(point, tool.tool == Eraser ? tool.size : eraserSize);
+    // Changes sent to other overlays. The indices refer to the list after applying all previous operations.
+    QList<DrawOperation> operations;
+    // New paths created by splitting are inserted after the current path. They are not contained in near.
+    // Handled paths are removed from near, because their memory can be reused by new paths.
+    for (int i=0; i<path_list.size() && !near.isEmpty(); i++) {
+        QVector<int> const splits = near.take(path_list[i]);
         if (splits.isEmpty())
             continue;
-        updateRegion += path_list[i]->getOuterDrawing().toAlignedRect();
+        DrawPath* const path = path_list[i];
+        updateRegion += path->getOuterDrawing().toAlignedRect();
+        QList<DrawPath*> pieces;
         if (splits.first() > 1)
-            path_list.insert(i+1, path_list[i]->split(0, splits.first()-1));
+            pieces.append(path->split(0, splits.first()-1));
         for (int s=0; s<splits.size()-1; s++) {
             if (splits[s+1]-splits[s] > 3) {
-                path_list.insert(i+1, path_list[i]->split(splits[s]+1, splits[s+1]-1));
+                pieces.append(path->split(splits[s]+1, splits[s+1]-1));
                 s++;
             }
         }
-        if (splits.last() < path_list[i]->number()-2)
-            path_list.insert(i+1, path_list[i]->split(splits.last()+1, path_list[i]->number()));
-        delete path_list[i];
-        path_list[i] = nullptr;
-    }
-    for (int i=0; i<path_list.size();) {
-        if (path_list[i] == nullptr)
-            path_list.removeAt(i);
-#ifdef DEBUG_DRAWING
-        // TODO: check again:
-        else if (path_list[i]->isEmpty()) { // this should never happen...
-            qDebug() << "this should never happen.";
-            delete path_list[i];
-            path_list.removeAt(i);
+        if (splits.last() < path->number()-2)
+            pieces.append(path->split(splits.last()+1, path->number()));
+        operations.append(DrawOperation(DrawOperation::RemovePaths, i, 1));
+        path_list.removeAt(i);
+        delete path;
+        if (!pieces.isEmpty()) {
+            DrawOperation insertion(DrawOperation::AddPaths, i);
+            for (int p=0; p<pieces.size(); p++) {
+                path_list.insert(i+p, pieces[p]);
+                insertion.paths.append(*pieces[p]);
+            }
+            operations.append(insertion);
         }
-#endif
-        else
-            i++;
+        // Continue after the new pieces.
+        i += pieces.size() - 1;
     }
     if (!updateRegion.isEmpty()) {
-        end_cache = -1;
+        // Only the tiles of the path cache containing erased paths must be rendered again.
+        updateCacheAfterChange(oldLength, path_list.size(), updateRegion);
         update(updateRegion);
-        emit pathsChanged(master->page->label(), path_list, master->shiftx, master->shifty, master->resolution);
+        sendOperations(operations);
     }
 }
 
-void PathOverlay::setPathsQuick(QString const pagelabel, QList<DrawPath*> const& list, qint16 const refshiftx, qint16 const refshifty, double const refresolution)
+PathIndex const& PathOverlay::indexedPaths(QString const& label)
 {
-    QPointF shift = QPointF(master->shiftx, master->shifty) - master->resolution/refresolution*QPointF(refshiftx, refshifty);
-    int const diff = list.length() - paths[pagelabel].length();
-    if (diff == 0) {
-        QRect const rect = paths[pagelabel].last()->update(*list.last(), shift, master->resolution/refresolution);
-        if (rect.isValid())
-            update(rect);
-        else
-            setPaths(pagelabel, list, refshiftx, refshifty, refresolution);
-    }
-    else if (diff == 1) {
-        paths[pagelabel].append(new DrawPath(*list.last(), shift, master->resolution/refresolution));
-        update(paths[pagelabel].last()->getOuterDrawing().toAlignedRect());
-    }
-    else if (diff < 0) {
-        if (diff == -1 && paths[pagelabel].length() >= 1) {
-           DrawPath* path = paths[pagelabel].takeLast();
-           update(path->getOuterDrawing().toAlignedRect());
-           delete path;
+    PathIndex& index = pathIndex[label];
+    index.sync(paths.value(label));
+    return index;
+}
+
+void PathOverlay::pathsReplaced(QString const& label)
+{
+    // The index and the cache might refer to deleted paths, which could share their address with new paths.
+    pathIndex.remove(label);
+    if (master->page != nullptr && master->page->label() == label)
+        clearPathCache();
+}
+
+void PathOverlay::sendOperations(QList<DrawOperation> const& operations)
+{
+    QString const label = master->page->label();
+    changedPages.insert(label);
+    emit pathOperations(label, operations, paths[label], master->shiftx, master->shifty, master->resolution);
+}
+
+void PathOverlay::applyOperations(QString const pagelabel, QList<DrawOperation> const& operations, QList<DrawPath*> const& list, qint16 const refshiftx, qint16 const refshifty, double const refresolution)
+{
+    QPointF const shift = QPointF(master->shiftx, master->shifty) - master->resolution/refresolution*QPointF(refshiftx, refshifty);
+    double const scale = master->resolution/refresolution;
+    bool const isCurrentPage = master->page != nullptr && master->page->label() == pagelabel;
+    changedPages.insert(pagelabel);
+    QList<DrawPath*>& target = paths[pagelabel];
+    int const oldLength = target.length();
+    // Region containing all changed paths.
+    QRegion changed;
+    // Smallest index of a changed path. If this path is cached, the path cache must be updated.
+    int firstChanged = oldLength;
+    bool valid = true;
+    for (QList<DrawOperation>::const_iterator op=operations.cbegin(); valid && op!=operations.cend(); op++) {
+        switch (op->type)
+        {
+        case DrawOperation::AddPaths:
+            if (op->index < 0 || op->index > target.length()) {
+                valid = false;
+                break;
+            }
+            for (int i=0; i<op->paths.length(); i++) {
+                target.insert(op->index + i, new DrawPath(op->paths[i], shift, scale));
+                changed += target[op->index + i]->getOuterDrawing().toAlignedRect();
+            }
+            break;
+        case DrawOperation::AppendNodes:
+        {
+            if (op->index < 0 || op->index >= target.length() || op->paths.isEmpty()) {
+                valid = false;
+                break;
+            }
+            QRect const rect = target[op->index]->update(op->paths.first(), shift, scale);
+            if (rect.isValid())
+                changed += rect;
+            else
+                valid = false;
+            break;
         }
-        else if (-diff >= paths[pagelabel].length()) {
-            qDeleteAll(paths[pagelabel]);
-            paths[pagelabel].clear();
-            update();
+        case DrawOperation::ReplacePath:
+            if (op->index < 0 || op->index >= target.length() || op->paths.isEmpty()) {
+                valid = false;
+                break;
+            }
+            changed += target[op->index]->getOuterDrawing().toAlignedRect();
+            delete target[op->index];
+            target[op->index] = new DrawPath(op->paths.first(), shift, scale);
+            changed += target[op->index]->getOuterDrawing().toAlignedRect();
+            break;
+        case DrawOperation::RemovePaths:
+            if (op->index < 0 || op->index + op->count > target.length()) {
+                valid = false;
+                break;
+            }
+            for (int i=0; i<op->count; i++) {
+                changed += target[op->index]->getOuterDrawing().toAlignedRect();
+                delete target.takeAt(op->index);
+            }
+            break;
         }
-        else {
-            for (int i=diff; i++<0;)
-                delete paths[pagelabel].takeLast();
-            update();
+        if (op->index < firstChanged)
+            firstChanged = op->index;
+    }
+    // Check that the changed paths agree with the ones of the sender.
+    if (valid && target.length() == list.length()) {
+        for (QList<DrawOperation>::const_iterator op=operations.cbegin(); op!=operations.cend(); op++) {
+            if (op->type == DrawOperation::RemovePaths)
+                continue;
+            for (int i=op->index; i<op->index + op->paths.length() && i<target.length(); i++) {
+                if (target[i]->getHash() != list[i]->getHash()) {
+                    valid = false;
+                    break;
+                }
+            }
         }
-        end_cache = -1;
-        pixpaths = QPixmap();
     }
-    else {
+    else
+        valid = false;
+    if (!valid) {
 #ifdef DEBUG_DRAWING
-        qDebug() << "set paths quick failed!" << this;
+        qDebug() << "applying draw operations failed!" << this;
 #endif
+        // The paths of both overlays differ. Compare the complete lists.
+        // The cached tiles may contain partially applied changes.
+        if (isCurrentPage)
+            clearPathCache();
         setPaths(pagelabel, list, refshiftx, refshifty, refresolution);
+        return;
     }
+    if (!isCurrentPage)
+        return;
+    // Changes only affecting paths after end_cache do not touch the path cache.
+    if (end_cache >= 0 && firstChanged < end_cache)
+        updateCacheAfterChange(oldLength, target.length(), changed);
+    update(changed);
 }
 
 void PathOverlay::setPaths(QString const pagelabel, QList<DrawPath*> const& list, qint16 const refshiftx, qint16 const refshifty, double const refresolution)
 {
     QPointF shift = QPointF(master->shiftx, master->shifty) - master->resolution/refresolution*QPointF(refshiftx, refshifty);
+    int const oldLength = paths.value(pagelabel).length();
+    changedPages.insert(pagelabel);
+    // Region containing all removed and added paths.
+    QRegion changed;
     if (!paths.contains(pagelabel)) {
         paths[pagelabel] = QList<DrawPath*>();
         for (QList<DrawPath*>::const_iterator it = list.cbegin(); it!=list.cend(); it++)
             paths[pagelabel].append(new DrawPath(**it, shift, master->resolution/refresolution));
+        changed = QRegion(rect());
     }
     else {
         // Basic assumption: If list and paths[pagelabel] both contain two elements, then these elements appear in the same order in both lists.
@@ -881,11 +1103,14 @@ void PathOverlay::setPaths(QString const pagelabel, QList<DrawPath*> const& list
         for (;new_it<list.cend() && old_it<paths[pagelabel].end() && (*new_it)->getHash() == (*old_it)->getHash(); new_it++, old_it++) {}
         if (old_it >= paths[pagelabel].end()-1) {
             if (old_it == paths[pagelabel].end()-1) {
+                changed += (*old_it)->getOuterDrawing().toAlignedRect();
                 delete *old_it;
                 paths[pagelabel].pop_back();
             }
-            while (new_it < list.cend())
+            while (new_it < list.cend()) {
                 paths[pagelabel].append(new DrawPath(**(new_it++), shift, master->resolution/refresolution));
+                changed += paths[pagelabel].last()->getOuterDrawing().toAlignedRect();
+            }
         }
         else {
             // create look up table for new hashs
@@ -897,23 +1122,32 @@ void PathOverlay::setPaths(QString const pagelabel, QList<DrawPath*> const& list
                 // next new path which exists already in the old paths:
                 next = newHashs.value((*old_it)->getHash(), list.cend());
                 if (next == list.cend()) {
+                    changed += (*old_it)->getOuterDrawing().toAlignedRect();
                     delete *old_it;
                     old_it = paths[pagelabel].erase(old_it);
                 }
                 else {
-                    while (new_it < next)
-                        old_it = paths[pagelabel].insert(old_it, new DrawPath(**(new_it++), shift, master->resolution/refresolution)) + 1;
+                    while (new_it < next) {
+                        old_it = paths[pagelabel].insert(old_it, new DrawPath(**(new_it++), shift, master->resolution/refresolution));
+                        changed += (*old_it)->getOuterDrawing().toAlignedRect();
+                        old_it++;
+                    }
                     new_it++;
                     old_it++;
                 }
             }
-            while (new_it < list.cend())
+            while (new_it < list.cend()) {
                 paths[pagelabel].append(new DrawPath(**(new_it++), shift, master->resolution/refresolution));
+                changed += paths[pagelabel].last()->getOuterDrawing().toAlignedRect();
+            }
         }
     }
-    end_cache = -1;
+    if (master->page == nullptr || master->page->label() != pagelabel)
+        return;
+    // Only tiles of the path cache containing changed paths must be rendered again.
+    updateCacheAfterChange(oldLength, paths[pagelabel].length(), changed);
     updatePathCache();
-    update();
+    update(changed);
 }
 
 void PathOverlay::setPointerPosition(QPointF const point, qint16 const refshiftx, qint16 const refshifty, double const refresolution)
@@ -923,7 +1157,7 @@ void PathOverlay::setPointerPosition(QPointF const point, qint16 const refshiftx
     }
     else {
         pointerPosition = (point - QPointF(refshiftx, refshifty)) * master->resolution/refresolution + QPointF(master->shiftx, master->shifty);
-        if (tool.tool == Magnifier && enlargedPage.isNull())
+        if (tool.tool == Magnifier && magnifierRenderer == nullptr)
             updateEnlargedPage();
     }
     if (tool.tool == Pointer || tool.tool == Magnifier || tool.tool == Torch)
@@ -946,7 +1180,7 @@ void PathOverlay::setStylusPosition(QPointF const point, qint16 const refshiftx,
         qDebug() << "update stylus position" << this;
 #endif
         stylusPosition = (point - QPointF(refshiftx, refshifty)) * master->resolution/refresolution + QPointF(master->shiftx, master->shifty);
-        if (thetool->tool == Magnifier && enlargedPage.isNull())
+        if (thetool->tool == Magnifier && magnifierRenderer == nullptr)
             updateEnlargedPage();
     }
     if (thetool->tool == Pointer || thetool->tool == Torch || thetool->tool == Magnifier)
@@ -980,82 +1214,375 @@ void PathOverlay::updateEnlargedPage()
         thetool = &stylusTool;
     // Check whether an update is required.
     if (thetool->tool != Magnifier || master->page == nullptr || thetool->extras.magnification < 1e-12) {
-        if (!enlargedPage.isNull())
-            enlargedPage = QPixmap();
+        if (magnifierRenderer != nullptr)
+            magnifierRenderer->clearTiles();
         return;
     }
-    // Create enlargedPageRenderer if necessary.
-    if (enlargedPageRenderer == nullptr) {
-        enlargedPageRenderer = new SingleRenderer(master->doc, master->pagePart, this);
-        connect(enlargedPageRenderer, &BasicRenderer::cacheThreadFinished, this, &PathOverlay::updateEnlargedPage);
+    // Create magnifierRenderer if necessary.
+    if (magnifierRenderer == nullptr) {
+        magnifierRenderer = new TileRenderer(master->doc, master->pagePart, this);
+        connect(magnifierRenderer, &BasicRenderer::cacheThreadFinished, this, &PathOverlay::updateEnlargedPage);
     }
-    // Render page using enlargedPageRenderer if necessary (the rendering is done in a separate thread).
-    if (enlargedPageRenderer->getPage() != master->pageIndex || std::abs(enlargedPageRenderer->getResolution() - thetool->extras.magnification*master->resolution) > 1e-6 ) {
-        enlargedPageRenderer->changeResolution(thetool->extras.magnification*master->resolution);
-        enlargedPage = QPixmap();
-#ifdef DEBUG_DRAWING
-        qDebug() << "Rendering enlarged page" << master->pageIndex;
-#endif
-        enlargedPageRenderer->renderPage(master->pageIndex);
-        // Return if the enlarged page image is not needed right now.
-        // This makes scanning through the slides much faster.
-        if (QApplication::mouseButtons() != Qt::LeftButton)
-            return;
+    // Changing page or resolution drops all tiles. Tiles are requested when the magnifier is drawn.
+    magnifierRenderer->setPage(master->pageIndex);
+    magnifierRenderer->changeResolution(thetool->extras.magnification*master->resolution);
+    update();
+}
+
+void PathOverlay::drawMagnifier(QPainter& painter, FullDrawTool const& magnifier, QPointF const& position)
+{
+    qreal const magnification = magnifier.extras.magnification;
+    if (magnification < 1e-12)
+        return;
+    // A point p in this widget is shown at magnification*p + offset.
+    QPointF const offset = (1 - magnification)*position;
+    // Visible part of the enlarged page in coordinates of the rendered page.
+    QPointF const pageOrigin = magnification*QPointF(master->shiftx, master->shifty);
+    QRect const area = QRectF(magnification*position - pageOrigin - QPointF(magnifier.size, magnifier.size), QSizeF(2*magnifier.size, 2*magnifier.size)).toAlignedRect();
+    magnifierRenderer->request(area, magnification*(position - lastMagnifierPosition));
+    lastMagnifierPosition = position;
+
+    painter.save();
+    painter.setCompositionMode(QPainter::CompositionMode_SourceOver);
+    painter.setClipping(true);
+    QPainterPath path;
+    path.addEllipse(position, magnifier.size, magnifier.size);
+    painter.setClipPath(path, Qt::ReplaceClip);
+    // Draw a scaled version of the slide first. Missing tiles show this until they are rendered.
+    QRectF const visible(position - QPointF(magnifier.size, magnifier.size)/magnification, 2*QSizeF(magnifier.size, magnifier.size)/magnification);
+    QRectF const source = visible.translated(-master->shiftx, -master->shifty) & QRectF(master->pixmap.rect());
+    if (!source.isEmpty())
+        painter.drawPixmap(QRectF(magnification*source.topLeft() + pageOrigin + offset, magnification*source.size()), master->pixmap, source);
+    // Draw the tiles, which are available.
+    int const tile = TileRenderer::tileSize;
+    QPointF const tileOrigin = pageOrigin + offset;
+    for (int row=qMax(area.top(), 0)/tile; row<=area.bottom()/tile; row++) {
+        for (int column=qMax(area.left(), 0)/tile; column<=area.right()/tile; column++) {
+            QPixmap const pixmap = magnifierRenderer->getTile(column, row);
+            if (!pixmap.isNull())
+                painter.drawPixmap(tileOrigin + QPointF(column*tile, row*tile), pixmap);
+        }
     }
-    // Draw enlargedPage.
-    enlargedPage = QPixmap(thetool->extras.magnification*size());
-    enlargedPage.fill(QColor(0,0,0,0));
-    QPainter painter;
-    painter.begin(&enlargedPage);
-    // Draw the slide.
-    if (enlargedPageRenderer->resultReady())
-        // If a rendered page is ready in enlargedPageRenderer: show it in enlargedPage.
-        painter.drawPixmap(
-                    int(thetool->extras.magnification*master->shiftx),
-                    int(thetool->extras.magnification*master->shifty),
-                    enlargedPageRenderer->getPixmap()
-                    );
+    // Draw the paths scaled by the magnification. No copies of the paths are needed.
+    painter.translate(offset);
+    painter.scale(magnification, magnification);
+    drawPaths(painter, master->page->label(), QRegion(visible.toAlignedRect()), true);
+    painter.restore();
+    painter.setPen(QPen(magnifier.color, 2));
+    painter.drawEllipse(position, magnifier.size, magnifier.size);
+}
+
+/// Magic bytes identifying binary drawing files.
+static char const drawingsMagic[] = "BPDR";
+/// Version of the binary drawing file format. Files of newer versions are not read.
+/// Version 2 adds an optional pressure value for each node of a stroke.
+static quint16 const drawingsVersion = 2;
+/// Flag in the header of binary drawing files: the data of each page is compressed with zlib.
+static quint16 const drawingsCompressed = 0x1;
+
+void PathOverlay::pageGeometry(QString const& label, QPoint& shift, qreal& scale) const
+{
+    Poppler::Page const* page = master->doc->getPage(label);
+    QSizeF size;
+    if (page == nullptr)
+        size = master->page->pageSizeF();
     else
-        // Otherwise: show a scaled version of the page image.
-        painter.drawPixmap(
-                    int(thetool->extras.magnification*master->shiftx),
-                    int(thetool->extras.magnification*master->shifty),
-                    master->pixmap.scaled(thetool->extras.magnification*master->pixmap.size(), Qt::IgnoreAspectRatio, Qt::SmoothTransformation)
-                    );
-    // Draw annotations.
-    painter.setRenderHint(QPainter::Antialiasing);
-    if (paths.contains(master->page->label())) {
-        for (QList<DrawPath*>::const_iterator path_it=paths[master->page->label()].cbegin(); path_it!=paths[master->page->label()].cend(); path_it++) {
-            FullDrawTool const& tool = (*path_it)->getTool();
-            switch (tool.tool) {
-            case Pen:
-            {
-                painter.setCompositionMode(QPainter::CompositionMode_SourceOver);
-                painter.setPen(QPen(tool.color, thetool->extras.magnification*tool.size));
-                DrawPath tmp(**path_it, QPointF(0,0), thetool->extras.magnification);
-                painter.drawPolyline(tmp.data(), tmp.number());
+        size = page->pageSizeF();
+    shift = QPoint();
+    if (size.width() * height() >= width() * size.height()) {
+        shift.setY(( height() - size.height()/size.width() * width() )/2);
+        scale = width() / size.width();
+    }
+    else {
+        shift.setX((width() - size.width()/size.height() * height() )/2);
+        scale = height() / size.height();
+    }
+}
+
+bool PathOverlay::loadBinary(QFile& file, PdfDoc const* notesDoc)
+{
+    // Binary format (little endian):
+    //   header: magic bytes "BPDR", quint16 version, quint16 flags,
+    //           path, number of pages and modification time of presentation and notes file
+    //   chunks: quint32 size of the chunk in bytes, data of one page (compressed if flags contain drawingsCompressed)
+    //   end:    quint32 0
+    // Data of a page: label, quint32 number of styles, styles (tool name, quint32 ARGB color, float width in points),
+    //   quint32 number of strokes, strokes (quint32 style index, quint32 number of nodes, quint8 pressure flag (version >= 2),
+    //   all x coordinates, all y coordinates, all pressures if the pressure flag is set).
+    // All coordinates are floats in points (inch/72).
+    QDataStream stream(&file);
+    stream.setByteOrder(QDataStream::LittleEndian);
+    QByteArray magic(4, '\0');
+    quint16 version, flags;
+    stream.readRawData(magic.data(), 4);
+    stream >> version >> flags;
+    if (magic != QByteArray(drawingsMagic, 4) || stream.status() != QDataStream::Ok) {
+        qCritical() << "Loading file failed: file is not a valid drawing file.";
+        return false;
+    }
+    if (version > drawingsVersion) {
+        qCritical() << "Loading file failed: file was created by a newer version of BeamerPresenter.";
+        return false;
+    }
+
+    // Check whether the presentation and notes files are as expected and warn otherwise.
+    {
+        QString presentationPath, presentationModified, notesPath, notesModified;
+        qint32 presentationPages, notesPages;
+        stream >> presentationPath >> presentationPages >> presentationModified >> notesPath >> notesPages >> notesModified;
+        QFileInfo const& presentation_fileinfo = QFileInfo(master->doc->getPath());
+        if (presentationPath != presentation_fileinfo.absoluteFilePath())
+            qWarning() << "This drawing file was generated for a different PDF file path.";
+        if (presentationModified != presentation_fileinfo.lastModified().toString("yyyy-MM-dd hh:mm:ss"))
+            qWarning() << "The presentation file has been modified since writing the drawing file.";
+        if (presentationPages != master->doc->getDoc()->numPages())
+            qWarning() << "The numbers of pages in the presentation and drawing file do not match!";
+        QFileInfo const& notes_fileinfo = QFileInfo(notesDoc->getPath());
+        if (notesPath != notes_fileinfo.absoluteFilePath())
+            qWarning() << "This drawing file was generated for a different PDF file path.";
+        if (notesModified != notes_fileinfo.lastModified().toString("yyyy-MM-dd hh:mm:ss"))
+            qWarning() << "The notes file has been modified since writing the drawing file.";
+        if (notesPages != notesDoc->getDoc()->numPages())
+            qWarning() << "The numbers of pages in the notes and drawing file do not match!";
+    }
+
+    // Read the file page by page.
+    QVector<float> xs, ys, pressures;
+    while (true) {
+        // Autosave files do not contain the end marker.
+        if (stream.atEnd())
+            break;
+        quint32 chunkSize;
+        stream >> chunkSize;
+        if (stream.status() != QDataStream::Ok || chunkSize > quint32(file.size())) {
+            qCritical() << "Loading file failed: file is truncated or corrupt.";
+            return false;
+        }
+        if (chunkSize == 0)
+            break;
+        QByteArray chunk(int(chunkSize), Qt::Uninitialized);
+        if (stream.readRawData(chunk.data(), int(chunkSize)) != int(chunkSize)) {
+            qCritical() << "Loading file failed: file is truncated.";
+            return false;
+        }
+        if (flags & drawingsCompressed)
+            chunk = qUncompress(chunk);
+        QDataStream page(chunk);
+        page.setByteOrder(QDataStream::LittleEndian);
+        page.setFloatingPointPrecision(QDataStream::SinglePrecision);
+
+        QString label;
+        quint32 numberStyles;
+        page >> label >> numberStyles;
+        if (page.status() != QDataStream::Ok || numberStyles > quint32(chunk.size())) {
+            qCritical() << "Loading file failed: file is corrupt.";
+            return false;
+        }
+        QPoint shift;
+        qreal scale;
+        pageGeometry(label, shift, scale);
+        QList<FullDrawTool> styles;
+        for (quint32 i=0; i<numberStyles; i++) {
+            QString name;
+            quint32 color;
+            float width;
+            page >> name >> color >> width;
+            styles.append({toolNames.key(name, NoTool), QColor::fromRgba(color), scale*width, {0.}});
+        }
+
+        QList<DrawPath*>& list = paths[label];
+        qDeleteAll(list);
+        list.clear();
+        pathsReplaced(label);
+        quint32 numberStrokes;
+        page >> numberStrokes;
+        bool valid = page.status() == QDataStream::Ok;
+        for (quint32 i=0; valid && i<numberStrokes; i++) {
+            quint32 style, number;
+            quint8 hasPressure = 0;
+            page >> style >> number;
+            if (version >= 2)
+                page >> hasPressure;
+            // Each node needs 8 bytes.
+            if (page.status() != QDataStream::Ok || style >= quint32(styles.length()) || number > quint32(chunk.size())/8) {
+                valid = false;
                 break;
             }
-            case Highlighter:
-            {
-                painter.setCompositionMode(QPainter::CompositionMode_Darken);
-                painter.setPen(QPen(tool.color, thetool->extras.magnification*tool.size, Qt::SolidLine, Qt::RoundCap, Qt::RoundJoin));
-                DrawPath tmp(**path_it, QPointF(0,0), thetool->extras.magnification);
-                painter.drawPolyline(tmp.data(), tmp.number());
-                break;
+            xs.resize(int(number));
+            ys.resize(int(number));
+            for (int j=0; j<int(number); j++) {
+                page >> xs[j];
+                xs[j] = float(shift.x() + scale*xs[j]);
             }
-            default:
-                break;
+            for (int j=0; j<int(number); j++) {
+                page >> ys[j];
+                ys[j] = float(shift.y() + scale*ys[j]);
             }
+            pressures.resize(hasPressure ? int(number) : 0);
+            for (int j=0; j<pressures.length(); j++)
+                page >> pressures[j];
+            valid = page.status() == QDataStream::Ok;
+            if (valid && number > 0 && styles[int(style)].tool != NoTool) {
+                list.append(new DrawPath(styles[int(style)], xs.constData(), ys.constData(), int(number)));
+                list.last()->setPressures(pressures);
+            }
+        }
+        changedPages.insert(label);
+        emit pathsChanged(label, list, master->shiftx, master->shifty, master->resolution);
+        if (!valid) {
+            qCritical() << "Loading file failed: drawings on page" << label << "are corrupt.";
+            return false;
         }
     }
-    update();
+    return true;
+}
+
+QByteArray const PathOverlay::binaryHeader(PdfDoc const* notedoc, bool const compress) const
+{
+    QByteArray header;
+    QDataStream stream(&header, QIODevice::WriteOnly);
+    stream.setByteOrder(QDataStream::LittleEndian);
+    stream.writeRawData(drawingsMagic, 4);
+    stream << drawingsVersion << quint16(compress ? drawingsCompressed : 0);
+    stream << QFileInfo(master->doc->getPath()).absoluteFilePath()
+           << qint32(master->doc->getDoc()->numPages())
+           << master->doc->getLastModified().toString("yyyy-MM-dd hh:mm:ss");
+    stream << QFileInfo(notedoc->getPath()).absoluteFilePath()
+           << qint32(notedoc->getDoc()->numPages())
+           << notedoc->getLastModified().toString("yyyy-MM-dd hh:mm:ss");
+    return header;
+}
+
+PathOverlay::PageSnapshot const PathOverlay::pageSnapshot(QString const& label) const
+{
+    PageSnapshot snapshot {label, QList<DrawPath>(), QPoint(), 1.};
+    pageGeometry(label, snapshot.shift, snapshot.scale);
+    QList<DrawPath*> const& list = paths.value(label);
+    for (QList<DrawPath*>::const_iterator path_it=list.cbegin(); path_it!=list.cend(); path_it++)
+        snapshot.paths.append(**path_it);
+    return snapshot;
+}
+
+QByteArray const PathOverlay::encodePage(PageSnapshot const& page, bool const compress)
+{
+    // Tools used on this page. Strokes only store an index in this list.
+    QList<FullDrawTool const*> styles;
+    QVector<quint32> styleIndices;
+    styleIndices.reserve(page.paths.length());
+    for (QList<DrawPath>::const_iterator path_it=page.paths.cbegin(); path_it!=page.paths.cend(); path_it++) {
+        FullDrawTool const& tool = path_it->getTool();
+        int index = 0;
+        while (index < styles.length() && (styles[index]->tool != tool.tool || styles[index]->color != tool.color || styles[index]->size != tool.size))
+            index++;
+        if (index == styles.length())
+            styles.append(&tool);
+        styleIndices.append(quint32(index));
+    }
+    QByteArray chunk;
+    {
+        QDataStream stream(&chunk, QIODevice::WriteOnly);
+        stream.setByteOrder(QDataStream::LittleEndian);
+        stream.setFloatingPointPrecision(QDataStream::SinglePrecision);
+        stream << page.label << quint32(styles.length());
+        for (auto const tool : styles)
+            stream << toolNames.value(tool->tool, "unknown") << quint32(tool->color.rgba()) << float(tool->size/page.scale);
+        stream << quint32(page.paths.length());
+        for (int i=0; i<page.paths.length(); i++) {
+            DrawPath const& path = page.paths[i];
+            int const number = path.number();
+            float const* const pressures = path.pressureData();
+            stream << styleIndices[i] << quint32(number) << quint8(pressures != nullptr);
+            float const* const xs = path.xData();
+            float const* const ys = path.yData();
+            for (int j=0; j<number; j++)
+                stream << float((xs[j] - page.shift.x())/page.scale);
+            for (int j=0; j<number; j++)
+                stream << float((ys[j] - page.shift.y())/page.scale);
+            if (pressures != nullptr)
+                for (int j=0; j<number; j++)
+                    stream << pressures[j];
+        }
+    }
+    if (compress)
+        // Compression level 1 is fast and still makes the files much smaller.
+        return qCompress(chunk, 1);
+    return chunk;
+}
+
+void PathOverlay::saveBinary(QString const& filename, PdfDoc const* notedoc, bool const compress) const
+{
+    // See loadBinary for a description of the format.
+    QFile file(filename);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qCritical() << "Saving file failed: file is not writable.";
+        return;
+    }
+    QByteArray const header = binaryHeader(notedoc, compress);
+    QDataStream stream(&file);
+    stream.setByteOrder(QDataStream::LittleEndian);
+    stream.writeRawData(header.constData(), header.size());
+    // Write each page as a separate chunk. Only one page is kept in memory.
+    for (QMap<QString, QList<DrawPath*>>::const_iterator page_it=paths.cbegin(); page_it!=paths.cend(); page_it++) {
+        if (page_it->isEmpty())
+            continue;
+        QByteArray const chunk = encodePage(pageSnapshot(page_it.key()), compress);
+        stream << quint32(chunk.size());
+        stream.writeRawData(chunk.constData(), chunk.size());
+    }
+    // An empty chunk marks the end of the file.
+    stream << quint32(0);
+    if (stream.status() != QDataStream::Ok)
+        qCritical() << "Saving file failed: could not write all data.";
+    file.close();
+}
+
+void PathOverlay::startAutosave(QString const& filename, PdfDoc const* notesDoc, int const interval)
+{
+    delete autosaveThread;
+    autosaveThread = new AutosaveThread(filename, this);
+    // The thread reports failures (queued) to the main thread.
+    connect(autosaveThread, &AutosaveThread::failed, this, &PathOverlay::autosaveFailed);
+    autosaveNotes = notesDoc;
+    autosaveEntries = 0;
+    connect(&autosaveTimer, &QTimer::timeout, this, &PathOverlay::autosave, Qt::UniqueConnection);
+    autosaveTimer.start(interval);
+}
+
+void PathOverlay::autosave()
+{
+    if (autosaveThread == nullptr || changedPages.isEmpty() || master->page == nullptr)
+        return;
+    // Rewrite the complete file from time to time such that it does not grow too much.
+    bool const complete = autosaveEntries == 0 || autosaveEntries >= 32;
+    QList<PageSnapshot> pages;
+    if (complete) {
+        for (QMap<QString, QList<DrawPath*>>::const_iterator page_it=paths.cbegin(); page_it!=paths.cend(); page_it++) {
+            if (!page_it->isEmpty())
+                pages.append(pageSnapshot(page_it.key()));
+        }
+    }
+    else {
+        // Removed pages are saved as empty pages.
+        for (QSet<QString>::const_iterator label_it=changedPages.cbegin(); label_it!=changedPages.cend(); label_it++)
+            pages.append(pageSnapshot(*label_it));
+    }
+    changedPages.clear();
+    // Copying the paths only copies references to the nodes. Encoding and writing is done in the autosave thread.
+    autosaveThread->submit(binaryHeader(autosaveNotes, true), pages, complete);
+    autosaveEntries = complete ? 1 : autosaveEntries + 1;
+}
+
+void PathOverlay::autosaveFailed()
+{
+    // Pages of the failed snapshot are missing in the file. Rewrite it completely at the next autosave.
+    autosaveEntries = 0;
+    for (QMap<QString, QList<DrawPath*>>::const_iterator page_it=paths.cbegin(); page_it!=paths.cend(); page_it++)
+        changedPages.insert(page_it.key());
 }
 
 void PathOverlay::loadXML(QString const& filename, PdfDoc const* notesDoc)
 {
     // Load drawings from (compressed) XML.
-    // TODO: use gunzip and open Xournal files directly.
     qInfo() << "Loading files is experimental. Files might contain errors or might be unreadable for later versions of BeamerPresenter";
     QFile file(filename);
     if (!file.exists()) {
@@ -1066,6 +1593,22 @@ void PathOverlay::loadXML(QString const& filename, PdfDoc const* notesDoc)
         qCritical() << "Loading file failed: file is not readable.";
         return;
     }
+    if (file.peek(4) == QByteArray(drawingsMagic, 4)) {
+        loadBinary(file, notesDoc);
+        file.close();
+        update();
+        return;
+    }
+    {
+        // Xournal(++) files are usually gzip compressed.
+        QByteArray const start = file.peek(1024);
+        if (start.startsWith("\x1f\x8b") || start.contains("<xournal")) {
+            file.close();
+            loadXournal(filename);
+            update();
+            return;
+        }
+    }
     QDomDocument doc("BeamerPresenter");
     if (!doc.setContent(&file)) {
         file.close();
@@ -1126,6 +1669,7 @@ void PathOverlay::loadXML(QString const& filename, PdfDoc const* notesDoc)
             }
             else
                 paths[label] = QList<DrawPath*>();
+            pathsReplaced(label);
             for (QDomElement stroke = page_element.firstChildElement("stroke"); !stroke.isNull(); stroke = stroke.nextSiblingElement("stroke")) {
                 DrawTool const tool = toolNames.key(stroke.attribute("tool"), NoTool);
                 if (tool != NoTool) {
@@ -1138,77 +1682,11 @@ void PathOverlay::loadXML(QString const& filename, PdfDoc const* notesDoc)
                     paths[label].append(new DrawPath({tool, color, size, {0.}}, data, shift, scale));
                 }
             }
+            changedPages.insert(label);
             emit pathsChanged(label, paths[label], master->shiftx, master->shifty, master->resolution);
         }
 
     }
-    else if (root.attribute("creator").contains("xournal", Qt::CaseInsensitive)) {
-        // Try to import strokes from uncompressed Xournal or Xournal++ file
-        // Get filename and compare it to presentation file.
-        {
-            QDomElement const first_page = root.firstChildElement("page");
-            if (!first_page.isNull()) {
-                QDomElement const first_bg = first_page.firstChildElement("background");
-                if (!first_bg.isNull() && first_bg.hasAttribute("filename")) {
-                    QFileInfo const& presentation_fileinfo = QFileInfo(master->doc->getPath());
-                    if (first_bg.attribute("filename") != presentation_fileinfo.absoluteFilePath())
-                        qWarning() << "This Xournal(++) file uses a different PDF file path.";
-                }
-            }
-        }
-        for (QDomElement page_element = root.firstChildElement("page"); !page_element.isNull(); page_element = page_element.nextSiblingElement("page")) {
-            QDomElement bg = page_element.firstChildElement("background");
-            if (bg.isNull())
-                continue;
-            QDomElement layer = page_element.firstChildElement("layer");
-            if (layer.isNull() || !layer.hasChildNodes())
-                continue;
-            bool ok;
-            int const pageno = bg.attribute("pageno").remove(QRegExp("[a-z]")).toInt(&ok) - 1;
-            if (!ok)
-                continue;
-            QString const label = master->doc->getLabel(pageno);
-            // TODO: handle text.
-            qreal scale;
-            QPoint shift;
-            Poppler::Page const* page = master->doc->getPage(label);
-            QSizeF size;
-            if (page == nullptr)
-                size = master->page->pageSizeF();
-            else
-                size = page->pageSizeF();
-            if (size.width() * height() >= width() * size.height()) {
-                shift.setY(( height() - size.height()/size.width() * width() )/2);
-                scale = width() / size.width();
-            }
-            else {
-                shift.setX((width() - size.width()/size.height() * height() )/2);
-                scale = height() / size.height();
-            }
-            for (QDomElement stroke = layer.firstChildElement("stroke"); !stroke.isNull(); stroke = stroke.nextSiblingElement("stroke")) {
-                // This requires that tool names are compatible with those used by Xournal(++).
-                // But since the only stroke tools are "pen" and "highlighter", this is not a problem.
-                DrawTool const tool = toolNames.key(stroke.attribute("tool"), NoTool);
-                if (tool != NoTool) {
-                    QString colorstr = stroke.attribute("color");
-                    // Colors are saved by xournal in the format #RRGGBBAA, but Qt uses #AARRGGBB.
-                    // Try to convert between the two formats.
-                    if (colorstr[0] == '#' && colorstr.size() == 9) {
-                        colorstr.insert(1, colorstr.mid(7));
-                        colorstr.truncate(9);
-                    }
-                    QColor const color = QColor(colorstr);
-                    bool ok;
-                    qreal size = stroke.attribute("width").toDouble(&ok);
-                    if (!ok)
-                        size = defaultToolConfig[tool].size;
-                    QStringList const data = stroke.text().split(" ");
-                    paths[label].append(new DrawPath({tool, color, size, {0.}}, data, shift, scale));
-                }
-            }
-            emit pathsChanged(label, paths[label], master->shiftx, master->shifty, master->resolution);
-        }
-    }
     else {
         qWarning() << "Could not understand file: Unknown creator" << root.attribute("creator");
     }
@@ -1292,42 +1770,135 @@ void PathOverlay::saveXML(QString const& filename, PdfDoc const* notedoc, bool c
     file.close();
 }
 
-void PathOverlay::saveXournal(QString const& filename) const
+void PathOverlay::loadXournal(QString const& filename)
+{
+    // Import strokes from (compressed or uncompressed) Xournal or Xournal++ file.
+    // The file is decompressed and parsed as a stream.
+    GzipDevice device(filename);
+    if (!device.open(QIODevice::ReadOnly)) {
+        qCritical() << "Loading file failed: file is not readable.";
+        return;
+    }
+    QXmlStreamReader reader(&device);
+    if (!reader.readNextStartElement() || reader.name() != "xournal") {
+        qWarning() << "Could not understand file: not a Xournal(++) file.";
+        return;
+    }
+    // Only compare the filename of the first PDF background to the presentation file.
+    bool filenameChecked = false;
+    while (reader.readNextStartElement()) {
+        if (reader.name() != "page") {
+            reader.skipCurrentElement();
+            continue;
+        }
+        QString label;
+        qreal scale = 1.;
+        QPoint shift;
+        bool hasBackground = false;
+        while (reader.readNextStartElement()) {
+            if (reader.name() == "background") {
+                QXmlStreamAttributes const attributes = reader.attributes();
+                if (!filenameChecked && attributes.hasAttribute("filename")) {
+                    filenameChecked = true;
+                    if (attributes.value("filename").toString() != QFileInfo(master->doc->getPath()).absoluteFilePath())
+                        qWarning() << "This Xournal(++) file uses a different PDF file path.";
+                }
+                bool ok;
+                int const pageno = attributes.value("pageno").toString().remove(QRegExp("[a-z]")).toInt(&ok) - 1;
+                if (ok) {
+                    label = master->doc->getLabel(pageno);
+                    pageGeometry(label, shift, scale);
+                    hasBackground = true;
+                }
+                reader.skipCurrentElement();
+            }
+            else if (reader.name() == "layer" && hasBackground) {
+                QList<DrawPath*>& list = paths[label];
+                while (reader.readNextStartElement()) {
+                    if (reader.name() != "stroke") {
+                        // TODO: handle text.
+                        reader.skipCurrentElement();
+                        continue;
+                    }
+                    QXmlStreamAttributes const attributes = reader.attributes();
+                    // This requires that tool names are compatible with those used by Xournal(++).
+                    // But since the only stroke tools are "pen" and "highlighter", this is not a problem.
+                    DrawTool const tool = toolNames.key(attributes.value("tool").toString(), NoTool);
+                    QString colorstr = attributes.value("color").toString();
+                    // For pressure sensitive strokes width contains the nominal width followed by the width of each segment.
+                    QStringList const widths = attributes.value("width").toString().split(' ', QString::SkipEmptyParts);
+                    QStringList const data = reader.readElementText().simplified().split(' ');
+                    if (tool == NoTool || data.size() < 2)
+                        continue;
+                    // Colors are saved by xournal in the format #RRGGBBAA, but Qt uses #AARRGGBB.
+                    // Try to convert between the two formats.
+                    if (colorstr.size() == 9 && colorstr[0] == '#') {
+                        colorstr.insert(1, colorstr.mid(7));
+                        colorstr.truncate(9);
+                    }
+                    bool ok = !widths.isEmpty();
+                    qreal size = ok ? widths.first().toDouble(&ok) : 0.;
+                    if (!ok || size <= 0.)
+                        size = defaultToolConfig[tool].size;
+                    list.append(new DrawPath({tool, QColor(colorstr), size, {0.}}, data, shift, scale));
+                    // The pressure at each node is the width of the following segment relative to the nominal width.
+                    if (widths.size() > 1 && widths.size() == list.last()->number()) {
+                        QVector<float> pressures(widths.size());
+                        for (int i=1; i<widths.size(); i++)
+                            pressures[i-1] = float(widths[i].toDouble()/size);
+                        pressures.last() = pressures[pressures.length()-2];
+                        list.last()->setPressures(pressures);
+                    }
+                }
+            }
+            else
+                reader.skipCurrentElement();
+        }
+        if (hasBackground) {
+            changedPages.insert(label);
+            emit pathsChanged(label, paths[label], master->shiftx, master->shifty, master->resolution);
+        }
+    }
+    if (reader.hasError())
+        qWarning() << "Error while reading Xournal(++) file:" << reader.errorString();
+}
+
+void PathOverlay::saveXournal(QString const& filename, bool const compress) const
 {
     // Save drawings in a format, which can hopefully be read by Xournal(++).
+    // The XML is written as a stream and compressed while writing.
     qInfo() << "Saving to this Xournal compatibility format is experimental.";
-    QDomDocument doc("Xournal-readable");
-    QDomElement root = doc.createElement("xournal");
-    root.setAttribute("creator", "BeamerPresenter " APP_VERSION);
-    doc.appendChild(root);
-
-    // Set title.
-    {
-        QDomElement title = doc.createElement("title");
-        root.appendChild(title);
-        QDomText const title_text = doc.createTextNode("Xournal++ readable XML file created by BeamerPresenter");
-        title.appendChild(title_text);
+    QScopedPointer<QIODevice> device;
+    if (compress)
+        device.reset(new GzipDevice(filename));
+    else
+        device.reset(new QFile(filename));
+    if (!device->open(QIODevice::WriteOnly)) {
+        qCritical() << "Saving file failed: file is not writable.";
+        return;
     }
+    QXmlStreamWriter writer(device.data());
+    writer.setAutoFormatting(true);
+    writer.writeStartDocument();
+    writer.writeStartElement("xournal");
+    writer.writeAttribute("creator", "BeamerPresenter " APP_VERSION);
+    writer.writeTextElement("title", "Xournal++ readable XML file created by BeamerPresenter");
 
-    QString presentation_file = QFileInfo(master->doc->getPath()).absoluteFilePath();
+    QString const presentation_file = QFileInfo(master->doc->getPath()).absoluteFilePath();
 
     for (int i=0; i<master->doc->getDoc()->numPages(); i++) {
-        QDomElement page = doc.createElement("page");
         QSizeF const size = master->doc->getPageSize(i);
-        page.setAttribute("width", QString::number(size.width()));
-        page.setAttribute("height", QString::number(size.height()));
-        root.appendChild(page);
-
-        QDomElement bg = doc.createElement("background");
-        bg.setAttribute("type", "pdf");
-        bg.setAttribute("domain", "absolute");
-        bg.setAttribute("filename", master->doc->getPath());
-        bg.setAttribute("pageno", QString::number(i+1) + "ll");
-        page.appendChild(bg);
+        writer.writeStartElement("page");
+        writer.writeAttribute("width", QString::number(size.width()));
+        writer.writeAttribute("height", QString::number(size.height()));
 
-        QDomElement layer = doc.createElement("layer");
-        page.appendChild(layer);
+        writer.writeEmptyElement("background");
+        writer.writeAttribute("type", "pdf");
+        writer.writeAttribute("domain", "absolute");
+        writer.writeAttribute("filename", presentation_file);
+        writer.writeAttribute("pageno", QString::number(i+1) + "ll");
 
+        writer.writeStartElement("layer");
         /// scale page in points / pixel
         qreal scale;
         /// upper right corner of the page, in pixels
@@ -1342,30 +1913,36 @@ void PathOverlay::saveXournal(QString const& filename) const
         }
         QList<DrawPath*> const& pathlist = paths.value(master->doc->getLabel(i));
         for (QList<DrawPath*>::const_iterator path_it=pathlist.cbegin(); path_it!=pathlist.cend(); path_it++) {
-            QDomElement stroke = doc.createElement("stroke");
-            layer.appendChild(stroke);
+            writer.writeStartElement("stroke");
             FullDrawTool const& tool = (*path_it)->getTool();
-            stroke.setAttribute("tool", toolNames.value(tool.tool, "pen"));
+            writer.writeAttribute("tool", toolNames.value(tool.tool, "pen"));
             // Colors are saved by xournal in the format #RRGGBBAA, but Qt uses #AARRGGBB.
             // Convert between the two formats.
             QString colorstr = tool.color.name(QColor::HexArgb);
             colorstr.append(colorstr.mid(1, 2));
             colorstr.remove(1, 2);
-            stroke.setAttribute("color", colorstr);
-            // Stroke width is saved in points.
-            stroke.setAttribute("width", tool.size*scale);
+            writer.writeAttribute("color", colorstr);
+            // Stroke width is saved in points. Pressure sensitive strokes additionally contain the width of each segment.
+            QString width = QString::number(tool.size*scale);
+            float const* const pressures = (*path_it)->pressureData();
+            if (pressures != nullptr)
+                for (int i=0; i<(*path_it)->number()-1; i++)
+                    width += " " + QString::number(tool.size*scale*pressures[i]);
+            writer.writeAttribute("width", width);
             // Save data as list of x and y coordinates (alternating) in points.
             QStringList stringList;
             (*path_it)->toText(stringList, shift, scale);
-            QDomText const data = doc.createTextNode(stringList.join(" "));
-            stroke.appendChild(data);
+            writer.writeCharacters(stringList.join(" "));
+            writer.writeEndElement();
         }
+        // End layer and page.
+        writer.writeEndElement();
+        writer.writeEndElement();
     }
-
-    QFile file(filename);
-    file.open(QIODevice::WriteOnly);
-    file.write(doc.toByteArray());
-    file.close();
+    writer.writeEndDocument();
+    if (writer.hasError())
+        qCritical() << "Saving file failed: could not write all data.";
+    device->close();
 }
 
 void PathOverlay::drawPointer(QPainter& painter)
@@ -1421,10 +1998,10 @@ void PathOverlay::undoPath()
 {
     if (!paths[master->page->label()].isEmpty()) {
         undonePaths.append(paths[master->page->label()].takeLast());
-        end_cache = -1;
-        pixpaths = QPixmap();
-        update(undonePaths.last()->getOuterDrawing().toAlignedRect());
-        emit pathsChangedQuick(master->page->label(), paths[master->page->label()], master->shiftx, master->shifty, master->resolution);
+        QRect const outer = undonePaths.last()->getOuterDrawing().toAlignedRect();
+        updateCacheAfterChange(paths[master->page->label()].length() + 1, paths[master->page->label()].length(), outer);
+        update(outer);
+        sendOperations({DrawOperation(DrawOperation::RemovePaths, paths[master->page->label()].length(), 1)});
     }
 }
 
@@ -1434,16 +2011,16 @@ void PathOverlay::redoPath()
         DrawPath* path = undonePaths.takeLast();
         paths[master->page->label()].append(path);
         update(path->getOuterDrawing().toAlignedRect());
-        emit pathsChangedQuick(master->page->label(), paths[master->page->label()], master->shiftx, master->shifty, master->resolution);
+        sendOperations({DrawOperation(DrawOperation::AddPaths, paths[master->page->label()].length()-1, *path)});
     }
 }
 
 void PathOverlay::resetCache()
 {
-     end_cache = -1;
+     clearPathCache();
      if (tool.tool != Magnifier) {
-         delete enlargedPageRenderer;
-         enlargedPageRenderer = nullptr;
+         delete magnifierRenderer;
+         magnifierRenderer = nullptr;
      }
 }
 
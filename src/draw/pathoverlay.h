@@ -22,10 +22,16 @@
 #include <QWidget>
 #include <QApplication>
 #include <QRegExp>
+#include <QFile>
+#include <QTimer>
+#include <QScopedPointer>
 #include "drawpath.h"
-#include "../pdf/singlerenderer.h"
+#include "drawoperation.h"
+#include "pathindex.h"
+#include "../pdf/tilerenderer.h"
 
 class DrawSlide;
+class AutosaveThread;
 
 class PathOverlay : public QWidget
 {
@@ -43,20 +49,46 @@ public:
     QMap<QString, QList<DrawPath*>> const& getPaths() const {return paths;}
     FullDrawTool const& getTool() const {return tool;}
     FullDrawTool const& getStylusTool() const {return stylusTool;}
-    SingleRenderer* getEnlargedPageRenderer() {return enlargedPageRenderer;}
-
+    TileRenderer* getMagnifierRenderer() {return magnifierRenderer;}
+
+    /// Copy of the paths on one page, which can be saved in another thread.
+    struct PageSnapshot {
+        QString label;
+        /// Copies of the paths. These share the node data with the paths of the overlay.
+        QList<DrawPath> paths;
+        /// Position of the page in the overlay in pixels.
+        QPoint shift;
+        /// Scale of the page in pixels per point.
+        qreal scale;
+    };
+    /// Encode the paths of a page as chunk of a binary BeamerPresenter file (see loadBinary).
+    /// This can be called from any thread.
+    static QByteArray const encodePage(PageSnapshot const& page, bool const compress);
+    /// Save drawings to filename every interval ms in a separate thread.
+    /// Changed pages are appended to the file and the file is rewritten from time to time.
+    /// The file can be loaded like other binary drawing files.
+    void startAutosave(QString const& filename, PdfDoc const* notesDoc, int const interval);
+    /// Save drawings to a binary BeamerPresenter file.
+    /// The file is written page by page. If compress is true, each page is compressed separately.
+    void saveBinary(QString const& filename, PdfDoc const* notedoc, bool const compress = true) const;
     /// Save drawings to compressed or uncompressed BeamerPresenter XML file.
     void saveXML(QString const& filename, PdfDoc const* notedoc, bool const compress = true) const;
-    /// Save drawings to an XML file which should be readable for Xournal(++).
-    void saveXournal(QString const& filename) const;
-    /// Load drawings from compressed or uncompressed BeamerPresenter XML file.
-    /// This function also supports reading uncompressed Xournal(++) XML files.
+    /// Save drawings to a gzip compressed or uncompressed XML file which should be readable for Xournal(++).
+    void saveXournal(QString const& filename, bool const compress = true) const;
+    /// Load drawings from a binary or a (compressed or uncompressed) XML BeamerPresenter file.
+    /// This function also supports reading compressed and uncompressed Xournal(++) files.
     void loadXML(QString const& filename, PdfDoc const* nodesDoc);
 
     /// Set size of eraser (in point).
     void setEraserSize(qreal const size) {eraserSize = size;}
     /// Get size of eraser (in point).
     qreal getEraserSize() const {return eraserSize;}
+    /// Set how strokes are simplified when drawing ends (for all overlays).
+    /// tolerance is the maximum deviation (in point) of removed nodes, 0 disables simplification.
+    /// If smooth is true, simplified strokes are interpolated by splines.
+    static void setStrokeSimplification(qreal const tolerance, bool const smooth) {strokeTolerance = tolerance; smoothStrokes = smooth;}
+    /// Enable or disable pressure sensitive strokes for tablet input.
+    static void setPressureSensitive(bool const enable) {pressureSensitive = enable;}
     /// Draw pointer or torch.
     void drawPointer(QPainter& painter);
     /// Move the last visible path to hidden paths.
@@ -65,9 +97,12 @@ public:
     void redoPath();
     /// Reset cached pixmap of path overlays.
     void resetCache();
-    /// Draw paths to painter (starting from end_cache).
+    /// Draw the paths with index first to last (excluding last) of the page with given label inside region.
+    /// last < 0 means all paths starting from first. Plain drawing does not draw backgrounds for highlighters.
     /// TODO: reorganize!
-    void drawPaths(QPainter& painter, QString const& label, QRegion const& region, bool const plain=false, bool const toCache=false);
+    void drawPaths(QPainter& painter, QString const& label, QRegion const& region, bool const plain=false, int const first=0, int last=-1);
+    /// Draw all paths of the current page inside region using the tiles of the path cache where possible.
+    void drawCachedPaths(QPainter& painter, QRegion const& region);
     /// Does the given rectangle have any overlap with a video?
     bool hasVideoOverlap(QRectF const& rect) const;
 
@@ -84,12 +119,24 @@ protected:
     void erase(QPointF const& point);
     /// Radius of eraser in pixel.
     qreal eraserSize = 10.;
+    /// Maximum deviation (in point) of nodes removed when simplifying strokes. 0 disables simplification.
+    static qreal strokeTolerance;
+    /// Interpolate simplified strokes by splines.
+    static bool smoothStrokes;
+    /// Scale the width of strokes drawn with a tablet by the pressure.
+    static bool pressureSensitive;
     /// Current draw tool.
     FullDrawTool tool{NoTool, Qt::black, 0., {0.}};
     /// Tool for tablet events.
     FullDrawTool stylusTool{Pen, Qt::black, 2.5, {0.}};
     /// Currently visible paths.
     QMap<QString, QList<DrawPath*>> paths;
+    /// Spatial index of the paths for each page label. Use indexedPaths to access an up-to-date index.
+    QMap<QString, PathIndex> pathIndex;
+    /// Synchronize the spatial index of the paths on the page with given label and return it.
+    PathIndex const& indexedPaths(QString const& label);
+    /// Drop the spatial index and (for the current page) the path cache of label after all its paths have been replaced.
+    void pathsReplaced(QString const& label);
     /// Undisplayed paths which could be restored.
     QList<DrawPath*> undonePaths;
     /// Current position of the pointer.
@@ -98,23 +145,73 @@ protected:
     /// Current position of the stylus.
     /// (0,0) indicates that no stylus pointing tool is currently active.
     QPointF stylusPosition = QPointF();
-    /// Page enlarged by magnification factor: used for magnifier.
-    QPixmap enlargedPage;
-    /// Renderer for enlarged page: enables rendering of enlarged page in separate thread.
-    SingleRenderer* enlargedPageRenderer = nullptr;
-    /// Pixmap containing only paths.
-    QPixmap pixpaths;
-    /// Index of last path (of current slide) which is already rendered to pixpaths.
+    /// Renderer for the magnifier: renders tiles of the enlarged page around the magnifier in separate threads.
+    TileRenderer* magnifierRenderer = nullptr;
+    /// Position of the magnifier when tiles were requested last. Used to prefetch tiles in the direction of motion.
+    QPointF lastMagnifierPosition;
+    /// Draw the magnifier at position: tiles of the enlarged page (or the scaled slide where tiles are missing) and the paths.
+    void drawMagnifier(QPainter& painter, FullDrawTool const& magnifier, QPointF const& position);
+    // Path cache: the paths of the current page are rendered to tiles of size tileSize.
+    // Tiles are rendered when they are needed. Changing paths only requires rendering the tiles containing these paths again.
+    /// Side length of tiles in the path cache in pixels.
+    static int const tileSize = 256;
+    /// Tiles of the path cache in row-major order. Null pixmaps are tiles which need to be rendered.
+    QVector<QPixmap> tiles;
+    /// Tiles which are not cached because a highlighter overlaps with a video in this tile.
+    /// The paths in these tiles are drawn directly.
+    QVector<bool> liveTiles;
+    /// Number of columns of tiles.
+    int tileColumns = 0;
+    /// Number of rows of tiles.
+    int tileRows = 0;
+    /// Number of paths (of current slide) which are contained in the path cache or -1 if the cache is empty.
     int end_cache = -1;
+    /// Position and size of tile t in widget coordinates.
+    QRect const tileRect(int const t) const {return QRect((t%tileColumns)*tileSize, (t/tileColumns)*tileSize, tileSize, tileSize);}
+    /// Render the paths contained in the path cache to tile t.
+    void renderTile(int const t);
+    /// Delete all tiles of the path cache.
+    void clearPathCache();
+    /// Mark all tiles overlapping with region as outdated.
+    void invalidateTiles(QRegion const& region);
+    /// Update the path cache after paths of the current page have been removed or inserted.
+    /// If all oldLength paths were cached, only the tiles overlapping with changed are rendered again
+    /// and the newLength paths are cached. Otherwise the path cache is cleared.
+    void updateCacheAfterChange(int const oldLength, int const newLength, QRegion const& changed);
+    /// Load drawings from a binary BeamerPresenter file page by page. Returns false if file has a wrong format.
+    bool loadBinary(QFile& file, PdfDoc const* notesDoc);
+    /// Import drawings from a gzip compressed or uncompressed Xournal(++) file.
+    void loadXournal(QString const& filename);
+    /// Get position (shift, in pixels) and scale (in pixels per point) of page label in this overlay.
+    void pageGeometry(QString const& label, QPoint& shift, qreal& scale) const;
+    /// Header of a binary BeamerPresenter file.
+    QByteArray const binaryHeader(PdfDoc const* notedoc, bool const compress) const;
+    /// Copy the paths of page label for saving them.
+    PageSnapshot const pageSnapshot(QString const& label) const;
+    /// Labels of pages, on which paths have changed since the last autosave.
+    QSet<QString> changedPages;
+    /// Thread writing the autosave file. nullptr if autosave is disabled.
+    AutosaveThread* autosaveThread = nullptr;
+    /// Timer triggering autosave.
+    QTimer autosaveTimer;
+    /// Notes document, which is referenced in the autosave file.
+    PdfDoc const* autosaveNotes = nullptr;
+    /// Number of autosaves written since the autosave file was completely rewritten. 0 if nothing has been saved.
+    int autosaveEntries = 0;
+    /// Send changes of the paths on the current page to other overlays.
+    void sendOperations(QList<DrawOperation> const& operations);
     /// Master slide to which this overlay is attached.
     DrawSlide const* master;
 
 public slots:
-    /// Update enlarged page (required for magnifier) if necessary.
-    /// The page is rendered in a separate thread.
+    /// Prepare the renderer for the magnifier if necessary and repaint.
+    /// Only tiles of the enlarged page around the magnifier are rendered in separate threads.
     void updateEnlargedPage();
     void setPaths(QString const pagelabel, QList<DrawPath*> const& list, qint16 const refshiftx, qint16 const refshifty, double const refresolution);
-    void setPathsQuick(QString const pagelabel, QList<DrawPath*> const& list, qint16 const refshiftx, qint16 const refshifty, double const refresolution);
+    /// Apply changes made on another PathOverlay to the paths of page pagelabel.
+    /// list is the complete list of paths of the sender after these changes. It is only used
+    /// (like in setPaths) if the paths of this overlay turn out to differ from the ones of the sender.
+    void applyOperations(QString const pagelabel, QList<DrawOperation> const& operations, QList<DrawPath*> const& list, qint16 const refshiftx, qint16 const refshifty, double const refresolution);
     /// Set pointerPosition. If refresolution==0, set pointerPosition to QPointF(0,0)
     void setPointerPosition(QPointF const point, qint16 const refshiftx, qint16 const refshifty, double const refresolution);
     /// Set stylusPosition. If refresolution==0, set stylusPosition to QPointF(0,0)
@@ -124,6 +221,10 @@ public slots:
     void setStylusTool(FullDrawTool const& newtool, qreal const resolution=-1.);
     void setStylusTool(DrawTool const newtool, QColor const color=QColor(), qreal size=-1, qreal const resolution=-1.) {setStylusTool({newtool, color, size, {0.}}, resolution);}
     void updatePathCache();
+    /// Save changed pages to the autosave file (if autosave is enabled).
+    void autosave();
+    /// Writing the autosave file failed: the next autosave rewrites the complete file.
+    void autosaveFailed();
     void relaxPointer();
     void relaxStylus();
     void togglePointerVisibility();
@@ -133,7 +234,8 @@ public slots:
 signals:
     void pointerPositionChanged(QPointF const point, qint16 const refshiftx, qint16 const refshifty, double const refresolution);
     void stylusPositionChanged(QPointF const point, qint16 const refshiftx, qint16 const refshifty, double const refresolution);
-    void pathsChangedQuick(QString const pagelabel, QList<DrawPath*> const& list, qint16 const refshiftx, qint16 const refshifty, double const refresolution);
+    /// Paths of page pagelabel have been changed by operations. list contains all paths of the page after the change.
+    void pathOperations(QString const pagelabel, QList<DrawOperation> const& operations, QList<DrawPath*> const& list, qint16 const refshiftx, qint16 const refshifty, double const refresolution);
     void pathsChanged(QString const pagelabel, QList<DrawPath*> const& list, qint16 const refshiftx, qint16 const refshifty, double const refresolution);
     void sendToolChanged(FullDrawTool const tool, qreal const resolution);
     void sendUpdateEnlargedPage();
@@ -33,6 +33,30 @@ enum PagePart {
     RightHalf = -1,
 };
 
+/// Render priority:
+/// Order in which jobs in the RenderPool are rendered. Jobs with smaller values are rendered first.
+enum RenderPriority {
+    /// page is needed right now on the screen.
+    VisiblePriority = 0,
+    /// page will probably be needed next (next slide, or outdated visible page).
+    NextPriority = 1,
+    /// pre-rendering pages after the current page.
+    LookAheadPriority = 2,
+    /// pre-rendering pages before the current page.
+    LookBehindPriority = 3,
+};
+
+/// Cache encoding:
+/// Format in which rendered pages are stored in a CacheMap.
+enum CacheEncoding {
+    /// png images: small, but slow to encode and decode.
+    PngEncoding = 0,
+    /// raw image data compressed with fast zlib compression.
+    CompressedEncoding = 1,
+    /// raw image data: large, but hardly any time is needed for encoding and decoding.
+    RawEncoding = 2,
+};
+
 /// KeyAction: Actions handled by ControlScreen
 enum KeyAction {
     /// No Key Action. Used to indicate errors and missing KeyActions.
@@ -72,6 +96,8 @@ enum KeyAction {
     Update,
     /// Update the cache.
     UpdateCache,
+    /// Print statistics about caches and rendering times as JSON to standard output.
+    PrintStatistics,
 
 #ifdef EMBEDDED_APPLICATIONS_ENABLED
     /// Start all embedded applications on the currently shown slide.
@@ -167,14 +193,16 @@ enum KeyAction {
     /// Restore the latest deleted stroke.
     RedoDrawing,
 
-    /// Save drawings to compressed XML file.
+    /// Save drawings to compressed binary file.
     SaveDrawings,
     /// Save drawings to uncompressed XML file.
     SaveDrawingsUncompressed,
-    /// Load drawings from compressed or uncompressed XML file.
+    /// Load drawings from binary or XML file.
     LoadDrawings,
     /// Save drawings to Xournal(++) compatibility XML format
     SaveDrawingsXournal,
+    /// Save drawings to compressed XML file.
+    SaveDrawingsXML,
 
     // Hard coded keys used to directly pass raw key events.
     // Arrow keys
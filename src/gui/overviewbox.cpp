@@ -16,7 +16,10 @@
  * along with BeamerPresenter. If not, see <https://www.gnu.org/licenses/>.
  */
 
+#include <QScrollBar>
+#include <QTimer>
 #include "overviewbox.h"
+#include "../pdf/cachemap.h"
 
 OverviewBox::OverviewBox(QWidget *parent) :
     QScrollArea(parent),
@@ -26,47 +29,127 @@ OverviewBox::OverviewBox(QWidget *parent) :
     setWidgetResizable(true);
     setWidget(client);
     client->setLayout(layout);
+    // Thumbnails in the visible part are rendered first.
+    connect(verticalScrollBar(), &QScrollBar::valueChanged, this, &OverviewBox::prioritizeVisible);
     //setShortcutEnabled(false); // TODO: check what this does
     // TODO: handle keyboard shortcuts
 }
 
 OverviewBox::~OverviewBox()
 {
+    delete renderer;
     qDeleteAll(frames);
     frames.clear();
 }
 
 void OverviewBox::create(PdfDoc const* doc, PagePart const pagePart)
 {
+    if (renderer == nullptr || renderer->getDoc() != doc || renderer->getPagePart() != pagePart) {
+        delete renderer;
+        renderer = new ThumbnailRenderer(doc, pagePart, this);
+        connect(renderer, &ThumbnailRenderer::thumbnailReady, this, &OverviewBox::receiveThumbnail);
+    }
+    // Thumbnails requested for an older overview are not needed anymore.
+    renderer->cancel();
     qDeleteAll(frames);
     frames.clear();
     // TODO: get the real width of the scroll area (instead of width()-16).
     client->setFixedWidth(width() - 16);
-    QList<Poppler::Page*> const pages = *doc->getPages();
+    int const numberOfPages = doc->getDoc()->numPages();
     double const frameWidth = double(client->width() - 2*columns - 2)/columns;
-    int i=0;
-    double resolution;
-    for (QList<Poppler::Page*>::const_iterator page_it=pages.cbegin(); page_it!=pages.cend(); page_it++, i++) {
+    // Thumbnails can only be reused if they have the correct size.
+    if (frameWidth != thumbnailWidth) {
+        thumbnails.clear();
+        heldThumbnails.clear();
+        thumbnailWidth = frameWidth;
+    }
+    renderer->setWidth(frameWidth);
+    // Missing thumbnails are shown as empty placeholders of the right size until they are rendered.
+    QPixmap placeholder;
+    for (int i=0; i<numberOfPages; i++) {
         OverviewFrame* frame = new OverviewFrame(i, this);
         frames.append(frame);
-        resolution = 72*frameWidth / (*page_it)->pageSize().width();
         layout->addWidget(frame, i/columns, i%columns);
-        QPixmap pixmap;
-        if (pagePart == FullPage)
-            pixmap = QPixmap::fromImage((*page_it)->renderToImage(resolution, resolution));
-        else {
-            QImage image = (*page_it)->renderToImage(2*resolution, 2*resolution);
-            if (pagePart == LeftHalf)
-                pixmap = QPixmap::fromImage(image.copy(0, 0, image.width()/2, image.height()));
-            else
-                pixmap = QPixmap::fromImage(image.copy(image.width()/2, 0, image.width()/2, image.height()));
+        QPixmap const pixmap = thumbnails.value(i);
+        if (pixmap.isNull()) {
+            QSize const size = renderer->thumbnailSize(i);
+            if (placeholder.size() != size) {
+                placeholder = QPixmap(size);
+                placeholder.fill(palette().mid().color());
+            }
+            frame->setPixmap(placeholder);
         }
-        frame->setPixmap(pixmap);
+        else
+            frame->setPixmap(pixmap);
         connect(frame, &OverviewFrame::activated, this, &OverviewBox::sendPageNumber);
         connect(frame, &OverviewFrame::activated, this, &OverviewBox::setFocused);
     }
     outdated = false;
     show();
+    requestMissing();
+}
+
+void OverviewBox::requestMissing()
+{
+    if (renderer == nullptr || outdated)
+        return;
+    // Cached slides can only be downscaled if they show the same part of the same document.
+    bool const useCache = sourceCache != nullptr && sourceCache->getDoc() == renderer->getDoc() && sourceCache->getPagePart() == renderer->getPagePart();
+    for (int i=0; i<frames.length(); i++) {
+        if (thumbnails.contains(i))
+            continue;
+        if (useCache) {
+            QByteArray const bytes = sourceCache->getCachedBytes(i);
+            if (!bytes.isEmpty())
+                renderer->setSource(i, bytes);
+        }
+        // Jobs which are still queued are not submitted twice.
+        renderer->request(i, LookAheadPriority);
+    }
+    // The geometry of the frames is known after the layout has been updated.
+    QTimer::singleShot(0, this, &OverviewBox::prioritizeVisible);
+}
+
+void OverviewBox::prioritizeVisible()
+{
+    if (renderer == nullptr)
+        return;
+    QRect const visible(0, verticalScrollBar()->value(), viewport()->width(), viewport()->height());
+    for (int i=0; i<frames.length(); i++) {
+        if (!thumbnails.contains(i) && frames[i]->geometry().intersects(visible))
+            renderer->request(i, VisiblePriority);
+    }
+}
+
+void OverviewBox::receiveThumbnail(int const page, QPixmap const pixmap)
+{
+    // Thumbnails rendered before the width changed or before reloading are dropped by the renderer.
+    if (pixmap.isNull() || renderer == nullptr)
+        return;
+    thumbnails[page] = pixmap;
+    if (page >= 0 && page < frames.length())
+        frames[page]->setPixmap(pixmap);
+}
+
+void OverviewBox::holdThumbnails()
+{
+    // Queued thumbnails refer to the old page numbers.
+    if (renderer != nullptr)
+        renderer->cancel();
+    heldThumbnails = thumbnails;
+    thumbnails.clear();
+}
+
+void OverviewBox::remapPages(QList<int> const& mapping)
+{
+    for (int page=0; page<mapping.length(); page++) {
+        if (mapping[page] >= 0 && heldThumbnails.contains(mapping[page]) && !thumbnails.contains(page)) {
+            thumbnails[page] = heldThumbnails.value(mapping[page]);
+            if (page < frames.length() && !outdated)
+                frames[page]->setPixmap(thumbnails[page]);
+        }
+    }
+    heldThumbnails.clear();
 }
 
 void OverviewBox::setFocused(int page)
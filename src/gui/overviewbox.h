@@ -24,8 +24,11 @@
 #include <QGridLayout>
 #include "overviewframe.h"
 #include "../pdf/pdfdoc.h"
+#include "../pdf/thumbnailrenderer.h"
 #include "../enumerates.h"
 
+class CacheMap;
+
 class OverviewBox : public QScrollArea
 {
     Q_OBJECT
@@ -37,6 +40,18 @@ private:
     bool outdated = true;
     quint8 columns = 5;
     int focused = 0;
+    /// Rendered thumbnails, which can be reused when creating the overview again.
+    QMap<int, QPixmap> thumbnails;
+    /// Thumbnails of the previous version of the document set aside by holdThumbnails.
+    QMap<int, QPixmap> heldThumbnails;
+    /// Width of the thumbnails in thumbnails.
+    double thumbnailWidth = -1.;
+    /// Renders missing thumbnails in parallel in the RenderPool.
+    ThumbnailRenderer* renderer = nullptr;
+    /// Cache of full-size slides. Thumbnails of cached pages are downscaled from these slides.
+    CacheMap const* sourceCache = nullptr;
+    /// Raise the priority of thumbnails in the visible part of the overview.
+    void prioritizeVisible();
 
 protected:
     void keyPressEvent(QKeyEvent* event) override {event->setAccepted(false);}
@@ -46,8 +61,17 @@ public:
     ~OverviewBox();
     void create(PdfDoc const* doc, PagePart const pagePart = PagePart::FullPage);
     void setColumns(quint8 const cols) {columns = cols;}
+    /// Set the cache, from which thumbnails are downscaled if possible instead of rendering them.
+    void setSourceCache(CacheMap const* cache) {sourceCache = cache;}
+    /// Request all thumbnails, which are still missing, e.g. because their render jobs have been cancelled.
+    void requestMissing();
     bool needsUpdate() const {return outdated;}
     void setOutdated() {outdated=true;}
+    /// Set all thumbnails aside after reloading the document. They are not used until remapPages is called.
+    void holdThumbnails();
+    /// Take back thumbnails set aside by holdThumbnails of pages, which have not changed after reloading the document.
+    /// mapping contains for each new page the index of the same page before reloading or -1.
+    void remapPages(QList<int> const& mapping);
     void setFocused(int const page);
     void moveFocusDown() {setFocused(focused+columns);}
     void moveFocusUp() {setFocused(focused-columns);}
@@ -60,6 +84,8 @@ signals:
     void sendReturn();
 
 public slots:
+    /// Show a thumbnail rendered by renderer and keep it for reuse.
+    void receiveThumbnail(int const page, QPixmap const pixmap);
 };
 
 #endif // OVERVIEWBOX_H
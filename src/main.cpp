@@ -25,6 +25,7 @@
 #include <QMimeDatabase>
 #include <QScreen>
 #include "screens/controlscreen.h"
+#include "pdf/diskcache.h"
 #include "names.h"
 
 
@@ -501,6 +502,11 @@ int main(int argc, char *argv[])
         {{"x", "log"}, "Log times of slide changes to standard output."},
         {"external-links", "Allow external links."},
         {"color-frames", "Minimum number of frames used for each color transitions in timer colors.", "int"},
+        {"render-threads", "Number of threads used for rendering slides to cache. Default is the number of CPU cores.", "int"},
+        {"stats", "Write statistics about caches and rendering times as JSON to this file when quitting. Use \"-\" for standard output.", "file"},
+        {"disk-cache", "Store rendered slides on disk and reuse them when the same file is shown again. Value can be \"true\" (use $XDG_CACHE_HOME/beamerpresenter/pages), \"false\" or a directory.", "dir"},
+        {"disk-cache-size", "Maximum size of the disk cache in MiB. Least recently used slides are removed when it grows larger. A non-positive number is treated as infinity.", "int"},
+        {"cache-format", "Format of cached slides: \"png\" (small, slow), \"compressed\" (zlib compressed raw images) or \"raw\" (large, fast). A second, comma separated value sets the format for the control screen.", "format"},
 #ifdef CHECK_QPA_PLATFORM
         {"force-show", "Force showing notes or presentation (if in a framebuffer) independent of QPA platform plugin."},
 #endif
@@ -510,6 +516,11 @@ int main(int argc, char *argv[])
         {"mute-presentation", "Mute presentation (default: false)", "bool"},
         {"mute-notes", "Mute notes (default: true)", "bool"},
         {"eraser-size", "Radius of eraser.", "pixels"},
+        {"stroke-tolerance", "Simplify strokes when drawing ends by removing nodes which deviate less than this distance (in point) from a straight line. 0 (default) disables simplification.", "float"},
+        {"stroke-smoothing", "Interpolate simplified strokes by splines.", "bool"},
+        {"pressure", "Scale the width of strokes drawn with a tablet by the pressure (default: true).", "bool"},
+        {"autosave", "Save drawings periodically to this file.", "file"},
+        {"autosave-interval", "Time between two autosaves in seconds (default: 60).", "int"},
         {"icon-path", "Set path for default icons, e.g. /usr/share/icons/default", "path"},
         {"presentation", "Presentation PDF file (usually first positional argument)", "path"},
         {"notes", "Notes PDF file (usually second positional argument)", "path"},
@@ -1258,6 +1269,11 @@ int main(int argc, char *argv[])
         // Set radius of eraser tool.
         value  = qrealFromConfig(parser, local, settings, "eraser-size", 10, 1e5);
         ctrlScreen->getPresentationSlide()->getPathOverlay()->setEraserSize(value);
+
+        // Set the tolerance for simplifying strokes when drawing ends.
+        value = qrealFromConfig(parser, local, settings, "stroke-tolerance", 0., 100.);
+        PathOverlay::setStrokeSimplification(value, boolFromConfig(parser, local, settings, "stroke-smoothing", false));
+        PathOverlay::setPressureSensitive(boolFromConfig(parser, local, settings, "pressure", true));
     }
 
     // Settings with integer values
@@ -1309,6 +1325,55 @@ int main(int argc, char *argv[])
         // This restricts only the number of slides which are pre-rendered to cache, not the actual amount of memory used.
         value = intFromConfig<int>(parser, local, settings, "cache", -1);
         ctrlScreen->setCacheNumber(value);
+
+        // Set maximum number of threads used for rendering pages to cache.
+        // Values < 1 select the number of CPU cores.
+        value = intFromConfig<int>(parser, local, settings, "render-threads", 0);
+        RenderPool::instance()->setThreadCount(value);
+    }
+    {
+        // Set the format in which slides are stored in cache.
+        // The first value sets the format for the presentation screen, an optional second value the format for the control screen.
+        QString value;
+        if (!parser.value("cache-format").isEmpty())
+            value = parser.value("cache-format");
+        else if (local.contains("cache-format"))
+            value = local.value("cache-format").toString();
+        else if (settings.contains("cache-format"))
+            value = settings.value("cache-format").toString();
+        if (!value.isEmpty()) {
+            QMap<QString, CacheEncoding> const encodings = {
+                {"png", PngEncoding},
+                {"compressed", CompressedEncoding},
+                {"zlib", CompressedEncoding},
+                {"raw", RawEncoding},
+            };
+            QStringList const values = value.toLower().split(",");
+            CacheEncoding const presentationEncoding = encodings.value(values.first().trimmed(), PngEncoding);
+            CacheEncoding const controlEncoding = values.length() > 1 ? encodings.value(values[1].trimmed(), PngEncoding) : presentationEncoding;
+            for (auto const& item : values) {
+                if (!encodings.contains(item.trimmed()))
+                    qWarning() << "Cache format not understood:" << item << "Using png instead.";
+            }
+            ctrlScreen->setCacheEncoding(presentationEncoding, controlEncoding);
+        }
+    }
+    {
+        // Set the directory for the persistent disk cache.
+        // The disk cache is disabled by default.
+        QString value;
+        if (!parser.value("disk-cache").isEmpty())
+            value = parser.value("disk-cache");
+        else if (local.contains("disk-cache"))
+            value = local.value("disk-cache").toString();
+        else if (settings.contains("disk-cache"))
+            value = settings.value("disk-cache").toString();
+        // Limit the size of the disk cache in MiB.
+        DiskCache::instance()->setMaxSize(1048576LL * intFromConfig<qint32>(parser, local, settings, "disk-cache-size", 1024));
+        if (QStringList({"true", "yes", "1", "default"}).contains(value.toLower()))
+            DiskCache::instance()->setDirectory(DiskCache::defaultDirectory());
+        else if (!value.isEmpty() && !QStringList({"false", "no", "0", "none"}).contains(value.toLower()))
+            DiskCache::instance()->setDirectory(value);
     }
     {
         quint16 value;
@@ -1531,8 +1596,34 @@ int main(int argc, char *argv[])
         ctrlScreen->loadXML(drawpath);
     }
 
+    // File to which drawings are saved periodically.
+    {
+        QString autosavePath;
+        if (!parser.value("autosave").isEmpty())
+            autosavePath = parser.value("autosave");
+        else if (local.contains("autosave"))
+            autosavePath = local.value("autosave").toString();
+        else if (settings.contains("autosave"))
+            autosavePath = settings.value("autosave").toString();
+        if (!autosavePath.isEmpty()) {
+            int const interval = intFromConfig<int>(parser, local, settings, "autosave-interval", 60);
+            ctrlScreen->startAutosave(autosavePath, 1000*(interval > 0 ? interval : 60));
+        }
+    }
+
+    // File to which statistics about caches and rendering are written on exit.
+    QString statsPath;
+    if (!parser.value("stats").isEmpty())
+        statsPath = parser.value("stats");
+    else if (local.contains("stats"))
+        statsPath = local.value("stats").toString();
+    else if (settings.contains("stats"))
+        statsPath = settings.value("stats").toString();
+
     // Start the execution loop.
     int status = app.exec();
+    if (!statsPath.isEmpty())
+        ctrlScreen->writeStatistics(statsPath);
     // Tidy up and exit.
     delete ctrlScreen;
     return status;
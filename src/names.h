@@ -76,6 +76,7 @@ static const QMap<KeyAction, QString> actionNames {
     {SyncFromPresentationScreen, "sync control"},
     {Update, "update"},
     {UpdateCache, "update cache"},
+    {PrintStatistics, "statistics"},
 
 #ifdef EMBEDDED_APPLICATIONS_ENABLED
     {StartEmbeddedCurrentSlide, "embedded"},
@@ -131,6 +132,7 @@ static const QMap<KeyAction, QString> actionNames {
     {LoadDrawings, "open"},
     {SaveDrawingsUncompressed, "save uncompressed"},
     {SaveDrawingsXournal, "save xournal"},
+    {SaveDrawingsXML, "save xml"},
 };
 
 /// Map KeyActions to icon names.
@@ -193,6 +195,8 @@ static const QMap<QString, KeyAction> keyActionMap {
     {"update", KeyAction::Update},
 
     {"update cache", KeyAction::UpdateCache},
+    {"print statistics", KeyAction::PrintStatistics},
+    {"statistics", KeyAction::PrintStatistics},
 #ifdef EMBEDDED_APPLICATIONS_ENABLED
     {"start embedded current page", KeyAction::StartEmbeddedCurrentSlide},
     {"start embedded current slide", KeyAction::StartEmbeddedCurrentSlide},
@@ -267,12 +271,14 @@ static const QMap<QString, KeyAction> keyActionMap {
     {"save drawings compatibility", KeyAction::SaveDrawingsXournal},
     {"load drawings", KeyAction::LoadDrawings},
     {"save drawings uncompressed", KeyAction::SaveDrawingsUncompressed},
+    {"save drawings xml", KeyAction::SaveDrawingsXML},
     {"save", KeyAction::SaveDrawings},
     {"save xournal", KeyAction::SaveDrawingsXournal},
     {"save xournal++", KeyAction::SaveDrawingsXournal},
     {"save compatibility", KeyAction::SaveDrawingsXournal},
     {"load", KeyAction::LoadDrawings},
     {"save uncompressed", KeyAction::SaveDrawingsUncompressed},
+    {"save xml", KeyAction::SaveDrawingsXML},
 };
 
 /// Map tool strings from configuration file to DrawTool (enum).
@@ -16,28 +16,195 @@
  * along with BeamerPresenter. If not, see <https://www.gnu.org/licenses/>.
  */
 
+#include <cstring>
 #include "basicrenderer.h"
+#include "renderstats.h"
 
 BasicRenderer::BasicRenderer(PdfDoc const* doc, PagePart const part, QObject* parent)
     : QObject(parent),
       pdf(doc),
-      pagePart(part),
-      cacheThread(new CacheThread(this, this))
+      pagePart(part)
+{}
+
+void BasicRenderer::deliverBytes(int const page, QByteArray const bytes, quint32 const jobGeneration)
+{
+    // Results of jobs started before the content changed have been posted before
+    // the change, but arrive afterwards.
+    if (jobGeneration == generation)
+        receiveBytes(page, bytes);
+    else
+        discardBytes(page);
+}
+
+void BasicRenderer::newGeneration()
 {
-    connect(cacheThread, &CacheThread::finished, this, &BasicRenderer::receiveBytes);
+    generation++;
+    RenderPool::instance()->renewGeneration(this);
 }
 
 QPixmap const BasicRenderer::renderPixmap(int const page) const
 {
     // This should only be called from within CacheThread, BasicRenderer and CacheMap!
+    // It can be called from several CacheThreads at the same time.
+    return QPixmap::fromImage(renderImage(page));
+}
+
+QImage const BasicRenderer::renderImage(int const page) const
+{
+    return cropImage(renderFullImage(page), pagePart);
+}
+
+QImage const BasicRenderer::renderFullImage(int const page) const
+{
     Poppler::Page const* cachePage = pdf->getPage(page);
-    QImage image = cachePage->renderToImage(72*resolution, 72*resolution);
-    if (pagePart == FullPage)
-        return QPixmap::fromImage(image);
-    else if (pagePart == LeftHalf)
-        return QPixmap::fromImage(image.copy(0, 0, image.width()/2, image.height()));
+    QElapsedTimer timer;
+    timer.start();
+    QImage const image = cachePage->renderToImage(72*resolution, 72*resolution);
+    RenderStats::instance()->record(RenderStats::Render, timer);
+    return image;
+}
+
+QImage const BasicRenderer::cropImage(QImage const& image, PagePart const part)
+{
+    switch (part) {
+    case LeftHalf:
+        return image.copy(0, 0, image.width()/2, image.height());
+    case RightHalf:
+        return image.copy(image.width()/2, 0, image.width()/2, image.height());
+    default:
+        return image;
+    }
+}
+
+/// Size of the header of raw images in cache in bytes.
+/// The header contains magic bytes, width, height, bytes per line and format of the image.
+/// It is chosen larger than necessary to keep the image data aligned.
+static int const rawHeaderSize = 32;
+/// Magic bytes identifying raw images in cache.
+static char const rawMagic[] = "BPRI";
+/// Magic bytes identifying compressed raw images in cache.
+static char const compressedMagic[] = "BPZI";
+
+QByteArray const BasicRenderer::encodeImage(QImage const& image, CacheEncoding const encoding)
+{
+    QByteArray bytes;
+    if (image.isNull())
+        return bytes;
+    QElapsedTimer timer;
+    timer.start();
+    switch (encoding) {
+    case PngEncoding:
+    {
+        QBuffer buffer(&bytes);
+        buffer.open(QIODevice::WriteOnly);
+        image.save(&buffer, "PNG");
+        break;
+    }
+    case RawEncoding:
+    case CompressedEncoding:
+    {
+        qint32 const header[4] = {image.width(), image.height(), image.bytesPerLine(), static_cast<qint32>(image.format())};
+        int const dataSize = image.bytesPerLine()*image.height();
+        bytes.reserve(rawHeaderSize + dataSize);
+        bytes.append(rawMagic, 4);
+        bytes.append(reinterpret_cast<char const*>(header), sizeof(header));
+        bytes.append(QByteArray(rawHeaderSize - bytes.size(), '\0'));
+        bytes.append(reinterpret_cast<char const*>(image.constBits()), dataSize);
+        if (encoding == CompressedEncoding)
+            // Compression level 1 is by far the fastest and still reduces the size of slides a lot.
+            bytes = QByteArray(compressedMagic, 4) + qCompress(bytes, 1);
+        break;
+    }
+    }
+    RenderStats::instance()->record(RenderStats::Encode, timer);
+    return bytes;
+}
+
+/// Free raw image data when the QImage using it is deleted.
+static void releaseRawData(void* info)
+{
+    delete static_cast<QByteArray*>(info);
+}
+
+/// Bits per pixel of image formats which are accepted in raw images from cache.
+/// Returns 0 for all other formats.
+static int rawFormatDepth(qint32 const format)
+{
+    switch (format) {
+    case QImage::Format_RGB32:
+    case QImage::Format_ARGB32:
+    case QImage::Format_ARGB32_Premultiplied:
+    case QImage::Format_RGBX8888:
+    case QImage::Format_RGBA8888:
+    case QImage::Format_RGBA8888_Premultiplied:
+        return 32;
+    case QImage::Format_RGB888:
+        return 24;
+    case QImage::Format_RGB16:
+        return 16;
+    case QImage::Format_Grayscale8:
+        return 8;
+    default:
+        return 0;
+    }
+}
+
+/// Create an image from raw image data with header. The image shares the memory with bytes.
+/// Returns a null image if the header does not describe a valid image contained in bytes.
+static QImage const decodeRawImage(QByteArray const& bytes)
+{
+    if (bytes.size() < rawHeaderSize)
+        return QImage();
+    qint32 header[4];
+    memcpy(header, bytes.constData() + 4, sizeof(header));
+    int const depth = rawFormatDepth(header[3]);
+    // Compute sizes in 64 bit to avoid overflows for corrupt headers.
+    if (
+            header[0] <= 0
+            || header[1] <= 0
+            || header[2] <= 0
+            || depth == 0
+            || header[2] < (static_cast<qint64>(header[0])*depth + 7)/8
+            || bytes.size() < rawHeaderSize + static_cast<qint64>(header[1])*header[2]
+            ) {
+        qWarning() << "Cached image data is corrupt.";
+        return QImage();
+    }
+    // The copy of bytes shares the data with bytes and keeps it alive as long as the image exists.
+    QByteArray* const shared = new QByteArray(bytes);
+    return QImage(
+                reinterpret_cast<uchar const*>(shared->constData()) + rawHeaderSize,
+                header[0], header[1], header[2],
+                static_cast<QImage::Format>(header[3]),
+                &releaseRawData, shared
+                );
+}
+
+QImage const BasicRenderer::decodeImage(QByteArray const& bytes)
+{
+    QElapsedTimer timer;
+    timer.start();
+    QImage image;
+    if (bytes.startsWith(compressedMagic))
+        image = decodeRawImage(qUncompress(reinterpret_cast<uchar const*>(bytes.constData()) + 4, bytes.size() - 4));
+    else if (bytes.startsWith(rawMagic))
+        image = decodeRawImage(bytes);
     else
-        return QPixmap::fromImage(image.copy(image.width()/2, 0, image.width()/2, image.height()));
+        image.loadFromData(bytes, "PNG");
+    RenderStats::instance()->record(RenderStats::Decode, timer);
+    return image;
+}
+
+QPixmap const BasicRenderer::decodePixmap(QByteArray const& bytes)
+{
+    if (bytes.startsWith(rawMagic) || bytes.startsWith(compressedMagic))
+        return QPixmap::fromImage(decodeImage(bytes));
+    QElapsedTimer timer;
+    timer.start();
+    QPixmap pixmap;
+    pixmap.loadFromData(bytes, "PNG");
+    RenderStats::instance()->record(RenderStats::Decode, timer);
+    return pixmap;
 }
 
 QString const BasicRenderer::getRenderCommand(int const page) const
@@ -25,9 +25,10 @@
 #include "pdfdoc.h"
 #include "cachethread.h"
 
-/// Abstract class for rendering pages using a CacheThread.
-/// Classes inheriting from BasicRenderer can be used to render slides in a different thread.
-/// These classes are SingleRenderer (rendering and storing a single page), and CacheMap (storing cached pages in a QMap).
+/// Abstract class for rendering pages using the shared RenderPool.
+/// Classes inheriting from BasicRenderer can be used to render slides in different threads.
+/// These classes are CacheMap (storing cached pages in a QMap), TileRenderer (rendering parts of a page
+/// at high resolution) and ThumbnailRenderer (rendering small previews of pages).
 class BasicRenderer : public QObject
 {
     Q_OBJECT
@@ -36,15 +37,29 @@ public:
     /// Constructor
     explicit BasicRenderer(PdfDoc const* doc, PagePart const part = FullPage, QObject* parent = nullptr);
     /// Destructor
-    /// cacheThread must be deleted by destructors of child classes.
+    /// Destructors of child classes must remove this renderer from the RenderPool before deleting their data.
     ~BasicRenderer() {};
-    /// Get cache thread.
-    CacheThread* getCacheThread() {return cacheThread;}
     /// Render page using poppler.
     QPixmap const renderPixmap(int const page) const;
+    /// Render page using poppler and return it as a QImage.
+    virtual QImage const renderImage(int const page) const;
+    /// Render the full page (ignoring the page part) using poppler.
+    QImage const renderFullImage(int const page) const;
+    /// Return the half of image given by part, or image itself if part is FullPage.
+    static QImage const cropImage(QImage const& image, PagePart const part);
 
-    /// Is a cache thread running?
-    bool threadRunning() const {return cacheThread->isRunning();}
+    /// Encode an image in the given format for storing it in cache.
+    static QByteArray const encodeImage(QImage const& image, CacheEncoding const encoding);
+    /// Decode cached data. The format is detected automatically.
+    /// For raw data, the returned image shares the memory with bytes (no copy is made).
+    static QImage const decodeImage(QByteArray const& bytes);
+    /// Decode cached data to a QPixmap. The format is detected automatically.
+    static QPixmap const decodePixmap(QByteArray const& bytes);
+
+    /// Can rendered pages be stored in the DiskCache?
+    virtual bool diskCacheable() const {return true;}
+    /// Are jobs of this renderer queued or running in the RenderPool?
+    bool threadRunning() const {return RenderPool::instance()->hasJobs(this);}
     qreal getResolution() const {return resolution;}
 
     // Settings.
@@ -56,10 +71,22 @@ public:
     QString const getRenderCommand(int const page) const;
     /// Get page part.
     PagePart getPagePart() const {return pagePart;}
+    /// Get PDF document.
+    PdfDoc const* getDoc() const {return pdf;}
+    /// Set the format used to store rendered pages.
+    virtual void setEncoding(CacheEncoding const enc) {encoding=enc;}
+    /// Get the format used to store rendered pages.
+    CacheEncoding getEncoding() const {return encoding;}
+    /// Generation of the settings and content of this renderer. Results of render jobs,
+    /// which were started in an earlier generation, are discarded.
+    quint32 getGeneration() const {return generation;}
 
 public slots:
-    /// Get cached pages from cacheThread. Called when cacheThread finishes.
-    virtual void receiveBytes() = 0;
+    /// Get a page rendered to an encoded image by the RenderPool. Called by deliverBytes.
+    virtual void receiveBytes(int const page, QByteArray const bytes) = 0;
+    /// Called by the RenderPool when a render job finishes. Results of an earlier generation
+    /// are passed to discardBytes instead of receiveBytes.
+    void deliverBytes(int const page, QByteArray const bytes, quint32 const jobGeneration);
 
 protected:
     /// PDF document.
@@ -70,11 +97,18 @@ protected:
     PagePart const pagePart;
     /// Command for external renderer.
     QString renderCommand = "";
-    /// Separate thread used to render pages to compressed cache.
-    CacheThread* cacheThread;
+    /// Format used to store rendered pages.
+    CacheEncoding encoding = PngEncoding;
+    /// Generation of the settings and content, see getGeneration().
+    quint32 generation = 0;
+    /// Start a new generation when the rendered content changes (e.g. other page, resolution or document).
+    /// Results of running jobs are discarded. Queued jobs are rendered with the new settings and are kept.
+    void newGeneration();
+    /// Called instead of receiveBytes for the result of a job of an earlier generation.
+    virtual void discardBytes(int const page) {Q_UNUSED(page)}
 
 signals:
-    /// Nofity that cacheThread has finished and this has received a new compressed page from cacheThread.
+    /// Nofity that a render job has finished and this has received a new compressed page from the RenderPool.
     void cacheThreadFinished();
 
 };
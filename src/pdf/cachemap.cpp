@@ -18,18 +18,20 @@
 #include <cmath>
 
 #include "cachemap.h"
+#include "renderstats.h"
+
+QList<CacheMap*> CacheMap::instances;
 
 CacheMap::~CacheMap()
 {
-    cacheThread->requestInterruption();
-    cacheThread->wait(10000);
-    if (cacheThread->isRunning()) {
-        cacheThread->terminate();
-        cacheThread->wait(10000);
-    }
-    delete cacheThread;
+    instances.removeOne(this);
+    RenderPool::instance()->removeRenderer(this);
+    for (auto const page : data.keys())
+        handOver(page);
     qDeleteAll(data);
     data.clear();
+    qDeleteAll(held);
+    held.clear();
 }
 
 qint64 CacheMap::setPixmap(int const page, QPixmap const* pix)
@@ -37,21 +39,22 @@ qint64 CacheMap::setPixmap(int const page, QPixmap const* pix)
     // Check whether the pixmap is empty.
     if (pix->isNull())
         return 0;
-    QByteArray* bytes = new QByteArray();
-    QBuffer buffer(bytes);
-    buffer.open(QIODevice::WriteOnly);
-    if (!pix->save(&buffer, "PNG")) {
+    QByteArray* bytes = new QByteArray(encodeImage(pix->toImage(), encoding));
+    if (bytes->isEmpty()) {
         qWarning() << "Rendering failed." << this;
         delete bytes;
         return 0;
     }
-    qint64 currentSize = qint64(bytes->size());
+    qint64 currentSize = qint64(bytes->size()) - dropDecoded(page);
     if (data.contains(page) && data[page] != nullptr) {
         // Usually this should not happen.
-        currentSize -= data[page]->size();
+        handOver(page);
+        if (!borrowed.remove(page))
+            currentSize -= data[page]->size();
         delete data[page];
     }
     data[page] = bytes;
+    sharePage(page);
     return currentSize;
 }
 
@@ -60,8 +63,65 @@ void CacheMap::clearCache()
 #ifdef DEBUG_CACHE
     qDebug() << "Clear cache" << this << parent();
 #endif
+    for (auto const page : data.keys())
+        handOver(page);
     qDeleteAll(data);
     data.clear();
+    decoded.clear();
+    borrowed.clear();
+    qDeleteAll(held);
+    held.clear();
+    heldBorrowed.clear();
+    // Pages, which are rendered at the moment, might be outdated.
+    newGeneration();
+}
+
+void CacheMap::holdPages()
+{
+    // Pages held from an earlier reload, which have not been remapped, are outdated.
+    qDeleteAll(held);
+    held = data;
+    heldBorrowed = borrowed;
+    data.clear();
+    borrowed.clear();
+    decoded.clear();
+    predecodePage = -1;
+    // Pages, which are rendered at the moment, show the previous version of the document.
+    newGeneration();
+}
+
+void CacheMap::remapPages(QList<int> const& mapping)
+{
+    int kept = 0;
+    for (int page=0; page<mapping.length(); page++) {
+        int const old = mapping[page];
+        if (old >= 0 && held.contains(old) && !data.contains(page)) {
+            data[page] = held.take(old);
+            if (heldBorrowed.contains(old))
+                borrowed.insert(page);
+            kept++;
+        }
+    }
+#ifdef DEBUG_CACHE
+    qDebug() << "Keep cached pages after reload:" << kept << "of" << kept + held.size() << this << parent();
+#endif
+    // All remaining pages have changed or have been rendered again.
+    qDeleteAll(held);
+    held.clear();
+    heldBorrowed.clear();
+}
+
+void CacheMap::setEncoding(CacheEncoding const enc)
+{
+    if (enc == encoding)
+        return;
+#ifdef DEBUG_CACHE
+    qDebug() << "Change cache encoding" << enc << encoding << this << parent();
+#endif
+    // Cached pages are decoded independent of the current encoding.
+    // Clearing cache just makes sure that all pages use the same encoding.
+    clearCache();
+    encoding = enc;
 }
 
 void CacheMap::changeResolution(const double res)
@@ -80,33 +140,67 @@ QPixmap const CacheMap::getCachedPixmap(int const page) const
 #ifdef DEBUG_CACHE
     qDebug() << "get cached page" << page << this << data.contains(page);
 #endif
-    QPixmap pixmap;
-    if (data.contains(page))
-        pixmap.loadFromData(*data.value(page), "PNG");
-    return pixmap;
+    if (decoded.contains(page)) {
+        decodedHits++;
+        return decoded.value(page);
+    }
+    if (data.contains(page)) {
+        hits++;
+        return decodePixmap(*data.value(page));
+    }
+    misses++;
+    return QPixmap();
 }
 
 QPixmap const CacheMap::getPixmap(int const page)
+{
+    QElapsedTimer timer;
+    timer.start();
+    QPixmap const pixmap = loadPixmap(page);
+    RenderStats::instance()->record(RenderStats::GetPixmap, timer);
+    return pixmap;
+}
+
+QPixmap const CacheMap::loadPixmap(int const page)
 {
 #ifdef DEBUG_CACHE
     qDebug() << "get page" << page << this << data.contains(page);
 #endif
     QPixmap pixmap;
+    if (!data.contains(page))
+        borrowPage(page);
     if (data.contains(page) && data.value(page) != nullptr) {
-        pixmap.loadFromData(*data.value(page), "PNG");
+        bool const wasDecoded = decoded.contains(page);
+        if (wasDecoded)
+            // The page has been decoded ahead of time.
+            pixmap = decoded.value(page);
+        else
+            pixmap = decodePixmap(*data.value(page));
         // Check whether pixmap has the correct size.
         QSizeF pageSize = resolution*pdf->getPageSize(page);
         if (pagePart != FullPage)
             pageSize.setWidth(pageSize.width()/2);
-        if (std::abs(pixmap.height() - pageSize.height()) < 2 && std::abs(pixmap.width() - pageSize.width()) < 2)
+        if (std::abs(pixmap.height() - pageSize.height()) < 2 && std::abs(pixmap.width() - pageSize.width()) < 2) {
+            if (wasDecoded)
+                decodedHits++;
+            else
+                hits++;
             return pixmap;
+        }
 #ifdef DEBUG_CACHE
         qDebug() << "Size changed:" << pixmap.size() << pageSize;
 #endif
         // The size was wrong. Delete the old cached page.
-        emit cacheSizeChanged(-data[page]->size());
+        qint64 const decodedSize = dropDecoded(page);
+        if (!borrowed.remove(page))
+            emit cacheSizeChanged(-data[page]->size() - decodedSize);
+        else
+            emit cacheSizeChanged(-decodedSize);
+        delete data[page];
         data.remove(page);
     }
+    // The page was not cached (or had the wrong size) and must be rendered in the main thread.
+    misses++;
     if (resolution <= 0.)
         return pixmap;
     if (renderCommand.isEmpty()) {
@@ -127,16 +221,20 @@ QPixmap const CacheMap::getPixmap(int const page)
         else
             renderer->kill();
         delete renderer;
+        if (bytes == nullptr)
+            return pixmap;
         pixmap.loadFromData(*bytes, "PNG");
-        if (pagePart == FullPage) {
+        if (pagePart == FullPage && encoding == PngEncoding) {
             data[page] = bytes;
+            borrowed.remove(page);
+            sharePage(page);
             emit cacheSizeChanged(bytes->size());
         }
         else {
             delete bytes;
             if (pagePart == LeftHalf)
                 pixmap = pixmap.copy(0, 0, pixmap.width()/2, pixmap.height());
-            else
+            else if (pagePart == RightHalf)
                 pixmap = pixmap.copy(pixmap.width()/2, 0, pixmap.width()/2, pixmap.height());
             emit cacheSizeChanged(setPixmap(page, &pixmap));
         }
@@ -148,44 +246,270 @@ qint64 CacheMap::clearPage(const int page)
 {
     if (!data.contains(page))
         return 0;
-    qint64 pageSize(data[page]->size());
+    handOver(page);
+    // Pages borrowed from other CacheMaps are counted there.
+    qint64 pageSize = borrowed.remove(page) ? 0 : data[page]->size();
     delete data[page];
     data.remove(page);
-    return pageSize;
+    return pageSize + dropDecoded(page);
 }
 
-void CacheMap::receiveBytes()
+void CacheMap::receiveBytes(int const page, QByteArray const bytes)
+{
+    if (!bytes.isEmpty())
+        storeBytes(page, bytes);
+#ifdef DEBUG_CACHE
+    qDebug() << "Render job finished:" << page << this << parent();
+#endif
+    emit cacheThreadFinished();
+}
+
+void CacheMap::discardBytes(int const page)
 {
-    QByteArray const* bytes = cacheThread->getBytes();
-    if (bytes != nullptr && !bytes->isEmpty()) {
-        qint64 size_diff = bytes->size();
-        int const page = cacheThread->getPage();
-        if (data.contains(page))
-            size_diff -= data[page]->size();
-        data[page] = bytes;
-        emit cacheSizeChanged(size_diff);
-    }
 #ifdef DEBUG_CACHE
-    qDebug() << "Cache thread finished:" << this << parent();
+    qDebug() << "Discard outdated page:" << page << this << parent();
 #endif
+    emit pageDiscarded(page);
     emit cacheThreadFinished();
 }
 
-bool CacheMap::updateCache(int const page)
+void CacheMap::receivePartnerBytes(int const page, QByteArray const bytes, quint32 const jobGeneration)
+{
+    // The page might have been rendered in the mean time or be outdated.
+    if (bytes.isEmpty() || data.contains(page) || jobGeneration != generation)
+        return;
+#ifdef DEBUG_CACHE
+    qDebug() << "Received page from partner:" << page << this << parent();
+#endif
+    storeBytes(page, bytes);
+}
+
+void CacheMap::storeBytes(int const page, QByteArray const& bytes)
+{
+    qint64 size_diff = bytes.size() - dropDecoded(page);
+    if (data.contains(page)) {
+        handOver(page);
+        if (!borrowed.remove(page))
+            size_diff -= data[page]->size();
+        delete data[page];
+    }
+    data[page] = new QByteArray(bytes);
+    sharePage(page);
+    emit cacheSizeChanged(size_diff);
+    emit pageReady(page);
+    // Neighbours of the current page should be decoded as soon as they are available.
+    if (predecodePage >= 0 && std::abs(page - predecodePage) == 1)
+        submitDecode(page);
+}
+
+bool CacheMap::updateCache(int const page, RenderPriority const priority)
 {
     if (resolution <= 0.)
         return false;
     if (data.contains(page))
         return false;
-    cacheThread->setPage(page);
-    cacheThread->start();
-    return true;
+    if (borrowPage(page))
+        return false;
+    for (auto const other : instances) {
+        if (sameContent(other) && RenderPool::instance()->hasJob(other, page)) {
+            // The page is rendered by other and will be shared when it is ready.
+            // Only make sure that the job gets the requested priority.
+            RenderPool::instance()->submit(other, page, priority);
+            return false;
+        }
+    }
+    // Render the full page only once if a partner also needs this page.
+    for (auto const other : instances) {
+        if (other->isPartner(this) && RenderPool::instance()->attachPartner(other, page, this, priority))
+            // other renders the full page. This will receive the other half from there.
+            return false;
+    }
+    CacheMap* partner = nullptr;
+    for (auto const other : instances) {
+        if (isPartner(other) && !other->data.contains(page)) {
+            partner = other;
+            break;
+        }
+    }
+    return RenderPool::instance()->submit(this, page, priority, partner);
+}
+
+bool CacheMap::isPartner(CacheMap const* other) const
+{
+    return other != this
+            && pagePart != FullPage
+            && other->pagePart == -pagePart
+            && other->pdf == pdf
+            && other->renderCommand == renderCommand
+            && resolution > 0.
+            && other->resolution > 0.
+            && other->resolution <= resolution;
+}
+
+bool CacheMap::sameContent(CacheMap const* other) const
+{
+    return other != this
+            && resolution > 0.
+            && other->pdf == pdf
+            && other->resolution == resolution
+            && other->pagePart == pagePart
+            && other->renderCommand == renderCommand
+            && other->encoding == encoding;
+}
+
+bool CacheMap::borrowPage(int const page)
+{
+    for (auto const other : instances) {
+        if (sameContent(other) && other->data.value(page, nullptr) != nullptr && !other->borrowed.contains(page)) {
+#ifdef DEBUG_CACHE
+            qDebug() << "Borrow page" << page << "from" << other << "for" << this;
+#endif
+            receiveSharedPage(page, other->data.value(page));
+            return true;
+        }
+    }
+    return false;
+}
+
+void CacheMap::sharePage(int const page)
+{
+    QByteArray const* bytes = data.value(page, nullptr);
+    if (bytes == nullptr)
+        return;
+    for (auto const other : instances) {
+        if (sameContent(other))
+            other->receiveSharedPage(page, bytes);
+    }
+}
+
+void CacheMap::receiveSharedPage(int const page, QByteArray const* bytes)
+{
+    if (data.contains(page))
+        return;
+    // QByteArray is implicitly shared: the copy uses the same data as bytes.
+    data[page] = new QByteArray(*bytes);
+    borrowed.insert(page);
+    emit pageReady(page);
+    if (predecodePage >= 0 && std::abs(page - predecodePage) == 1)
+        submitDecode(page);
+}
+
+void CacheMap::predecode(int const page)
+{
+#ifdef DEBUG_CACHE
+    qDebug() << "Decode neighbours of page" << page << this << parent();
+#endif
+    predecodePage = page;
+    // Drop decoded pages, which are not needed anymore.
+    qint64 freed = 0;
+    for (QMap<int, QPixmap>::iterator it=decoded.begin(); it!=decoded.end();) {
+        if (std::abs(it.key() - page) > 1) {
+            freed += pixmapSize(*it);
+            it = decoded.erase(it);
+        }
+        else
+            it++;
+    }
+    if (freed > 0)
+        emit cacheSizeChanged(-freed);
+    submitDecode(page + 1);
+    submitDecode(page - 1);
+}
+
+void CacheMap::submitDecode(int const page)
+{
+    if (decoded.contains(page) || !data.contains(page) || data.value(page) == nullptr)
+        return;
+    RenderPool::instance()->submitDecode(this, page, *data.value(page));
+}
+
+void CacheMap::receiveImage(int const page, QByteArray const source, QImage const image, quint32 const jobGeneration)
+{
+    // The decoded data must still be the cached data of this page.
+    // source keeps the decoded data alive, thus comparing the data pointers is sufficient.
+    if (image.isNull() || jobGeneration != generation || data.value(page) == nullptr || data.value(page)->constData() != source.constData())
+        return;
+    if (predecodePage < 0 || std::abs(page - predecodePage) > 1)
+        return;
+#ifdef DEBUG_CACHE
+    qDebug() << "Decoded page" << page << this << parent();
+#endif
+    // Converting to a pixmap is done here while the main thread is idle.
+    qint64 const oldSize = dropDecoded(page);
+    decoded[page] = QPixmap::fromImage(image);
+    emit cacheSizeChanged(pixmapSize(decoded[page]) - oldSize);
+}
+
+qint64 CacheMap::dropDecoded(int const page)
+{
+    QMap<int, QPixmap>::iterator const it = decoded.find(page);
+    if (it == decoded.end())
+        return 0;
+    qint64 const size = pixmapSize(*it);
+    decoded.erase(it);
+    return size;
+}
+
+void CacheMap::handOver(int const page)
+{
+    QByteArray const* bytes = data.value(page, nullptr);
+    if (bytes == nullptr || borrowed.contains(page))
+        return;
+    // Another CacheMap, which has borrowed this page, keeps its copy of the data.
+    // Then it must count the page in its cache size.
+    for (auto const other : instances) {
+        QByteArray const* copy = other->data.value(page, nullptr);
+        if (other != this && copy != nullptr && other->borrowed.contains(page) && copy->constData() == bytes->constData()) {
+#ifdef DEBUG_CACHE
+            qDebug() << "Hand over page" << page << "from" << this << "to" << other;
+#endif
+            other->borrowed.remove(page);
+            emit other->cacheSizeChanged(bytes->size());
+            return;
+        }
+    }
+}
+
+QSet<int> const CacheMap::cachedPages() const
+{
+    QSet<int> pages;
+    for (QMap<int, QByteArray const*>::const_iterator it=data.cbegin(); it!=data.cend(); it++)
+        pages.insert(it.key());
+    return pages;
 }
 
 qint64 CacheMap::getSizeBytes() const
 {
     qint64 size = 0;
-    for (QMap<int, QByteArray const*>::const_iterator it=data.cbegin(); it!=data.cend(); it++)
-        size += (*it)->size();
+    for (QMap<int, QByteArray const*>::const_iterator it=data.cbegin(); it!=data.cend(); it++) {
+        if (!borrowed.contains(it.key()))
+            size += (*it)->size();
+    }
+    for (auto const& pixmap : decoded)
+        size += pixmapSize(pixmap);
     return size;
 }
+
+QJsonObject const CacheMap::statistics() const
+{
+    QJsonObject object;
+    object.insert("pages", data.size());
+    object.insert("borrowed_pages", borrowed.size());
+    object.insert("bytes", double(getSizeBytes()));
+    object.insert("decoded_pages", decoded.size());
+    object.insert("resolution", resolution);
+    object.insert("encoding", encoding == RawEncoding ? "raw" : encoding == CompressedEncoding ? "compressed" : "png");
+    object.insert("hits", double(hits));
+    object.insert("decoded_hits", double(decodedHits));
+    object.insert("misses", double(misses));
+    quint64 const requests = hits + decodedHits + misses;
+    object.insert("hit_rate", requests > 0 ? double(hits + decodedHits)/requests : 0.);
+    return object;
+}
+
+void CacheMap::clearStatistics()
+{
+    hits = 0;
+    decodedHits = 0;
+    misses = 0;
+}
@@ -20,56 +20,147 @@
 #define CACHEMAP_H
 
 #include <QMap>
+#include <QSet>
+#include <QJsonObject>
 #include "basicrenderer.h"
 
 /// QObject rendering pdf pages to images and storing these in a compressed cache.
-/// This class handles the complete rendering, owns the cached pages, and owns the
-/// cache thread which is used to render pages without affecting the main thread.
+/// This class handles the complete rendering and owns the cached pages. Pages are
+/// rendered to cache in the shared RenderPool without affecting the main thread.
+/// CacheMaps with the same content (document, resolution, page part, renderer and encoding)
+/// share their cached pages: each page is rendered only once and the data is not copied.
+/// For pages split in two halves, a CacheMap showing the left half and one showing the right half
+/// of the same document are partners: the full page is rendered once for both of them.
 class CacheMap : public BasicRenderer
 {
     Q_OBJECT
 
 public:
     /// Constructor
-    explicit CacheMap(PdfDoc const* doc, PagePart const part = FullPage, QObject* parent = nullptr): BasicRenderer(doc, part, parent), data() {}
+    explicit CacheMap(PdfDoc const* doc, PagePart const part = FullPage, QObject* parent = nullptr): BasicRenderer(doc, part, parent), data(), decoded() {instances.append(this);}
     /// Destructor
     ~CacheMap() override;
 
     // Get images from cache.
     /// Get an image from cache if available or an empty pixmap otherwise.
+    /// Pages which have been decoded ahead of time are returned without decoding.
     QPixmap const getCachedPixmap(int const page) const;
     /// Get an image from cache or render a new image and save it to cache.
     QPixmap const getPixmap(int const page);
-    /// Calculate and return cache ssize in bytes.
+    /// Get the encoded data of a cached page or an empty array. The data is shared, not copied.
+    /// Unlike getCachedPixmap this does not count as cache hit or miss.
+    QByteArray const getCachedBytes(int const page) const {QByteArray const* bytes = data.value(page, nullptr); return bytes == nullptr ? QByteArray() : *bytes;}
+    /// Calculate and return cache ssize in bytes, including the pages decoded ahead of time.
+    /// Pages shared with other CacheMaps are only counted by the CacheMap which rendered them.
     qint64 getSizeBytes() const;
     /// Set data from pixmap.
-    /// Write the pixmap in png format to a QBytesArray at *value(page).
+    /// Write the pixmap in the format given by encoding to a QBytesArray at *value(page).
     qint64 setPixmap(int const page, QPixmap const* pix);
-    /// Clear cache.
+    /// Clear cache. Pages, which are rendered at the moment, are discarded when they are ready.
     void clearCache();
     /// Is a page contained in cache?
     bool contains(int const page) {return data.contains(page);}
     /// Number of cached slides.
     int length() const {return data.size();}
-    /// Delete a page from cache and return its size.
+    /// Page numbers of all cached slides.
+    QSet<int> const cachedPages() const;
+    /// Delete a page (and its decoded version) from cache and return its size.
     qint64 clearPage(int const page);
+    /// Set all cached pages aside after reloading the document. They are not used until remapPages is called.
+    void holdPages();
+    /// Take pages set aside by holdPages, which have not changed after reloading the document, back to cache
+    /// and delete all other held pages. Pages which have been rendered again in the meantime are kept.
+    /// mapping contains for each new page the index of the same page before reloading or -1.
+    void remapPages(QList<int> const& mapping);
     /// Change resolution. This clears cache if the resolution actually changes.
     void changeResolution(double const res) override;
+    /// Change encoding of cached pages. This clears cache if the encoding actually changes.
+    void setEncoding(CacheEncoding const enc) override;
+    /// Statistics about this cache: number of pages, size in bytes and hit rate of requests for pages.
+    QJsonObject const statistics() const;
+    /// Reset the hit and miss counters.
+    void clearStatistics();
 
-    /// Update cache. This will start cacheThread.
-    bool updateCache(int const page);
+    /// Update cache. This submits a render job with the given priority to the RenderPool.
+    /// If another CacheMap with the same content has cached this page or is rendering it,
+    /// the page is taken from there instead.
+    /// Returns true if a new job was submitted.
+    bool updateCache(int const page, RenderPriority const priority = LookAheadPriority);
+    /// Decode the cached neighbours (page-1 and page+1) of page ahead of time in the RenderPool.
+    /// Decoded pages, which are not neighbours of page, are dropped.
+    void predecode(int const page);
 
 public slots:
-    /// Get cached pages from cacheThread. Called when cacheThread finishes.
-    void receiveBytes() override;
+    /// Get a cached page from the RenderPool. Called when a render job finishes.
+    void receiveBytes(int const page, QByteArray const bytes) override;
+    /// Get the half of a page, which was rendered by a partner CacheMap in the RenderPool.
+    /// Unlike receiveBytes this does not emit cacheThreadFinished.
+    /// Pages of an earlier generation (see BasicRenderer::getGeneration) are ignored.
+    void receivePartnerBytes(int const page, QByteArray const bytes, quint32 const jobGeneration);
+    /// Get a decoded page from the RenderPool. Called when a decode job finishes.
+    /// source is the data which has been decoded. The image is only used if source is still in cache
+    /// and the job belongs to the current generation.
+    void receiveImage(int const page, QByteArray const source, QImage const image, quint32 const jobGeneration);
+
+protected:
+    /// Drop a page rendered before the cache was cleared or held and emit pageDiscarded.
+    void discardBytes(int const page) override;
 
 private:
-    /// Cached slides as png images.
+    /// Cached slides as png images or (compressed) raw images, see encoding.
     QMap<int, QByteArray const*> data;
+    /// Pages decoded ahead of time. These are included in the cache size.
+    /// Only the neighbours of predecodePage (and predecodePage itself) are kept.
+    QMap<int, QPixmap> decoded;
+    /// Memory used by a decoded page in bytes.
+    static qint64 pixmapSize(QPixmap const& pixmap) {return qint64(pixmap.width())*pixmap.height()*pixmap.depth()/8;}
+    /// Delete the decoded version of page and return its size.
+    qint64 dropDecoded(int const page);
+    /// Number of requested pages, which were taken from cache and needed decoding.
+    mutable quint64 hits = 0;
+    /// Number of requested pages, which had been decoded ahead of time.
+    mutable quint64 decodedHits = 0;
+    /// Number of requested pages, which were not cached.
+    mutable quint64 misses = 0;
+    /// Implementation of getPixmap.
+    QPixmap const loadPixmap(int const page);
+    /// Page around which pages are decoded ahead of time. -1 if nothing should be decoded.
+    int predecodePage = -1;
+    /// Submit a job for decoding page if it is cached and not decoded yet.
+    void submitDecode(int const page);
+    /// Pages in data, which have been rendered by another CacheMap and are shared with it.
+    QSet<int> borrowed;
+    /// Pages of the previous version of the document set aside by holdPages.
+    QMap<int, QByteArray const*> held;
+    /// Pages in held, which had been borrowed from another CacheMap.
+    QSet<int> heldBorrowed;
+    /// All existing CacheMaps. Used for finding CacheMaps with the same content.
+    static QList<CacheMap*> instances;
+    /// Check whether other renders pages exactly like this CacheMap.
+    bool sameContent(CacheMap const* other) const;
+    /// Check whether other shows the other half of the pages of this CacheMap at the same or a lower resolution.
+    bool isPartner(CacheMap const* other) const;
+    /// Store a rendered page in cache and share it with other CacheMaps.
+    void storeBytes(int const page, QByteArray const& bytes);
+    /// Take page from another CacheMap with the same content if possible.
+    /// Returns true if the page is now cached.
+    bool borrowPage(int const page);
+    /// Store a page rendered by another CacheMap with the same content.
+    void receiveSharedPage(int const page, QByteArray const* bytes);
+    /// Hand a page, which was rendered by this, to all other CacheMaps with the same content.
+    void sharePage(int const page);
+    /// Before deleting an own page: make one of the CacheMaps, which have borrowed it, the owner of the page.
+    /// The page is then counted in its cache size instead of being kept uncounted.
+    void handOver(int const page);
 
 signals:
     /// Notify about changes in cache size (in bytes).
     void cacheSizeChanged(qint64 const size);
+    /// Notify that a page has been rendered to cache.
+    void pageReady(int const page);
+    /// Notify that a rendered page has been discarded because cache was cleared while rendering it.
+    /// The page must be requested again if it is still needed.
+    void pageDiscarded(int const page);
 };
 
 #endif // CACHEMAP_H
@@ -17,33 +17,63 @@
  */
 
 #include "cachethread.h"
-#include "cachemap.h"
+#include "basicrenderer.h"
+#include "diskcache.h"
+#include "renderstats.h"
 
-CacheThread::~CacheThread()
+void CacheThread::run()
 {
-    // Old bytes which have not been picked up could still be around. Delete them.
-    delete bytes;
-    bytes = nullptr;
+    RenderPool::Job job;
+    // Handle jobs until the pool tells this thread to exit.
+    while (pool->takeJob(job)) {
+        if (job.data.isEmpty()) {
+            QByteArray partnerBytes;
+            QByteArray const bytes = renderBytes(job.master, job.page, job.partner, &partnerBytes);
+            pool->finishJob(job, bytes, partnerBytes);
+        }
+        else
+            pool->finishDecodeJob(job, BasicRenderer::decodeImage(job.data));
+    }
 }
 
-void CacheThread::run()
+QByteArray const CacheThread::renderBytes(BasicRenderer const* master, int const page, BasicRenderer const* partner, QByteArray* partnerBytes)
+{
+    DiskCache const* disk = DiskCache::instance();
+    if (!disk->isEnabled() || !master->diskCacheable())
+        return renderPage(master, page, partner, partnerBytes);
+    bool const withPartner = partner != nullptr && partnerBytes != nullptr;
+    QElapsedTimer timer;
+    timer.start();
+    QByteArray bytes = disk->load(master, page);
+    if (!bytes.isEmpty()) {
+        RenderStats::instance()->record(RenderStats::DiskLoad, timer);
+        if (!withPartner)
+            return bytes;
+        *partnerBytes = disk->load(partner, page);
+        // If the partner's half is not on disk, render the full page for both.
+        if (!partnerBytes->isEmpty())
+            return bytes;
+    }
+    bytes = renderPage(master, page, partner, partnerBytes);
+    disk->store(master, page, bytes);
+    if (withPartner)
+        disk->store(partner, page, *partnerBytes);
+    return bytes;
+}
+
+QByteArray const CacheThread::renderPage(BasicRenderer const* master, int const page, BasicRenderer const* partner, QByteArray* partnerBytes)
 {
-    // Handle one page. This page should not change while rendering.
-    page = newPage;
+    bool const withPartner = partner != nullptr && partnerBytes != nullptr && master->getPagePart() != FullPage;
     QString renderCommand = master->getRenderCommand(page);
+    QImage image;
     if (renderCommand.isEmpty()) {
-        QPixmap pixmap = master->renderPixmap(page);
-        if (isInterruptionRequested())
-            return;
-        QByteArray* bytes_nonconst = new QByteArray();
-        QBuffer buffer(bytes_nonconst);
-        buffer.open(QIODevice::WriteOnly);
-        pixmap.save(&buffer, "PNG");
-        // Usually bytes==nullptr. But if the old bytes have not been picked up, we should delete them here.
-        delete bytes;
-        bytes = bytes_nonconst;
+        if (!withPartner)
+            return BasicRenderer::encodeImage(master->renderImage(page), master->getEncoding());
+        image = master->renderFullImage(page);
     }
     else {
+        QElapsedTimer timer;
+        timer.start();
         ExternalRenderer* renderer = new ExternalRenderer(page);
 #if QT_VERSION_MAJOR <= 5 and QT_VERSION_MINOR < 15
         renderer->start(renderCommand);
@@ -53,42 +83,30 @@ void CacheThread::run()
 #endif
         if (!renderer->waitForFinished(60000)) {
             renderer->kill();
-            // Usually bytes==nullptr. But if the old bytes have not been picked up, we should delete them here.
-            delete bytes;
-            bytes = nullptr;
             delete renderer;
-            return;
+            return QByteArray();
         }
-        // Usually bytes==nullptr. But if the old bytes have not been picked up, we should delete them here.
-        delete bytes;
-        bytes = renderer->getBytes();
+        QByteArray const* rendered = renderer->getBytes();
         delete renderer;
-        if (master->getPagePart() != FullPage) {
-            if (isInterruptionRequested()) {
-                delete bytes;
-                bytes = nullptr;
-                return;
-            }
-            QPixmap pixmap;
-            pixmap.loadFromData(*bytes, "PNG");
-            delete bytes;
-            if (master->getPagePart() == LeftHalf)
-                pixmap = pixmap.copy(0, 0, pixmap.width()/2, pixmap.height());
-            else
-                pixmap = pixmap.copy(pixmap.width()/2, 0, pixmap.width()/2, pixmap.height());
-            QByteArray* bytes_nonconst = new QByteArray();
-            QBuffer buffer(bytes_nonconst);
-            buffer.open(QIODevice::WriteOnly);
-            pixmap.save(&buffer, "PNG");
-            bytes = bytes_nonconst;
+        RenderStats::instance()->record(RenderStats::Render, timer);
+        if (rendered == nullptr)
+            return QByteArray();
+        if (master->getPagePart() == FullPage && master->getEncoding() == PngEncoding) {
+            // The external renderer already returns a png image.
+            QByteArray const bytes = *rendered;
+            delete rendered;
+            return bytes;
         }
+        image.loadFromData(*rendered, "PNG");
+        delete rendered;
     }
-}
-
-QByteArray const* CacheThread::getBytes()
-{
-    // Return bytes and set bytes=nullptr.
-    QByteArray const* returnBytes = bytes;
-    bytes = nullptr;
-    return returnBytes;
+    if (withPartner) {
+        // Use the other half of the page for partner. This saves rendering the page a second time.
+        QImage other = BasicRenderer::cropImage(image, partner->getPagePart());
+        qreal const ratio = partner->getResolution() / master->getResolution();
+        if (ratio < 0.999)
+            other = other.scaled(qRound(ratio*other.width()), qRound(ratio*other.height()), Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+        *partnerBytes = BasicRenderer::encodeImage(other, partner->getEncoding());
+    }
+    return BasicRenderer::encodeImage(BasicRenderer::cropImage(image, master->getPagePart()), master->getEncoding());
 }
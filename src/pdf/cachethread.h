@@ -23,41 +23,33 @@
 #include <QThread>
 #include <QPixmap>
 #include "externalrenderer.h"
+#include "renderpool.h"
 
 class BasicRenderer;
 
-/// QThread used for rendering slides to png images in cache.
-/// This thread is owned by CacheMap objects, but rendering a page to cache
-/// using this thread is always triggered by ControlScreen::updateCacheStep.
+/// Worker thread of the RenderPool used for rendering slides to (encoded) images in cache.
+/// This thread is owned by the RenderPool. It takes jobs from the pool until the pool
+/// tells it to exit, renders the pages and hands the results back to the pool.
 class CacheThread : public QThread
 {
     Q_OBJECT
 
 private:
-    /// Next page which will be rendered. This number is set via setPage(int) by CacheMap.
-    int newPage = 0;
-    /// Currently rendered page. This page is only adapted to newPage at the beginning of run().
-    int page = 0;
-    /// CacheMap object owning this.
-    BasicRenderer const* master;
-    /// Cached page as a png image, result of CacheThread.
-    /// This is accessible by getBytes(). Once taken by getBytes(), bytes is set to nullptr.
-    /// When cleaning up, this should thus be deleted and set to nullptr.
-    QByteArray const* bytes = nullptr;
+    /// RenderPool owning this.
+    RenderPool* pool;
 
 public:
     /// Constructor.
-    CacheThread(BasicRenderer const* cache, QObject* parent = nullptr) : QThread(parent), master(cache) {}
-    /// Destructor.
-    ~CacheThread();
-    /// Set page which should be rendered next.
-    void setPage(int const pageNumber) {newPage = pageNumber;}
-    /// Get bytes and set bytes to nullptr. The calling function then owns the bytes.
-    /// This should be called exactly once after run() finished.
-    QByteArray const* getBytes();
-    /// Get page which this is currently rendering.
-    int getPage() const {return page;}
-    /// Do the work: Set page=newPage, render it, and save the compressed page in bytes.
+    CacheThread(RenderPool* pool, QObject* parent = nullptr) : QThread(parent), pool(pool) {}
+    /// Render a page using the settings of master and return it in the encoding of master.
+    /// Pages are loaded from and written to the DiskCache if it is enabled.
+    /// If partner is given, the full page is rendered only once and the other half of the page
+    /// is written to partnerBytes in the encoding and resolution of partner.
+    /// Returns an empty QByteArray if rendering failed.
+    static QByteArray const renderBytes(BasicRenderer const* master, int const page, BasicRenderer const* partner = nullptr, QByteArray* partnerBytes = nullptr);
+    /// Render a page like renderBytes without using the DiskCache.
+    static QByteArray const renderPage(BasicRenderer const* master, int const page, BasicRenderer const* partner, QByteArray* partnerBytes);
+    /// Do the work: take jobs from pool, render them and return the results to pool.
     void run() override;
 };
 
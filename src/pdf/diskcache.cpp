@@ -0,0 +1,194 @@
+/*
+ * This file is part of BeamerPresenter.
+ * Copyright (C) 2020  stiglers-eponym
+
+ * BeamerPresenter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * BeamerPresenter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with BeamerPresenter. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <QDir>
+#include <QDirIterator>
+#include <QDateTime>
+#include <QFile>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QCryptographicHash>
+#include <QSet>
+#include <QtDebug>
+#include "diskcache.h"
+#include "basicrenderer.h"
+
+DiskCache* DiskCache::instance()
+{
+    static DiskCache cache;
+    return &cache;
+}
+
+QString const DiskCache::defaultDirectory()
+{
+    // GenericCacheLocation is $XDG_CACHE_HOME or ~/.cache on Linux.
+    return QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation) + "/beamerpresenter/pages";
+}
+
+void DiskCache::setDirectory(QString const& dir)
+{
+    QMutexLocker locker(&mutex);
+    if (dir.isEmpty()) {
+        directory = "";
+        return;
+    }
+    if (!QDir().mkpath(dir)) {
+        qWarning() << "Failed to create directory for disk cache:" << dir;
+        directory = "";
+        return;
+    }
+    directory = QDir(dir).absolutePath();
+    pruneMutex.lock();
+    usedSize = -1;
+    pruneMutex.unlock();
+#ifdef DEBUG_CACHE
+    qDebug() << "Disk cache directory:" << directory;
+#endif
+}
+
+bool DiskCache::isEnabled() const
+{
+    QMutexLocker locker(&mutex);
+    return !directory.isEmpty();
+}
+
+void DiskCache::setMaxSize(qint64 const bytes)
+{
+    QMutexLocker locker(&mutex);
+    maxSize = bytes;
+}
+
+QString const DiskCache::filePath(BasicRenderer const* renderer, int const page) const
+{
+    mutex.lock();
+    QString const dir = directory;
+    mutex.unlock();
+    if (dir.isEmpty() || renderer->getResolution() <= 0.)
+        return "";
+    QByteArray const hash = renderer->getDoc()->getContentHash();
+    if (hash.isEmpty())
+        return "";
+    // The render command contains the file name and the image size.
+    // Only a short hash of the command is included in the file name.
+    QString const command = renderer->getRenderCommand(page);
+    QString const renderer_id = command.isEmpty() ? "poppler" : QString(QCryptographicHash::hash(command.toUtf8(), QCryptographicHash::Md5).toHex().left(12));
+    return dir + "/" + QString::fromLatin1(hash) + "/"
+            + QString::number(renderer->getResolution(), 'f', 6)
+            + "-" + QString::number(renderer->getPagePart())
+            + "-" + QString::number(renderer->getEncoding())
+            + "-" + renderer_id
+            + "/" + QString::number(page);
+}
+
+QByteArray const DiskCache::load(BasicRenderer const* renderer, int const page) const
+{
+    QString const path = filePath(renderer, page);
+    if (path.isEmpty())
+        return QByteArray();
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly))
+        return QByteArray();
+#if QT_VERSION >= QT_VERSION_CHECK(5, 10, 0)
+    // The modification time marks the last use of the file when the directory is pruned.
+    file.setFileTime(QDateTime::currentDateTime(), QFileDevice::FileModificationTime);
+#endif
+    // The data is owned by the cache, while the file may be pruned or overwritten at any time.
+    QByteArray const bytes = file.readAll();
+    if (bytes.isEmpty())
+        return QByteArray();
+#ifdef DEBUG_CACHE
+    qDebug() << "Loaded page from disk cache:" << page << path;
+#endif
+    return bytes;
+}
+
+void DiskCache::store(BasicRenderer const* renderer, int const page, QByteArray const& bytes) const
+{
+    if (bytes.isEmpty())
+        return;
+    QString const path = filePath(renderer, page);
+    if (path.isEmpty())
+        return;
+    if (!QDir().mkpath(QFileInfo(path).absolutePath()))
+        return;
+    // QSaveFile writes to a temporary file first. Like this other threads or processes
+    // never read incomplete files.
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly) || file.write(bytes) != bytes.size() || !file.commit())
+        qWarning() << "Failed to write page to disk cache:" << path;
+    else
+        addUsage(bytes.size());
+}
+
+void DiskCache::addUsage(qint64 const size) const
+{
+    mutex.lock();
+    QString const dir = directory;
+    qint64 const limit = maxSize;
+    mutex.unlock();
+    if (dir.isEmpty() || limit <= 0)
+        return;
+    QMutexLocker locker(&pruneMutex);
+    if (usedSize >= 0)
+        usedSize += size;
+    if (usedSize < 0 || usedSize > limit)
+        usedSize = prune(dir, limit);
+}
+
+qint64 DiskCache::prune(QString const& dir, qint64 const limit)
+{
+    QList<QFileInfo> files;
+    qint64 total = 0;
+    QDirIterator it(dir, QDir::Files, QDirIterator::Subdirectories);
+    while (it.hasNext()) {
+        it.next();
+        // Skip temporary files of QSaveFile, which may still be written by another thread.
+        if (it.fileName().contains('.'))
+            continue;
+        files.append(it.fileInfo());
+        total += it.fileInfo().size();
+    }
+    if (total <= limit)
+        return total;
+    // Sort files by their last use, oldest first.
+    // The access time is often updated only rarely, therefore also the modification time is used.
+    std::sort(files.begin(), files.end(), [](QFileInfo const& a, QFileInfo const& b) {
+        return qMax(a.lastRead(), a.lastModified()) < qMax(b.lastRead(), b.lastModified());
+    });
+    qint64 const target = limit / 10 * 9;
+    QSet<QString> directories;
+    for (auto const& info : files) {
+        if (total <= target)
+            break;
+        if (QFile::remove(info.absoluteFilePath())) {
+            total -= info.size();
+            directories.insert(info.absolutePath());
+        }
+    }
+    // Remove directories which became empty. rmdir fails for directories which are not empty.
+    for (auto const& path : directories) {
+        QDir subdir(path);
+        while (subdir.absolutePath().length() > dir.length() && QDir().rmdir(subdir.absolutePath()))
+            subdir.cdUp();
+    }
+#ifdef DEBUG_CACHE
+    qDebug() << "Pruned disk cache to" << total << "bytes";
+#endif
+    return total;
+}
@@ -0,0 +1,83 @@
+/*
+ * This file is part of BeamerPresenter.
+ * Copyright (C) 2020  stiglers-eponym
+
+ * BeamerPresenter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * BeamerPresenter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with BeamerPresenter. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef DISKCACHE_H
+#define DISKCACHE_H
+
+#include <QString>
+#include <QByteArray>
+#include <QMutex>
+
+class BasicRenderer;
+
+/// Persistent cache of rendered pages on disk.
+/// Pages are stored in files, which are identified by the content of the PDF file, page number,
+/// resolution, page part, encoding and renderer. Like this rendered pages can be reused when the
+/// same presentation is shown again on the same hardware. Files are loaded by RenderPool jobs
+/// using memory mapping. The disk cache is disabled as long as no directory is set.
+/// The size of the directory is limited: if it grows beyond the limit, the least recently used
+/// files are removed. This also removes pages of old versions of a document after some time.
+class DiskCache
+{
+public:
+    /// Get the disk cache shared by all renderers.
+    static DiskCache* instance();
+    /// Default directory: $XDG_CACHE_HOME/beamerpresenter/pages.
+    static QString const defaultDirectory();
+
+    /// Set directory for cached pages. An empty string disables the disk cache.
+    void setDirectory(QString const& dir);
+    /// Is the disk cache enabled?
+    bool isEnabled() const;
+    /// Set maximum size of the cache directory in bytes. A non-positive number disables the limit.
+    void setMaxSize(qint64 const bytes);
+
+    /// Load a page rendered with the settings of renderer from disk.
+    /// Returns an empty QByteArray if the page is not cached on disk.
+    /// This is thread safe.
+    QByteArray const load(BasicRenderer const* renderer, int const page) const;
+    /// Write a page rendered with the settings of renderer to disk.
+    /// This is thread safe.
+    void store(BasicRenderer const* renderer, int const page, QByteArray const& bytes) const;
+
+private:
+    /// Constructor: only used by instance().
+    DiskCache() {}
+    /// Path to the file which contains the page rendered by renderer.
+    /// Returns an empty string if the disk cache cannot be used for renderer.
+    QString const filePath(BasicRenderer const* renderer, int const page) const;
+    /// Add size bytes to usedSize and prune the cache directory if it exceeds maxSize.
+    /// This reads the full directory when it is called for the first time.
+    void addUsage(qint64 const size) const;
+    /// Remove least recently used files until the directory is smaller than 90% of limit.
+    /// Returns the size of the remaining files in bytes.
+    static qint64 prune(QString const& dir, qint64 const limit);
+
+    /// Directory containing cached pages or empty string if the disk cache is disabled.
+    QString directory;
+    /// Maximum size of directory in bytes. Non-positive numbers mean no limit.
+    qint64 maxSize = 1024*1048576LL;
+    /// Protects directory and maxSize.
+    mutable QMutex mutex;
+    /// Size of all files in directory in bytes or -1 if it is not known yet.
+    mutable qint64 usedSize = -1;
+    /// Protects usedSize and makes sure that only one thread prunes the directory.
+    mutable QMutex pruneMutex;
+};
+
+#endif // DISKCACHE_H
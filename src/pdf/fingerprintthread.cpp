@@ -0,0 +1,69 @@
+/*
+ * This file is part of BeamerPresenter.
+ * Copyright (C) 2020  stiglers-eponym
+
+ * BeamerPresenter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * BeamerPresenter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with BeamerPresenter. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <QCryptographicHash>
+#include <QImage>
+#include <QtDebug>
+#include "fingerprintthread.h"
+
+FingerprintThread::~FingerprintThread()
+{
+    requestInterruption();
+    wait();
+}
+
+void FingerprintThread::calculate(QList<Poppler::Page*> const& pages)
+{
+    wait();
+    this->pages = pages;
+    fingerprints.clear();
+    start(QThread::LowestPriority);
+}
+
+QList<QByteArray> const& FingerprintThread::interrupt()
+{
+    requestInterruption();
+    wait();
+    return fingerprints;
+}
+
+void FingerprintThread::run()
+{
+    for (auto const page : pages) {
+        if (isInterruptionRequested())
+            return;
+        fingerprints.append(pageFingerprint(page));
+    }
+#ifdef DEBUG_RENDERING
+    qDebug() << "Calculated fingerprints of" << fingerprints.length() << "pages";
+#endif
+}
+
+QByteArray const FingerprintThread::pageFingerprint(Poppler::Page const* page)
+{
+    // Text and a very low resolution image should notice all relevant changes of a slide.
+    QCryptographicHash hash(QCryptographicHash::Md5);
+    QSizeF const size = page->pageSizeF();
+    hash.addData(QByteArray::number(size.width()) + "x" + QByteArray::number(size.height()));
+    hash.addData(page->label().toUtf8());
+    hash.addData(page->text(QRectF()).toUtf8());
+    QImage const image = page->renderToImage(18., 18.);
+    for (int line=0; line<image.height(); line++)
+        hash.addData(reinterpret_cast<char const*>(image.constScanLine(line)), image.bytesPerLine());
+    return hash.result();
+}
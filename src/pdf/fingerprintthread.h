@@ -0,0 +1,55 @@
+/*
+ * This file is part of BeamerPresenter.
+ * Copyright (C) 2020  stiglers-eponym
+
+ * BeamerPresenter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * BeamerPresenter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with BeamerPresenter. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef FINGERPRINTTHREAD_H
+#define FINGERPRINTTHREAD_H
+
+#include <QThread>
+#include <poppler/qt5/poppler-qt5.h>
+
+/// Thread calculating fingerprints of the content of all pages of a document.
+/// PdfDoc compares the fingerprints of the old and new version of a document when reloading it.
+/// The fingerprints are calculated in the background after loading a document, such that
+/// neither loading nor reloading needs to render all pages in the main thread.
+class FingerprintThread : public QThread
+{
+    Q_OBJECT
+
+public:
+    /// Constructor
+    explicit FingerprintThread(QObject* parent = nullptr) : QThread(parent) {}
+    /// Destructor: stop the calculation.
+    ~FingerprintThread() override;
+    /// Calculate the fingerprints of pages in this thread. The pages must stay valid until the thread has finished.
+    void calculate(QList<Poppler::Page*> const& pages);
+    /// Stop the calculation and return the fingerprints calculated so far (in the order of the pages passed
+    /// to calculate()). This only waits until the fingerprint of the current page is done.
+    QList<QByteArray> const& interrupt();
+    /// Calculate the fingerprints.
+    void run() override;
+    /// Calculate a fingerprint of the content of page (size, label, text and a low resolution image).
+    static QByteArray const pageFingerprint(Poppler::Page const* page);
+
+private:
+    /// Pages of which the fingerprints are calculated.
+    QList<Poppler::Page*> pages;
+    /// Fingerprints of pages (in the same order).
+    QList<QByteArray> fingerprints;
+};
+
+#endif // FINGERPRINTTHREAD_H
@@ -16,10 +16,16 @@
  * along with BeamerPresenter. If not, see <https://www.gnu.org/licenses/>.
  */
 
+#include <QFile>
+#include <QCryptographicHash>
+#include <QMultiHash>
+#include <algorithm>
 #include "pdfdoc.h"
 
 PdfDoc::~PdfDoc()
 {
+    // The fingerprint thread uses the pages.
+    delete fingerprinter;
     qDeleteAll(pdfPages);
     pdfPages.clear();
     delete popplerDoc;
@@ -48,8 +54,16 @@ bool PdfDoc::loadDocument()
     if (popplerDoc != nullptr && QFileInfo(pdfPath).lastModified() <= lastModified)
         return false;
 
-    // Load the file
-    Poppler::Document* newDoc = Poppler::Document::load(pdfPath);
+    // Load the file to memory. Like this the old version of the document stays
+    // available while it is compared to the new version when reloading.
+    QFile pdfFile(pdfPath);
+    if (!pdfFile.open(QIODevice::ReadOnly)) {
+        qCritical() << "Failed to open document";
+        return false;
+    }
+    QByteArray const newData = pdfFile.readAll();
+    pdfFile.close();
+    Poppler::Document* newDoc = Poppler::Document::loadFromData(newData);
     if (newDoc == nullptr) {
         qCritical() << "Failed to open document";
         return false;
@@ -86,17 +100,26 @@ bool PdfDoc::loadDocument()
 #endif
 #endif
 
-    // Clear old lists
+    // Create lists of pages.
+    QList<Poppler::Page*> newPages;
+    for (int i=0; i < newDoc->numPages(); i++)
+        newPages.append(newDoc->page(i));
+
+    // When reloading: the fingerprints of the old pages have been calculated in the background
+    // since the old document was loaded. The pages are compared in getPageMapping().
+    // Don't wait for the remaining old pages: they are treated as changed.
+    // This also stops the thread before the old pages are deleted.
+    pageMapping.clear();
+    mappingPending = popplerDoc != nullptr;
+    if (mappingPending)
+        oldFingerprints = fingerprinter->interrupt();
+
+    // Replace old lists
     qDeleteAll(pdfPages);
-    pdfPages.clear();
+    pdfPages = newPages;
     labels.clear();
-
-    // Create lists of pages.
-    for (int i=0; i < newDoc->numPages(); i++) {
-        Poppler::Page* p = newDoc->page(i);
-        pdfPages.append(p);
-        labels.append(p->label());
-    }
+    for (auto const page : pdfPages)
+        labels.append(page->label());
 
     // Check document contents and print warnings if unimplemented features are found.
     if (newDoc->hasOptionalContent())
@@ -110,9 +133,74 @@ bool PdfDoc::loadDocument()
     delete popplerDoc;
     popplerDoc = newDoc;
     lastModified = file.lastModified();
+    // Calculate fingerprints of the new pages for comparing them to the next version of the document.
+    fingerprinter->calculate(pdfPages);
+    hashMutex.lock();
+    fileData = newData;
+    contentHash.clear();
+    hashMutex.unlock();
     return true;
 }
 
+QList<int> const& PdfDoc::getPageMapping()
+{
+    if (mappingPending) {
+        calculatePageMapping();
+        mappingPending = false;
+        oldFingerprints.clear();
+    }
+    return pageMapping;
+}
+
+void PdfDoc::calculatePageMapping()
+{
+    // Map fingerprints of old pages to their indices.
+    QMultiHash<QByteArray, int> oldPages;
+    for (int i=oldFingerprints.length()-1; i>=0; i--)
+        oldPages.insert(oldFingerprints[i], i);
+
+    // If the fingerprints of the new pages are still being calculated, the calculation is stopped.
+    // New pages without fingerprint are treated as changed.
+    QList<QByteArray> const& newFingerprints = fingerprinter->interrupt();
+#ifdef DEBUG_RENDERING
+    if (newFingerprints.length() < pdfPages.length())
+        qDebug() << "Fingerprints missing for" << pdfPages.length() - newFingerprints.length() << "pages";
+#endif
+    pageMapping.clear();
+    for (int i=0; i<pdfPages.length(); i++) {
+        if (i >= newFingerprints.length())
+            pageMapping.append(-1);
+        else if (i < oldFingerprints.length() && oldFingerprints[i] == newFingerprints[i]) {
+            // Most pages stay at their position.
+            pageMapping.append(i);
+            oldPages.remove(newFingerprints[i], i);
+        }
+        else
+            pageMapping.append(-1);
+    }
+    // Pages might have been moved by inserting or removing other pages.
+    for (int i=0; i<newFingerprints.length(); i++) {
+        if (pageMapping[i] < 0 && oldPages.contains(newFingerprints[i])) {
+            // Use the first old page with this fingerprint.
+            QList<int> candidates = oldPages.values(newFingerprints[i]);
+            int const old = *std::min_element(candidates.cbegin(), candidates.cend());
+            pageMapping[i] = old;
+            oldPages.remove(newFingerprints[i], old);
+        }
+    }
+#ifdef DEBUG_RENDERING
+    qDebug() << "Unchanged pages after reload:" << pageMapping;
+#endif
+}
+
+QByteArray const PdfDoc::getContentHash() const
+{
+    QMutexLocker locker(&hashMutex);
+    if (contentHash.isEmpty() && !fileData.isEmpty())
+        contentHash = QCryptographicHash::hash(fileData, QCryptographicHash::Sha1).toHex();
+    return contentHash;
+}
+
 QSizeF const PdfDoc::getPageSize(int const pageNumber) const
 {
     // Return page size in point = inch/72
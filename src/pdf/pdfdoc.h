@@ -25,7 +25,9 @@
 #include <poppler/qt5/poppler-qt5.h>
 #include <QDomDocument>
 #include <QInputDialog>
+#include <QMutex>
 #include "../enumerates.h"
+#include "fingerprintthread.h"
 
 #if __has_include(<poppler/qt5/poppler-version.h>)
 // Not available in poppler <= 0.62.0:
@@ -56,6 +58,23 @@ private:
     QDateTime lastModified = QDateTime();
     /// List of labels
     QList<QString> labels;
+    /// Content of the PDF file. The document is loaded from this data.
+    QByteArray fileData;
+    /// Hash of the file content (hex encoded). This is computed when it is first needed.
+    mutable QByteArray contentHash;
+    /// Protects fileData and contentHash.
+    mutable QMutex hashMutex;
+    /// Thread calculating fingerprints of the content of all pages in the background after loading the document.
+    FingerprintThread* const fingerprinter = new FingerprintThread();
+    /// After reloading the document: fingerprints of the pages of the previous version of the document.
+    QList<QByteArray> oldFingerprints;
+    /// After reloading the document: for each page the index of the page with the same content
+    /// in the previous version of the document, or -1 if the page is new or has changed.
+    QList<int> pageMapping;
+    /// True if the document has been reloaded, but pageMapping has not been calculated yet.
+    bool mappingPending = false;
+    /// Compare fingerprints of old and new pages and write the result to pageMapping.
+    void calculatePageMapping();
 
 public:
     /// Constructor: takes the path to the PDF file as argument. This does not load the document.
@@ -92,6 +111,16 @@ public:
     int destToSlide(QString const& dest) const;
     /// Return the path to the PDF file.
     QString const& getPath() const {return pdfPath;}
+    /// Return a hash of the content of the loaded file. This is used to identify pages in the disk cache.
+    /// The hash is computed on the first call after (re)loading the document. This is thread safe.
+    QByteArray const getContentHash() const;
+    /// After reloading the document: for each page the index of the unchanged page in the previous
+    /// version of the document or -1 if the page has changed. Empty after loading the document for the first time.
+    /// This never waits for the fingerprints: if they are still being calculated, the calculation is stopped
+    /// and pages without fingerprint are treated as changed.
+    QList<int> const& getPageMapping();
+    /// The thread calculating fingerprints of all pages. It emits finished() when getPageMapping() is complete.
+    FingerprintThread const* getFingerprintThread() const {return fingerprinter;}
 };
 
 #endif // PDFWIDGET_H
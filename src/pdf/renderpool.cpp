@@ -0,0 +1,361 @@
+/*
+ * This file is part of BeamerPresenter.
+ * Copyright (C) 2020  stiglers-eponym
+
+ * BeamerPresenter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * BeamerPresenter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with BeamerPresenter. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QtDebug>
+#include "renderpool.h"
+#include "cachethread.h"
+#include "basicrenderer.h"
+
+RenderPool* RenderPool::instance()
+{
+    // The pool is owned by the application and deleted after the main event loop has ended.
+    static RenderPool* pool = new RenderPool(QCoreApplication::instance());
+    return pool;
+}
+
+RenderPool::RenderPool(QObject* parent) :
+    QObject(parent),
+    maxThreads(QThread::idealThreadCount() > 0 ? QThread::idealThreadCount() : 1)
+{}
+
+RenderPool::~RenderPool()
+{
+    mutex.lock();
+    stopping = true;
+    queue.clear();
+    jobAvailable.wakeAll();
+    QList<CacheThread*> const threads = workers;
+    mutex.unlock();
+    for (auto thread : threads) {
+        thread->wait(10000);
+        if (thread->isRunning()) {
+            thread->terminate();
+            thread->wait(10000);
+        }
+        delete thread;
+    }
+}
+
+void RenderPool::setThreadCount(int const number)
+{
+    QMutexLocker locker(&mutex);
+    if (number < 1)
+        maxThreads = QThread::idealThreadCount() > 0 ? QThread::idealThreadCount() : 1;
+    else
+        maxThreads = number;
+#ifdef DEBUG_CACHE
+    qDebug() << "Render threads:" << maxThreads;
+#endif
+    // Superfluous workers exit when they ask for their next job.
+    jobAvailable.wakeAll();
+    startWorkers();
+}
+
+bool RenderPool::submit(BasicRenderer* master, int const page, RenderPriority const priority, BasicRenderer* partner)
+{
+    QMutexLocker locker(&mutex);
+    if (stopping)
+        return false;
+    for (auto const& job : running) {
+        // Running jobs of an earlier generation do not deliver a usable result.
+        if ((job.master == master || job.partner == master) && job.page == page && job.data.isEmpty() && isCurrent(job, master))
+            return false;
+    }
+    for (QList<Job>::iterator it=queue.begin(); it!=queue.end(); it++) {
+        if ((it->master == master || it->partner == master) && it->page == page && it->data.isEmpty()) {
+            if (it->master == master && it->partner == nullptr && partner != nullptr) {
+                it->partner = partner;
+                it->partnerGeneration = partner->getGeneration();
+            }
+            if (it->priority > priority) {
+                // Raise the priority of the queued job.
+                Job job = *it;
+                queue.erase(it);
+                job.priority = priority;
+                enqueue(job);
+            }
+            return false;
+        }
+    }
+    enqueue({master, page, priority, QByteArray(), partner, master->getGeneration(), partner == nullptr ? 0 : partner->getGeneration()});
+    startWorkers();
+    jobAvailable.wakeOne();
+    return true;
+}
+
+bool RenderPool::submitDecode(BasicRenderer* master, int const page, QByteArray const& data, RenderPriority const priority)
+{
+    if (data.isEmpty())
+        return false;
+    QMutexLocker locker(&mutex);
+    if (stopping)
+        return false;
+    for (auto const& job : running) {
+        if (job.master == master && job.page == page && !job.data.isEmpty() && isCurrent(job, master))
+            return false;
+    }
+    for (QList<Job>::iterator it=queue.begin(); it!=queue.end(); it++) {
+        if (it->master == master && it->page == page && !it->data.isEmpty()) {
+            // Replace the queued job: data might have changed.
+            queue.erase(it);
+            break;
+        }
+    }
+    // data is implicitly shared: this does not copy the encoded page.
+    enqueue({master, page, priority, data, nullptr, master->getGeneration(), 0});
+    startWorkers();
+    jobAvailable.wakeOne();
+    return true;
+}
+
+bool RenderPool::attachPartner(BasicRenderer const* master, int const page, BasicRenderer* partner, RenderPriority const priority)
+{
+    QMutexLocker locker(&mutex);
+    for (auto const& job : running) {
+        if (job.master == master && job.page == page && job.data.isEmpty() && isCurrent(job, master))
+            return job.partner == partner && isCurrent(job, partner);
+    }
+    for (QList<Job>::iterator it=queue.begin(); it!=queue.end(); it++) {
+        if (it->master == master && it->page == page && it->data.isEmpty()) {
+            if (it->partner != nullptr && it->partner != partner)
+                return false;
+            Job job = *it;
+            job.partner = partner;
+            job.partnerGeneration = partner->getGeneration();
+            if (job.priority > priority) {
+                queue.erase(it);
+                job.priority = priority;
+                enqueue(job);
+            }
+            else
+                *it = job;
+            return true;
+        }
+    }
+    return false;
+}
+
+void RenderPool::enqueue(Job const& job)
+{
+    QList<Job>::iterator it = queue.begin();
+    while (it != queue.end() && it->priority <= job.priority)
+        it++;
+    queue.insert(it, job);
+}
+
+void RenderPool::setPriority(BasicRenderer const* master, int const page, RenderPriority const priority)
+{
+    QMutexLocker locker(&mutex);
+    for (QList<Job>::iterator it=queue.begin(); it!=queue.end(); it++) {
+        if (it->master == master && it->page == page && it->data.isEmpty()) {
+            Job job = *it;
+            queue.erase(it);
+            job.priority = priority;
+            enqueue(job);
+            return;
+        }
+    }
+}
+
+void RenderPool::startWorkers()
+{
+    // Only start a new thread if no idle thread can take the waiting jobs.
+    while (!stopping && workers.size() < maxThreads && idleWorkers < queue.size()) {
+        CacheThread* thread = new CacheThread(this);
+        workers.append(thread);
+        thread->start();
+        // Count the new thread as idle until it takes its first job.
+        idleWorkers++;
+    }
+}
+
+void RenderPool::cancel(BasicRenderer const* master)
+{
+    QMutexLocker locker(&mutex);
+    removeQueued(master);
+}
+
+void RenderPool::removeQueued(BasicRenderer const* master)
+{
+    for (QList<Job>::iterator it=queue.begin(); it!=queue.end();) {
+        if (it->master == master)
+            it = queue.erase(it);
+        else {
+            if (it->partner == master)
+                it->partner = nullptr;
+            it++;
+        }
+    }
+}
+
+int RenderPool::cancel(BasicRenderer const* master, RenderPriority const minPriority)
+{
+    QMutexLocker locker(&mutex);
+    int removed = 0;
+    for (QList<Job>::iterator it=queue.begin(); it!=queue.end();) {
+        if (it->master == master && it->priority >= minPriority && it->data.isEmpty()) {
+            it = queue.erase(it);
+            removed++;
+        }
+        else
+            it++;
+    }
+#ifdef DEBUG_CACHE
+    qDebug() << "Cancelled render jobs:" << removed << master;
+#endif
+    return removed;
+}
+
+void RenderPool::removeRenderer(BasicRenderer const* master)
+{
+    QMutexLocker locker(&mutex);
+    removeQueued(master);
+    bool busy = true;
+    while (busy) {
+        busy = false;
+        for (auto const& job : running) {
+            if (job.master == master || job.partner == master) {
+                busy = true;
+                break;
+            }
+        }
+        if (busy && !jobDone.wait(&mutex, 10000)) {
+            qWarning() << "Render job not finished after 10000 ms" << master;
+            break;
+        }
+    }
+}
+
+bool RenderPool::waitForDone(unsigned long const time)
+{
+    QMutexLocker locker(&mutex);
+    QElapsedTimer timer;
+    timer.start();
+    while (!running.isEmpty()) {
+        qint64 const remaining = qint64(time) - timer.elapsed();
+        if (remaining <= 0 || !jobDone.wait(&mutex, static_cast<unsigned long>(remaining)))
+            return running.isEmpty();
+    }
+    return true;
+}
+
+bool RenderPool::hasJobs(BasicRenderer const* master) const
+{
+    QMutexLocker locker(&mutex);
+    for (auto const& job : queue) {
+        if (job.master == master || job.partner == master)
+            return true;
+    }
+    for (auto const& job : running) {
+        if (job.master == master || job.partner == master)
+            return true;
+    }
+    return false;
+}
+
+bool RenderPool::hasJob(BasicRenderer const* master, int const page) const
+{
+    QMutexLocker locker(&mutex);
+    for (auto const& job : queue) {
+        if ((job.master == master || job.partner == master) && job.page == page && job.data.isEmpty())
+            return true;
+    }
+    for (auto const& job : running) {
+        if ((job.master == master || job.partner == master) && job.page == page && job.data.isEmpty() && isCurrent(job, master))
+            return true;
+    }
+    return false;
+}
+
+bool RenderPool::isCurrent(Job const& job, BasicRenderer const* renderer)
+{
+    if (job.master == renderer)
+        return job.generation == renderer->getGeneration();
+    return job.partner == renderer && job.partnerGeneration == renderer->getGeneration();
+}
+
+void RenderPool::renewGeneration(BasicRenderer const* renderer)
+{
+    QMutexLocker locker(&mutex);
+    for (auto& job : queue) {
+        if (job.master == renderer)
+            job.generation = renderer->getGeneration();
+        if (job.partner == renderer)
+            job.partnerGeneration = renderer->getGeneration();
+    }
+}
+
+bool RenderPool::takeJob(Job& job)
+{
+    QMutexLocker locker(&mutex);
+    while (true) {
+        if (stopping)
+            return false;
+        if (workers.size() > maxThreads) {
+            // Too many threads: this worker should exit.
+            CacheThread* thread = static_cast<CacheThread*>(QThread::currentThread());
+            workers.removeOne(thread);
+            idleWorkers--;
+            // The thread object lives in the main thread and is deleted there.
+            connect(thread, &QThread::finished, thread, &QObject::deleteLater);
+            return false;
+        }
+        if (!queue.isEmpty())
+            break;
+        jobAvailable.wait(&mutex);
+    }
+    idleWorkers--;
+    job = queue.takeFirst();
+    running.append(job);
+    return true;
+}
+
+void RenderPool::finishJob(Job const& job, QByteArray const& bytes, QByteArray const& partnerBytes)
+{
+    QMutexLocker locker(&mutex);
+    // Deliver the result while the job is still registered as running.
+    // Like this removeRenderer cannot return before the result has been posted,
+    // and Qt discards the posted call if the renderer gets deleted afterwards.
+    QMetaObject::invokeMethod(job.master, "deliverBytes", Qt::QueuedConnection, Q_ARG(int, job.page), Q_ARG(QByteArray, bytes), Q_ARG(quint32, job.generation));
+    if (job.partner != nullptr && !partnerBytes.isEmpty())
+        QMetaObject::invokeMethod(job.partner, "receivePartnerBytes", Qt::QueuedConnection, Q_ARG(int, job.page), Q_ARG(QByteArray, partnerBytes), Q_ARG(quint32, job.partnerGeneration));
+    removeRunning(job);
+}
+
+void RenderPool::finishDecodeJob(Job const& job, QImage const& image)
+{
+    QMutexLocker locker(&mutex);
+    // The encoded data is sent back with the image. Like this the renderer can check
+    // whether the decoded data is still up to date.
+    QMetaObject::invokeMethod(job.master, "receiveImage", Qt::QueuedConnection, Q_ARG(int, job.page), Q_ARG(QByteArray, job.data), Q_ARG(QImage, image), Q_ARG(quint32, job.generation));
+    removeRunning(job);
+}
+
+void RenderPool::removeRunning(Job const& job)
+{
+    for (QList<Job>::iterator it=running.begin(); it!=running.end(); it++) {
+        if (it->master == job.master && it->page == job.page && it->data.isEmpty() == job.data.isEmpty()) {
+            running.erase(it);
+            break;
+        }
+    }
+    idleWorkers++;
+    jobDone.wakeAll();
+}
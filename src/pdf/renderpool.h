@@ -0,0 +1,162 @@
+/*
+ * This file is part of BeamerPresenter.
+ * Copyright (C) 2020  stiglers-eponym
+
+ * BeamerPresenter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * BeamerPresenter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with BeamerPresenter. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef RENDERPOOL_H
+#define RENDERPOOL_H
+
+#include <QObject>
+#include <QList>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QByteArray>
+#include <QImage>
+#include "../enumerates.h"
+
+class BasicRenderer;
+class CacheThread;
+
+/// Bounded pool of CacheThreads shared by all BasicRenderers (CacheMaps, TileRenderers and ThumbnailRenderers).
+/// Renderers submit jobs (renderer, page, priority) to the pool. Up to threadCount() jobs are rendered
+/// in parallel, jobs with higher priority first. The result of each job is handed back to the renderer
+/// which submitted it by calling its slot deliverBytes(int, QByteArray, quint32) in the renderer's thread.
+/// Each job carries the generation of its renderer. Results of jobs, which were running when the
+/// renderer started a new generation (e.g. after changing the resolution), are discarded by the renderer.
+/// Besides rendering, the pool can decode cached pages ahead of time (decode jobs). The decoded image
+/// is handed back by calling the slot receiveImage(int, QByteArray, QImage, quint32) of the renderer.
+/// Queued jobs can be cancelled or change their priority. Running jobs are always finished.
+class RenderPool : public QObject
+{
+    Q_OBJECT
+
+public:
+    /// A single page which should be rendered by a renderer.
+    struct Job {
+        /// Renderer which submitted this job and which will receive the result.
+        BasicRenderer* master;
+        /// Page number.
+        int page;
+        /// Jobs with smaller priority values are rendered first.
+        RenderPriority priority;
+        /// Encoded page, which should be decoded. Empty for render jobs.
+        QByteArray data;
+        /// Renderer showing the other half of the page (only for pages split in two halves).
+        /// The other half is sent to its slot receivePartnerBytes(int, QByteArray, quint32).
+        /// nullptr if only master needs this page.
+        BasicRenderer* partner;
+        /// Generation of master when the job was started or submitted.
+        quint32 generation;
+        /// Generation of partner when the job was started or submitted.
+        quint32 partnerGeneration;
+    };
+
+    /// Get the pool shared by all renderers. The pool is created on the first call.
+    static RenderPool* instance();
+    /// Destructor: stop and delete all worker threads.
+    ~RenderPool();
+
+    /// Set the maximum number of worker threads. Values < 1 are replaced by QThread::idealThreadCount().
+    void setThreadCount(int const number);
+    /// Maximum number of worker threads.
+    int threadCount() const {return maxThreads;}
+
+    /// Add a job to the queue. Return false if the same job is already queued or running.
+    /// If the same job is queued with a lower priority, its priority is raised.
+    /// If partner is given, the full page is rendered once and the other half is sent to partner.
+    /// A job rendering the page for master as partner counts as the same job.
+    bool submit(BasicRenderer* master, int const page, RenderPriority const priority = LookAheadPriority, BasicRenderer* partner = nullptr);
+    /// Add a job decoding data, which has been rendered to cache before, to the queue.
+    /// The decoded image is sent to the slot receiveImage(int, QByteArray, QImage, quint32) of master.
+    /// Return false if a decode job for this page is already queued or running.
+    bool submitDecode(BasicRenderer* master, int const page, QByteArray const& data, RenderPriority const priority = NextPriority);
+    /// Let a queued or running render job of master for this page also render the other half for partner.
+    /// The priority of a queued job is raised to priority if necessary.
+    /// Returns true if partner will receive its half of the page.
+    bool attachPartner(BasicRenderer const* master, int const page, BasicRenderer* partner, RenderPriority const priority);
+    /// Change the priority of a queued render job. Does nothing if the job is not queued.
+    void setPriority(BasicRenderer const* master, int const page, RenderPriority const priority);
+    /// Remove all queued jobs of this renderer. Running jobs are finished.
+    /// Queued jobs, in which this renderer is the partner, do not send the other half anymore.
+    void cancel(BasicRenderer const* master);
+    /// Remove all queued render jobs of this renderer with priority >= minPriority. Decode jobs and running jobs are kept.
+    /// Returns the number of removed jobs.
+    int cancel(BasicRenderer const* master, RenderPriority const minPriority);
+    /// Update the generation of all queued jobs of this renderer (as master or partner) after it has started
+    /// a new generation. Queued jobs are rendered with the new settings, thus their results are still valid.
+    void renewGeneration(BasicRenderer const* renderer);
+    /// Remove all queued jobs of this renderer and wait until no job of this renderer
+    /// (as master or as partner) is running.
+    /// This must be called before the renderer is deleted.
+    void removeRenderer(BasicRenderer const* master);
+    /// Wait up to <time> ms until no more jobs are running. Return true if all jobs finished.
+    bool waitForDone(unsigned long const time);
+    /// Check whether a job of this renderer (as master or partner) is queued or running.
+    bool hasJobs(BasicRenderer const* master) const;
+    /// Check whether a render job for this page and renderer (as master or partner) of the current generation is queued or running.
+    bool hasJob(BasicRenderer const* master, int const page) const;
+
+    /// Get the next job for a worker thread. This blocks until a job is available.
+    /// Returns false if the worker thread should exit.
+    /// Should only be called from CacheThread::run.
+    bool takeJob(Job& job);
+    /// Hand the result of a job back to its renderer (and partner) and mark the job as done.
+    /// Should only be called from CacheThread::run.
+    void finishJob(Job const& job, QByteArray const& bytes, QByteArray const& partnerBytes = QByteArray());
+    /// Hand the result of a decode job back to its renderer and mark the job as done.
+    /// Should only be called from CacheThread::run.
+    void finishDecodeJob(Job const& job, QImage const& image);
+
+private:
+    /// Constructor: only used by instance().
+    explicit RenderPool(QObject* parent = nullptr);
+    /// Start new worker threads if jobs are waiting and the maximum number of threads is not reached.
+    /// mutex must be locked when calling this.
+    void startWorkers();
+    /// Remove all queued jobs of master and the reference to master as partner in queued jobs.
+    /// mutex must be locked when calling this.
+    void removeQueued(BasicRenderer const* master);
+    /// Insert job in queue behind all jobs with the same or higher priority.
+    /// mutex must be locked when calling this.
+    void enqueue(Job const& job);
+    /// Does job deliver a result of the current generation of renderer (as master or partner)?
+    /// mutex must be locked when calling this.
+    static bool isCurrent(Job const& job, BasicRenderer const* renderer);
+    /// Mark job as done and notify waiting threads.
+    /// mutex must be locked when calling this.
+    void removeRunning(Job const& job);
+
+    /// Protects all following members.
+    mutable QMutex mutex;
+    /// Notifies worker threads about new jobs.
+    QWaitCondition jobAvailable;
+    /// Notifies waiting functions that a job has finished.
+    QWaitCondition jobDone;
+    /// Jobs which have not been started yet, sorted by priority.
+    QList<Job> queue;
+    /// Jobs which are currently rendered.
+    QList<Job> running;
+    /// Worker threads.
+    QList<CacheThread*> workers;
+    /// Number of worker threads, which are currently waiting for a job.
+    int idleWorkers = 0;
+    /// Maximum number of worker threads.
+    int maxThreads;
+    /// Set to true when the pool is deleted.
+    bool stopping = false;
+};
+
+#endif // RENDERPOOL_H
@@ -0,0 +1,83 @@
+/*
+ * This file is part of BeamerPresenter.
+ * Copyright (C) 2020  stiglers-eponym
+
+ * BeamerPresenter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * BeamerPresenter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with BeamerPresenter. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <cstring>
+#include <QJsonArray>
+#include "renderstats.h"
+
+/// Names of the operations used in the JSON output.
+static char const* const operationNames[] = {"render", "encode", "decode", "getPixmap", "diskLoad"};
+
+RenderStats* RenderStats::instance()
+{
+    static RenderStats stats;
+    return &stats;
+}
+
+void RenderStats::record(Operation const operation, qint64 const nsecs)
+{
+    if (operation < 0 || operation >= NumberOfOperations)
+        return;
+    // Find the bin: durations below 2 microseconds go to bin 0.
+    int bin = 0;
+    for (qint64 usecs = nsecs/2000; usecs > 0 && bin < numberOfBins - 1; usecs >>= 1)
+        bin++;
+    QMutexLocker locker(&mutex);
+    Histogram& histogram = histograms[operation];
+    histogram.count++;
+    histogram.total += nsecs;
+    if (nsecs > histogram.maximum)
+        histogram.maximum = nsecs;
+    histogram.bins[bin]++;
+}
+
+void RenderStats::clear()
+{
+    QMutexLocker locker(&mutex);
+    memset(histograms, 0, sizeof(histograms));
+}
+
+QJsonObject const RenderStats::toJson() const
+{
+    QJsonObject object;
+    QMutexLocker locker(&mutex);
+    for (int operation=0; operation<NumberOfOperations; operation++) {
+        Histogram const& histogram = histograms[operation];
+        QJsonObject entry;
+        entry.insert("count", double(histogram.count));
+        entry.insert("total_ms", histogram.total/1e6);
+        entry.insert("mean_ms", histogram.count > 0 ? histogram.total/1e6/histogram.count : 0.);
+        entry.insert("max_ms", histogram.maximum/1e6);
+        // Only non-empty bins are written. "below_us" is the upper limit of the bin in microseconds.
+        QJsonArray bins;
+        for (int bin=0; bin<numberOfBins; bin++) {
+            if (histogram.bins[bin] == 0)
+                continue;
+            QJsonObject binObject;
+            if (bin < numberOfBins - 1)
+                binObject.insert("below_us", double(qint64(2) << bin));
+            else
+                binObject.insert("below_us", "inf");
+            binObject.insert("count", double(histogram.bins[bin]));
+            bins.append(binObject);
+        }
+        entry.insert("histogram", bins);
+        object.insert(operationNames[operation], entry);
+    }
+    return object;
+}
@@ -0,0 +1,82 @@
+/*
+ * This file is part of BeamerPresenter.
+ * Copyright (C) 2020  stiglers-eponym
+
+ * BeamerPresenter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * BeamerPresenter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with BeamerPresenter. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef RENDERSTATS_H
+#define RENDERSTATS_H
+
+#include <QMutex>
+#include <QElapsedTimer>
+#include <QJsonObject>
+
+/// Statistics about rendering and cache performance.
+/// Durations of rendering, encoding and decoding are collected in histograms with logarithmic bins.
+/// The statistics are shared by all threads and can be written to a JSON object for tuning
+/// the cache settings on a specific machine.
+class RenderStats
+{
+public:
+    /// Operations of which the duration is measured.
+    enum Operation {
+        /// Rendering a page with poppler or an external renderer.
+        Render = 0,
+        /// Encoding a rendered image for storing it in cache.
+        Encode,
+        /// Decoding a cached page.
+        Decode,
+        /// Total time needed by CacheMap::getPixmap, including rendering if the page was not cached.
+        GetPixmap,
+        /// Loading a page from the DiskCache.
+        DiskLoad,
+        /// Number of operations (not an operation).
+        NumberOfOperations,
+    };
+
+    /// Get the statistics shared by all threads.
+    static RenderStats* instance();
+
+    /// Add a measured duration in nanoseconds. This is thread safe.
+    void record(Operation const operation, qint64 const nsecs);
+    /// Add the time elapsed since timer was started. This is thread safe.
+    void record(Operation const operation, QElapsedTimer const& timer) {record(operation, timer.nsecsElapsed());}
+    /// Reset all histograms.
+    void clear();
+    /// Write all histograms to a JSON object.
+    QJsonObject const toJson() const;
+
+private:
+    /// Constructor: only used by instance().
+    RenderStats() {clear();}
+    /// Number of bins in each histogram.
+    /// Bin 0 contains durations below 2 microseconds, bin i durations between 2^i and 2^(i+1) microseconds
+    /// and the last bin all longer durations.
+    static int const numberOfBins = 24;
+    /// Histogram of durations of one operation.
+    struct Histogram {
+        quint64 count;
+        /// Sum of all durations in nanoseconds.
+        qint64 total;
+        /// Maximum duration in nanoseconds.
+        qint64 maximum;
+        quint64 bins[numberOfBins];
+    };
+    Histogram histograms[NumberOfOperations];
+    /// Protects histograms.
+    mutable QMutex mutex;
+};
+
+#endif // RENDERSTATS_H
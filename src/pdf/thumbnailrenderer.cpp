@@ -0,0 +1,128 @@
+/*
+ * This file is part of BeamerPresenter.
+ * Copyright (C) 2020  stiglers-eponym
+
+ * BeamerPresenter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * BeamerPresenter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with BeamerPresenter. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "thumbnailrenderer.h"
+#include "renderstats.h"
+
+ThumbnailRenderer::ThumbnailRenderer(PdfDoc const* doc, PagePart const part, QObject* parent) :
+    BasicRenderer(doc, part, parent)
+{
+    // Raw images are decoded without copying the data.
+    encoding = RawEncoding;
+}
+
+ThumbnailRenderer::~ThumbnailRenderer()
+{
+    RenderPool::instance()->removeRenderer(this);
+}
+
+void ThumbnailRenderer::setWidth(double const newWidth)
+{
+    if (newWidth == width)
+        return;
+    // Running jobs read the width. Wait for them before changing it.
+    RenderPool::instance()->removeRenderer(this);
+    width = newWidth;
+    // Thumbnails, which have been rendered but not received yet, have the old width.
+    newGeneration();
+}
+
+void ThumbnailRenderer::cancel()
+{
+    RenderPool::instance()->cancel(this);
+    // Thumbnails, which have been rendered but not received yet, might show outdated pages.
+    newGeneration();
+    QMutexLocker locker(&sourcesMutex);
+    sources.clear();
+}
+
+void ThumbnailRenderer::setSource(int const page, QByteArray const& bytes)
+{
+    QMutexLocker locker(&sourcesMutex);
+    sources[page] = bytes;
+}
+
+QImage const ThumbnailRenderer::downscaleImage(QImage const& image, QSize const& size)
+{
+    if (image.isNull() || size.isEmpty())
+        return QImage();
+    QImage result = image.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+    while (result.width() >= 2*size.width() && result.height() >= 2*size.height()) {
+        // Average 2x2 pixels. Two channels are averaged together in one 32 bit operation.
+        QImage half(result.width()/2, result.height()/2, QImage::Format_ARGB32_Premultiplied);
+        for (int y=0; y<half.height(); y++) {
+            quint32 const* const line0 = reinterpret_cast<quint32 const*>(result.constScanLine(2*y));
+            quint32 const* const line1 = reinterpret_cast<quint32 const*>(result.constScanLine(2*y+1));
+            quint32* const target = reinterpret_cast<quint32*>(half.scanLine(y));
+            for (int x=0; x<half.width(); x++) {
+                quint32 const a = line0[2*x], b = line0[2*x+1], c = line1[2*x], d = line1[2*x+1];
+                quint32 const rb = (((a & 0x00ff00ffu) + (b & 0x00ff00ffu) + (c & 0x00ff00ffu) + (d & 0x00ff00ffu)) >> 2) & 0x00ff00ffu;
+                quint32 const ag = ((((a >> 8) & 0x00ff00ffu) + ((b >> 8) & 0x00ff00ffu) + ((c >> 8) & 0x00ff00ffu) + ((d >> 8) & 0x00ff00ffu)) << 6) & 0xff00ff00u;
+                target[x] = rb | ag;
+            }
+        }
+        result = half;
+    }
+    if (result.size() == size)
+        return result;
+    return result.scaled(size, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+}
+
+QSize ThumbnailRenderer::thumbnailSize(int const page) const
+{
+    QSizeF const size = pdf->getPageSize(page);
+    qreal const pageWidth = pagePart == FullPage ? size.width() : size.width()/2;
+    if (pageWidth <= 0.)
+        return QSize();
+    return QSize(int(width + 0.5), int(width*size.height()/pageWidth + 0.5));
+}
+
+QImage const ThumbnailRenderer::renderImage(int const page) const
+{
+    QSizeF const size = pdf->getPageSize(page);
+    if (width <= 0. || size.width() <= 0.)
+        return QImage();
+    // Downscale an existing render if possible. This is much faster than rendering the page.
+    QByteArray source;
+    {
+        QMutexLocker locker(&sourcesMutex);
+        source = sources.take(page);
+    }
+    if (!source.isEmpty()) {
+        QImage const image = decodeImage(source);
+        QSize const target = thumbnailSize(page);
+        // Small renders would be blurry when scaled up.
+        if (image.width() >= target.width() && image.height() >= target.height())
+            return downscaleImage(image, target);
+    }
+    // Resolution in dpi. For half pages, the full page is rendered at twice the resolution.
+    double const resolution = pagePart == FullPage ? 72*width/size.width() : 144*width/size.width();
+    Poppler::Page const* pdfPage = pdf->getPage(page);
+    QElapsedTimer timer;
+    timer.start();
+    QImage const image = pdfPage->renderToImage(resolution, resolution);
+    RenderStats::instance()->record(RenderStats::Render, timer);
+    return cropImage(image, pagePart);
+}
+
+void ThumbnailRenderer::receiveBytes(int const page, QByteArray const bytes)
+{
+    if (bytes.isEmpty())
+        return;
+    emit thumbnailReady(page, decodePixmap(bytes));
+}
@@ -0,0 +1,79 @@
+/*
+ * This file is part of BeamerPresenter.
+ * Copyright (C) 2020  stiglers-eponym
+
+ * BeamerPresenter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * BeamerPresenter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with BeamerPresenter. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef THUMBNAILRENDERER_H
+#define THUMBNAILRENDERER_H
+
+#include <QPixmap>
+#include <QMap>
+#include <QMutex>
+#include "basicrenderer.h"
+
+/// Renderer for thumbnails of pages in the RenderPool, used by the overview.
+/// All thumbnails have the same width. The resolution is adapted to the size of each page.
+/// Thumbnails are not stored in this object, but handed to the receiver of thumbnailReady.
+/// If a full-size render of a page is available (e.g. from a CacheMap), the thumbnail is
+/// downscaled from it instead of rendering the page again.
+class ThumbnailRenderer : public BasicRenderer
+{
+    Q_OBJECT
+
+public:
+    /// Constructor
+    explicit ThumbnailRenderer(PdfDoc const* doc, PagePart const part = FullPage, QObject* parent = nullptr);
+    /// Destructor
+    ~ThumbnailRenderer() override;
+
+    /// Width of the thumbnails in pixels.
+    double getWidth() const {return width;}
+    /// Change the width of the thumbnails. This drops all queued jobs and running jobs' results if the width actually changes.
+    void setWidth(double const newWidth);
+    /// Size of the thumbnail of page in pixels.
+    QSize thumbnailSize(int const page) const;
+    /// Render the thumbnail of page. Called from the RenderPool.
+    QImage const renderImage(int const page) const override;
+    /// Thumbnails are not stored in the disk cache.
+    bool diskCacheable() const override {return false;}
+    /// Render the thumbnail of page in the RenderPool. If it is already queued, only its priority is raised.
+    void request(int const page, RenderPriority const priority) {RenderPool::instance()->submit(this, page, priority);}
+    /// Drop all queued jobs and sources. Running jobs are finished, but their results are discarded.
+    void cancel();
+    /// Set an encoded render of page (in any format supported by decodeImage), from which the thumbnail is downscaled.
+    void setSource(int const page, QByteArray const& bytes);
+    /// Downscale image to size using a box filter: the image is halved by averaging 2x2 pixels until
+    /// it is less than twice as large as size. Only the last step uses smooth scaling.
+    static QImage const downscaleImage(QImage const& image, QSize const& size);
+
+public slots:
+    /// Get a rendered thumbnail from the RenderPool. Called when a render job finishes.
+    void receiveBytes(int const page, QByteArray const bytes) override;
+
+private:
+    /// Width of the thumbnails in pixels.
+    double width = -1.;
+    /// Encoded full-size renders of pages, from which thumbnails are downscaled. Each source is used once.
+    mutable QMap<int, QByteArray> sources;
+    /// Protects sources. These are accessed from the RenderPool.
+    mutable QMutex sourcesMutex;
+
+signals:
+    /// Notify that the thumbnail of page has been rendered.
+    void thumbnailReady(int const page, QPixmap const pixmap);
+};
+
+#endif // THUMBNAILRENDERER_H
@@ -0,0 +1,142 @@
+/*
+ * This file is part of BeamerPresenter.
+ * Copyright (C) 2020  stiglers-eponym
+
+ * BeamerPresenter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * BeamerPresenter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with BeamerPresenter. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <cmath>
+#include "tilerenderer.h"
+#include "renderstats.h"
+
+TileRenderer::TileRenderer(PdfDoc const* doc, PagePart const part, QObject* parent) :
+    BasicRenderer(doc, part, parent)
+{
+    // Raw images are decoded without copying the data.
+    encoding = RawEncoding;
+}
+
+TileRenderer::~TileRenderer()
+{
+    RenderPool::instance()->removeRenderer(this);
+}
+
+void TileRenderer::setPage(int const newPage)
+{
+    if (newPage == page)
+        return;
+    // Running jobs read the page number. Wait for them before changing it.
+    RenderPool::instance()->removeRenderer(this);
+    page = newPage;
+    clearTiles();
+}
+
+void TileRenderer::changeResolution(double const res)
+{
+    if (std::abs(res - resolution) < 1e-6)
+        return;
+    RenderPool::instance()->removeRenderer(this);
+    resolution = res;
+    clearTiles();
+}
+
+void TileRenderer::clearTiles()
+{
+    tiles.clear();
+    usage.clear();
+    // Tiles, which have been rendered but not received yet, show an outdated page or resolution.
+    newGeneration();
+}
+
+QSize TileRenderer::pageSize() const
+{
+    QSizeF const size = pdf->getPageSize(page);
+    if (pagePart == FullPage)
+        return QSize(int(resolution*size.width()+0.5), int(resolution*size.height()+0.5));
+    return QSize(int(resolution*size.width()/2+0.5), int(resolution*size.height()+0.5));
+}
+
+QImage const TileRenderer::renderImage(int const key) const
+{
+    int const column = key & 0x7fff, row = key >> 15;
+    QSize const size = pageSize();
+    int x = column*tileSize;
+    int const y = row*tileSize;
+    int const width = qMin(tileSize, size.width() - x), height = qMin(tileSize, size.height() - y);
+    if (width <= 0 || height <= 0)
+        return QImage();
+    if (pagePart == RightHalf)
+        x += size.width();
+    Poppler::Page const* pdfPage = pdf->getPage(page);
+    QElapsedTimer timer;
+    timer.start();
+    QImage const image = pdfPage->renderToImage(72*resolution, 72*resolution, x, y, width, height);
+    RenderStats::instance()->record(RenderStats::Render, timer);
+    return image;
+}
+
+void TileRenderer::receiveBytes(int const key, QByteArray const bytes)
+{
+    if (bytes.isEmpty())
+        return;
+    if (!tiles.contains(key)) {
+        usage.append(key);
+        while (usage.length() > maxTiles)
+            tiles.remove(usage.takeFirst());
+    }
+    tiles[key] = decodePixmap(bytes);
+    emit cacheThreadFinished();
+}
+
+QPixmap const TileRenderer::getTile(int const column, int const row)
+{
+    int const key = tileKey(column, row);
+    QMap<int, QPixmap>::const_iterator const it = tiles.constFind(key);
+    if (it == tiles.cend())
+        return QPixmap();
+    // Mark the tile as recently used.
+    usage.removeOne(key);
+    usage.append(key);
+    return *it;
+}
+
+void TileRenderer::submitArea(QRect const& area, RenderPriority const priority)
+{
+    QRect const bounded = area & QRect(QPoint(0,0), pageSize());
+    if (bounded.isEmpty())
+        return;
+    for (int row=bounded.top()/tileSize; row<=bounded.bottom()/tileSize; row++) {
+        for (int column=bounded.left()/tileSize; column<=bounded.right()/tileSize; column++) {
+            int const key = tileKey(column, row);
+            if (!tiles.contains(key))
+                RenderPool::instance()->submit(this, key, priority);
+        }
+    }
+}
+
+void TileRenderer::request(QRect const& area, QPointF const& motion)
+{
+    if (page < 0 || resolution <= 0.)
+        return;
+    // If the area has moved: drop queued tiles, which were requested for older positions. Running jobs are finished.
+    if (!motion.isNull())
+        RenderPool::instance()->cancel(this);
+    submitArea(area, VisiblePriority);
+    // Prefetch the area, which will be visible if the motion continues for a few steps.
+    qreal const length = std::sqrt(QPointF::dotProduct(motion, motion));
+    if (length > 1.) {
+        QPointF const step = qMin(qreal(tileSize), 4*length)/length * motion;
+        submitArea(area.translated(step.toPoint()), LookAheadPriority);
+    }
+}
@@ -0,0 +1,84 @@
+/*
+ * This file is part of BeamerPresenter.
+ * Copyright (C) 2020  stiglers-eponym
+
+ * BeamerPresenter is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * BeamerPresenter is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with BeamerPresenter. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef TILERENDERER_H
+#define TILERENDERER_H
+
+#include <QMap>
+#include <QPixmap>
+#include "basicrenderer.h"
+
+/// Renderer for small square tiles of a page at high resolution in the RenderPool.
+/// This is used by the magnifier: only the tiles around the magnifier are rendered, and only a
+/// limited number of tiles is kept. The memory and time needed are thus independent of the magnification.
+/// Tiles are identified by their column and row. In render jobs the page number is replaced by a tile key.
+class TileRenderer : public BasicRenderer
+{
+    Q_OBJECT
+
+public:
+    /// Side length of tiles in pixels.
+    static int const tileSize = 256;
+    /// Maximum number of tiles kept in memory. The least recently used tiles are dropped first.
+    static int const maxTiles = 64;
+
+    /// Constructor
+    explicit TileRenderer(PdfDoc const* doc, PagePart const part = FullPage, QObject* parent = nullptr);
+    /// Destructor
+    ~TileRenderer() override;
+
+    /// Page from which tiles are rendered.
+    int getPage() const {return page;}
+    /// Change the page. This clears all tiles if the page actually changes.
+    void setPage(int const newPage);
+    /// Change resolution. This clears all tiles if the resolution actually changes.
+    void changeResolution(double const res) override;
+    /// Render the tile with given key. Called from the RenderPool.
+    QImage const renderImage(int const key) const override;
+    /// Tiles are not stored in the disk cache.
+    bool diskCacheable() const override {return false;}
+
+    /// Get a rendered tile or an empty pixmap if the tile is not available.
+    QPixmap const getTile(int const column, int const row);
+    /// Request all tiles overlapping with area (in pixels in the coordinates of the rendered page).
+    /// motion is the shift of area since the last request. Tiles in the direction of motion are rendered
+    /// ahead of time with lower priority. If motion is nonzero, older queued requests are dropped.
+    void request(QRect const& area, QPointF const& motion);
+    /// Delete all tiles. Tiles, which are rendered at the moment, are discarded when they are ready.
+    void clearTiles();
+
+public slots:
+    /// Get a rendered tile from the RenderPool. Called when a render job finishes.
+    void receiveBytes(int const key, QByteArray const bytes) override;
+
+private:
+    /// Combine column and row to a key, which is used instead of the page number in the RenderPool.
+    static int tileKey(int const column, int const row) {return (row << 15) | column;}
+    /// Size of the (part of the) page in pixels at the current resolution.
+    QSize pageSize() const;
+    /// Submit the tiles overlapping with area, which are not available yet.
+    void submitArea(QRect const& area, RenderPriority const priority);
+    /// Rendered tiles.
+    QMap<int, QPixmap> tiles;
+    /// Keys of the tiles, least recently used first.
+    QList<int> usage;
+    /// Page number.
+    int page = -1;
+};
+
+#endif // TILERENDERER_H
@@ -16,9 +16,13 @@
  * along with BeamerPresenter. If not, see <https://www.gnu.org/licenses/>.
  */
 #include <cmath>
+#include <iostream>
+#include <QFile>
+#include <QJsonDocument>
 
 #include "controlscreen.h"
 #include "../names.h"
+#include "../pdf/renderstats.h"
 
 #ifdef DISABLE_TOOL_TIP
 #else
@@ -96,9 +100,6 @@ ControlScreen::ControlScreen(QString presentationPath, QString notesPath, PagePa
     // Some numbers for cache management.
     // Maximum number of cached pages is by default the total number of pages.
     maxCacheNumber = numberOfPages;
-    // last_delete points to the last page which has not been deleted yet.
-    // No pages have been deleted from cache yet.
-    last_delete = numberOfPages - 1;
 
     // Set up presentation screen.
     // The presentation screen is shown immediately.
@@ -132,6 +133,11 @@ ControlScreen::ControlScreen(QString presentationPath, QString notesPath, PagePa
     else
         setWindowTitle("BeamerPresenter: " + notesPath);
 
+    // After reloading a document, unchanged pages are remapped when its fingerprints are ready.
+    connect(presentation->getFingerprintThread(), &QThread::finished, this, &ControlScreen::pageMappingReady);
+    if (notes != presentation)
+        connect(notes->getFingerprintThread(), &QThread::finished, this, &ControlScreen::pageMappingReady);
+
     // Set up the slide widgets.
     if (notesPath.isEmpty() && pagePart == FullPage) {
         // No notes are given.
@@ -147,10 +153,10 @@ ControlScreen::ControlScreen(QString presentationPath, QString notesPath, PagePa
 
         // Connect drawSlide to other widgets.
         // Copy paths from draw slide to presentation slide and vice versa when drawing on one of the slides.
-        // Copy paths after moving the mouse while drawing. This assumes that only the last path is changed or a new path is created.
-        connect(drawSlide->getPathOverlay(), &PathOverlay::pathsChangedQuick, presentationScreen->slide->getPathOverlay(), &PathOverlay::setPathsQuick);
-        connect(presentationScreen->slide->getPathOverlay(), &PathOverlay::pathsChangedQuick, drawSlide->getPathOverlay(), &PathOverlay::setPathsQuick);
-        // Copy all paths. This completely updates all paths after using the erasor.
+        // Send changes of the paths (new strokes, new nodes, erased and undone strokes) as operations, which are applied incrementally.
+        connect(drawSlide->getPathOverlay(), &PathOverlay::pathOperations, presentationScreen->slide->getPathOverlay(), &PathOverlay::applyOperations);
+        connect(presentationScreen->slide->getPathOverlay(), &PathOverlay::pathOperations, drawSlide->getPathOverlay(), &PathOverlay::applyOperations);
+        // Copy all paths. This completely updates all paths after loading drawings from a file.
         connect(drawSlide->getPathOverlay(), &PathOverlay::pathsChanged, presentationScreen->slide->getPathOverlay(), &PathOverlay::setPaths);
         connect(presentationScreen->slide->getPathOverlay(), &PathOverlay::pathsChanged, drawSlide->getPathOverlay(), &PathOverlay::setPaths);
         // Send pointer position (when using a pointer, torch or magnifier tool).
@@ -670,6 +676,33 @@ void ControlScreen::updateCache()
 
     // Stop running cache updates
     cacheTimer->stop();
+    // Decode the neighbours of the currently shown slides ahead of time.
+    // Like this changing to the next or previous slide does not need to wait for decoding.
+    presentationScreen->slide->getCacheMap()->predecode(presentationScreen->pageIndex);
+    ui->notes_widget->getCacheMap()->predecode(currentPageNumber);
+    if (drawSlideCache != nullptr && drawSlide != nullptr && drawSlide->isVisible())
+        drawSlideCache->predecode(currentPageNumber);
+    // Remember that the currently shown pages have been used.
+    lastAccess[currentPageNumber] = ++accessCounter;
+    if (presentationScreen->getPageNumber() != currentPageNumber)
+        lastAccess[presentationScreen->getPageNumber()] = ++accessCounter;
+
+    // Detect navigation direction.
+    if (currentPageNumber != lastCachedPageNumber) {
+        if (std::abs(currentPageNumber - lastCachedPageNumber) > 1) {
+            // Render jobs for pages around the old page are outdated after a jump.
+            // Drop them before they block the render threads. Only jobs counted in
+            // cacheThreadsRunning are cancelled: jobs of other renderers (tiles, thumbnails) are kept.
+            for (auto const cache : {presentationScreen->slide->getCacheMap(), ui->notes_widget->getCacheMap(), previewCache, previewCacheX, drawSlideCache}) {
+                if (cache != nullptr)
+                    cacheThreadsRunning -= RenderPool::instance()->cancel(cache, LookAheadPriority);
+            }
+            if (cacheThreadsRunning < 0)
+                cacheThreadsRunning = 0;
+        }
+        navigationDirection = currentPageNumber < lastCachedPageNumber ? -1 : 1;
+        lastCachedPageNumber = currentPageNumber;
+    }
     // Number of currently cached slides
     int const cacheNumber = presentationScreen->slide->getCacheMap()->length();
     if (
@@ -696,68 +729,150 @@ void ControlScreen::updateCache()
         // This is approximately -infinity and means that the cache size is unlimited:
         cacheSize = -8589934591L; // -8GiB
 
-    // There should be a simply connected region of cached pages between first_cached and last_cached.
-    if (first_cached > currentPageNumber || last_cached < currentPageNumber) {
-        // We are outside the simply connected cache region.
-        // Reset cache numbers and start a new simply connected region, which is initially empty.
-        first_cached = currentPageNumber;
-        last_cached = currentPageNumber-1;
-        first_delete = 0;
-        last_delete = numberOfPages-1;
+    resetPrefetchOrder();
 #ifdef DEBUG_CACHE
-        qDebug() << "Reset cache region" << first_delete << first_cached << currentPageNumber << last_cached << last_delete;
+    qDebug() << "Update cache around page" << currentPageNumber << "direction" << navigationDirection;
 #endif
-    }
-    else {
-        // TODO: check whether this is necessary.
-        // We are in the simply connected cache region.
-        // Make sure that deleting cached pages starts outside this region.
-        // Cached pages will only be deleted if the memory or the number of cached pages is limited.
-        last_delete = last_delete > currentPageNumber + cacheNumber ? last_delete : currentPageNumber + cacheNumber;
-        last_delete = last_delete >= numberOfPages ? numberOfPages-1 : last_delete;
-        first_delete = first_delete > currentPageNumber - cacheNumber/2 ? currentPageNumber - cacheNumber/2 : first_delete;
-        first_delete = first_delete < 0 ? 0 : first_delete;
-    }
-    if (last_cached < numberOfPages-1 || first_cached > 0)
-        // The simply connected region does not include all pages.
+
+    // The next slide (in navigation direction) is probably needed soon: render it before all other pages.
+    int const nextPage = currentPageNumber + navigationDirection;
+    if (nextPage >= 0 && nextPage < numberOfPages)
+        cachePage(nextPage, NextPriority);
+    if (cacheThreadsRunning < 2*RenderPool::instance()->threadCount())
         // Start the update steps by starting the cacheTimer.
         // cacheTimer will call updateCacheStep().
         cacheTimer->start();
 }
 
+void ControlScreen::resetPrefetchOrder()
+{
+    prefetchOrder.clear();
+    prefetchIndex = 0;
+    if (currentPageNumber >= 0 && currentPageNumber < numberOfPages)
+        prefetchOrder.append(currentPageNumber);
+    // Pages in navigation direction are preferred: for each page against the
+    // navigation direction, three pages in navigation direction are cached.
+    int ahead = 1, behind = 1;
+    while (true) {
+        int const aheadPage = currentPageNumber + navigationDirection*ahead;
+        int const behindPage = currentPageNumber - navigationDirection*behind;
+        bool const aheadValid = aheadPage >= 0 && aheadPage < numberOfPages;
+        bool const behindValid = behindPage >= 0 && behindPage < numberOfPages;
+        if (!aheadValid && !behindValid)
+            break;
+        if (aheadValid && (!behindValid || ahead <= 3*behind)) {
+            prefetchOrder.append(aheadPage);
+            ahead++;
+        }
+        else {
+            prefetchOrder.append(behindPage);
+            behind++;
+        }
+    }
+}
+
+int ControlScreen::prefetchRank(int const page) const
+{
+    // Position of page in an ordering like prefetchOrder. Larger numbers mean less important pages.
+    int const distance = navigationDirection*(page - currentPageNumber);
+    return distance >= 0 ? distance : -3*distance;
+}
+
+bool ControlScreen::isPageCached(int const page) const
+{
+    return presentationScreen->slide->getCacheMap()->contains(page)
+            && ui->notes_widget->getCacheMap()->contains(page)
+            && previewCache->contains(page)
+            && (drawSlideCache == nullptr || drawSlideCache->contains(page))
+            && (previewCacheX == nullptr || previewCacheX->contains(page));
+}
+
+int ControlScreen::evictionCandidate(int const protectedRank) const
+{
+    // Collect all pages which are cached in any CacheMap.
+    QSet<int> pages = presentationScreen->slide->getCacheMap()->cachedPages()
+            + ui->notes_widget->getCacheMap()->cachedPages()
+            + previewCache->cachedPages();
+    if (drawSlideCache != nullptr)
+        pages += drawSlideCache->cachedPages();
+    if (previewCacheX != nullptr)
+        pages += previewCacheX->cachedPages();
+    // Least recently used page, which is less important for prefetching than protectedRank.
+    // Pages which have never been shown are treated as least recently used.
+    // Among equally old pages the one which would be cached last is chosen.
+    int candidate = -1;
+    quint64 candidateAccess = 0;
+    int candidateRank = -1;
+    for (auto const page : pages) {
+        int const rank = prefetchRank(page);
+        if (rank <= protectedRank || page == presentationScreen->getPageNumber())
+            continue;
+        quint64 const access = lastAccess.value(page, 0);
+        if (candidate < 0 || access < candidateAccess || (access == candidateAccess && rank > candidateRank)) {
+            candidate = page;
+            candidateAccess = access;
+            candidateRank = rank;
+        }
+    }
+    return candidate;
+}
+
+bool ControlScreen::freeCacheSpace(int const protectedRank)
+{
+    // Estimate the size of the next page by the average size of the cached pages.
+    int cacheNumber = presentationScreen->slide->getCacheMap()->length();
+    qint64 const expectedSize = (cacheNumber > 0 && maxCacheSize > 0) ? cacheSize/cacheNumber : 0;
+    while (cacheSize + expectedSize > maxCacheSize || (maxCacheNumber < numberOfPages && cacheNumber >= maxCacheNumber)) {
+        int const page = evictionCandidate(protectedRank);
+        if (page < 0)
+            return false;
+        freeCachePage(page);
+        cacheNumber = presentationScreen->slide->getCacheMap()->length();
+    }
+    return true;
+}
+
 void ControlScreen::updateCacheStep()
 {
     /*
-    * Select a page for rendering to cache and tell the CacheThreads of CacheMaps to render that page.
+    * Select a page for rendering to cache and tell the CacheMaps to render that page.
     * Delete cached pages if necessary due to limited memory or a limited number of cached slides.
     * This function will notice when no more pages need to be rendered to cache and stop the cacheTimer.
     *
     * Outline of the cache management:
     *
-    * 0. updateCache initializes some variables and starts cacheTimer.
+    * 0. updateCache marks the current pages as used, detects the navigation direction,
+    *    orders all pages by the urgency with which they should be cached (prefetchOrder)
+    *    and starts cacheTimer.
+    *    prefetchOrder contains pages close to the current page in navigation direction first.
+    *    For each page against navigation direction it contains three pages in navigation direction.
     * 1. cacheTimer calls updateCacheStep in a loop whenever the main thread is not busy.
-    * 2. updateCacheStep deletes pages (using freeCachePage) as long as the cache uses
-    *    too much memory (or as long as too many slides are cached).
-    * 3. updateCacheStep checks whether a new pages should be rendered to cache.
-    *    TODO: This process of checking and finding pages should be more understandable.
-    *    - If no more cached pages are needed, it stops cacheTimer.
-    *    - If it finds a page, which should be rendered to cache:
-    *        a. it stops cacheTimer
-    *        b. it hands the page to ControlScreen::cachePage.
+    * 2. updateCacheStep selects the next page in prefetchOrder, which is not cached yet.
+    * 3. If the cache uses too much memory (or too many slides are cached) after adding this page,
+    *    updateCacheStep deletes pages (using freeCachePage) from all CacheMaps.
+    *    Pages which come before the selected page in prefetchOrder are never deleted.
+    *    All other pages are deleted in LRU order: pages which have never been shown come first,
+    *    then pages which have been shown least recently. Like this pages, which have been shown before,
+    *    stay in cache when jumping around in the presentation.
+    *    If no page can be deleted, the cache is full and cacheTimer is stopped.
     * 4. ControlScreen::cachePage calls CacheMap::updateCache for all slide widgets.
-    *    This starts CacheThreads which render the different pages in parallel in own threads.
-    *    For each new thread the counter ControlScreen::cacheThreadsRunning is incremented.
-    * 5. When the rendering is done, CacheMap gets the results from CacheThread and
+    *    This submits render jobs to the shared RenderPool, which renders up to
+    *    RenderPool::threadCount() pages in parallel in own threads.
+    *    Jobs are ordered by priority: pages shown on the screen (requested directly by
+    *    the slide widgets) come first, then the next slide (requested by updateCache),
+    *    then pages in navigation direction and finally pages against navigation direction.
+    *    For each new job the counter ControlScreen::cacheThreadsRunning is incremented.
+    *    cacheTimer is only stopped if enough jobs are waiting to keep all threads busy.
+    * 5. When the rendering is done, CacheMap gets the results from the RenderPool and
     *    ControlScreen::cacheThreadFinished is called.
     * 6. cacheThreadFinished decrements cacheThreadsRunning.
-    *    If cacheThreadsRunning==0, starts cacheTimer again.
+    *    If the RenderPool is running out of jobs, starts cacheTimer again.
     */
 
 #ifdef DEBUG_CACHE
     qDebug() << "Update cache step" << cacheThreadsRunning << cacheSize << maxCacheSize << maxCacheNumber;
 #endif
 
-    // TODO: improve this, make it more deterministic, avoid caching pages which will directly be freed again
     if (
             presentationScreen->slide->getCacheMap()->length() == numberOfPages
             && ui->notes_widget->getCacheMap()->length() == numberOfPages
@@ -770,120 +885,100 @@ void ControlScreen::updateCacheStep()
         cacheTimer->stop();
         return;
     }
-    if (
-            last_cached > last_delete
-            || first_cached < first_delete
-            || first_cached > currentPageNumber
-            || last_cached < currentPageNumber-1
-            ) {
+    // Find the next page, which is not cached yet.
+    while (prefetchIndex < prefetchOrder.length() && isPageCached(prefetchOrder[prefetchIndex]))
+        prefetchIndex++;
+    if (prefetchIndex >= prefetchOrder.length()) {
         cacheTimer->stop();
 #ifdef DEBUG_CACHE
-        qDebug() << "Stopped cache timer" << first_delete << first_cached << currentPageNumber << last_cached << last_delete;
+        qDebug() << "Stopped cache timer: all pages handled." << cacheSize;
 #endif
         return;
     }
-    // Free space if necessary
-    while (cacheSize > maxCacheSize || (maxCacheNumber < numberOfPages && presentationScreen->slide->getCacheMap()->length() > maxCacheNumber) ) {
-        // Start deleting later slides if less than 1/4 of the caches slides are previous slides
-        if (last_delete > 4*currentPageNumber - 3*first_delete) {
-            if (freeCachePage(last_delete))
-                break;
-            last_delete--;
-            last_cached = last_delete > last_cached ? last_cached : last_delete;
-        }
-        else {
-            if (freeCachePage(first_delete))
-                break;
-            first_delete++;
-            first_cached = first_cached > first_delete ? first_cached : first_delete;
-        }
-        if (last_cached > last_delete || first_cached < first_delete) {
-            cacheTimer->stop();
-#ifdef DEBUG_CACHE
-            qDebug() << "Stopped cache timer: need to reset cache region." << first_delete << first_cached << currentPageNumber << last_cached << last_delete;
-#endif
-            return;
-        }
-    }
-    if (last_cached+1 == numberOfPages) {
-        if (
-                first_cached > first_delete
-                && 2*maxCacheSize > 3*cacheSize
-                && (maxCacheNumber == numberOfPages || 2*maxCacheNumber > 3*presentationScreen->slide->getCacheMap()->length())
-                ) {
-            // cache first_cached-1
-            cachePage(--first_cached);
-            return;
-        }
-        else {
-            cacheTimer->stop();
-#ifdef DEBUG_CACHE
-            qDebug() << "Stopped cache timer" << first_delete << first_cached << currentPageNumber << last_cached << last_delete;
-#endif
-            return;
-        }
-    }
-    // Don't continue if it is likely that the next cached page would directly be deleted.
-    else if (
-             // More than 2/3 of available cache space is occupied.
-             2*maxCacheSize < 3*cacheSize
-             // Enough slides (compared to cache size) after current slide are contained in cache.
-             && (last_cached == numberOfPages || 3*(last_cached - currentPageNumber)*cacheSize > 2*presentationScreen->slide->getCacheMap()->length()*maxCacheSize)
-             // The remaining cache space is smaller than twice the average space needed per presentation slide.
-             && (maxCacheSize - cacheSize)*presentationScreen->slide->getCacheMap()->length() < 2*cacheSize
-             ) {
+    int const page = prefetchOrder[prefetchIndex];
+    // Free space if necessary. Pages which should be cached before page are kept.
+    if (!freeCacheSpace(prefetchRank(page))) {
         cacheTimer->stop();
 #ifdef DEBUG_CACHE
-        qDebug() << "Stopped cache timer" << first_delete << first_cached << currentPageNumber << last_cached << last_delete;
+        qDebug() << "Stopped cache timer: cache is full." << page << cacheSize << maxCacheSize;
 #endif
         return;
     }
-    else {
-        // Cache the page last_cached+1
-        cachePage(++last_cached);
-    }
+    prefetchIndex++;
+    cachePage(page, navigationDirection*(page - currentPageNumber) >= 0 ? LookAheadPriority : LookBehindPriority);
 }
 
-bool ControlScreen::freeCachePage(const int page)
+QJsonObject const ControlScreen::statistics() const
 {
-    if (drawSlideCache != nullptr) {
-        cacheSize -= drawSlideCache->clearPage(page);
-        if (cacheSize <= maxCacheSize && (maxCacheNumber >= numberOfPages || presentationScreen->slide->getCacheMap()->length() <= maxCacheNumber))
-            return true;
+    QJsonObject caches;
+    caches.insert("presentation", presentationScreen->slide->getCacheMap()->statistics());
+    caches.insert("notes", ui->notes_widget->getCacheMap()->statistics());
+    caches.insert("preview", previewCache->statistics());
+    if (previewCacheX != nullptr)
+        caches.insert("preview_draw_mode", previewCacheX->statistics());
+    if (drawSlideCache != nullptr)
+        caches.insert("draw_slide", drawSlideCache->statistics());
+    QJsonObject object;
+    object.insert("caches", caches);
+    object.insert("timing", RenderStats::instance()->toJson());
+    object.insert("transitions", presentationScreen->slide->transitionStatistics());
+    // cacheSize is not updated if the cache size is unlimited.
+    qint64 size = 0;
+    for (auto const& cache : caches)
+        size += qint64(cache.toObject().value("bytes").toDouble());
+    object.insert("cache_size", double(size));
+    object.insert("max_cache_size", double(maxCacheSize));
+    object.insert("max_cache_number", maxCacheNumber);
+    object.insert("number_of_pages", numberOfPages);
+    object.insert("render_threads", RenderPool::instance()->threadCount());
+    return object;
+}
+
+void ControlScreen::writeStatistics(QString const& path) const
+{
+    QByteArray const json = QJsonDocument(statistics()).toJson();
+    if (path == "-") {
+        std::cout << json.constData() << std::flush;
+        return;
     }
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate) || file.write(json) != json.size())
+        qWarning() << "Failed to write statistics to" << path;
+}
+
+void ControlScreen::freeCachePage(const int page)
+{
+    cacheSize -= presentationScreen->slide->getCacheMap()->clearPage(page);
     cacheSize -= ui->notes_widget->getCacheMap()->clearPage(page);
-    if (cacheSize <= maxCacheSize && (maxCacheNumber >= numberOfPages || presentationScreen->slide->getCacheMap()->length() <= maxCacheNumber))
-        return true;
+    cacheSize -= previewCache->clearPage(page);
     if (previewCacheX != nullptr)
         cacheSize -= previewCacheX->clearPage(page);
-    cacheSize -= previewCache->clearPage(page);
-    if (cacheSize <= maxCacheSize && (maxCacheNumber >= numberOfPages || presentationScreen->slide->getCacheMap()->length() <= maxCacheNumber))
-        return true;
-    cacheSize -= presentationScreen->slide->getCacheMap()->clearPage(page);
+    if (drawSlideCache != nullptr)
+        cacheSize -= drawSlideCache->clearPage(page);
 #ifdef DEBUG_CACHE
     qDebug() << "Freed page" << page << ". Cache size" << cacheSize << "B";
 #endif
-    return false;
 }
 
-void ControlScreen::cachePage(const int page)
+void ControlScreen::cachePage(const int page, RenderPriority const priority)
 {
 #ifdef DEBUG_CACHE
-    qDebug() << "Cache page" << page << cacheThreadsRunning << cacheSize;
+    qDebug() << "Cache page" << page << priority << cacheThreadsRunning << cacheSize;
 #endif
-    cacheTimer->stop();
-    cacheThreadsRunning = 0;
-    if (presentationScreen->slide->getCacheMap()->updateCache(page))
+    if (presentationScreen->slide->getCacheMap()->updateCache(page, priority))
         cacheThreadsRunning++;
-    if(ui->notes_widget->getCacheMap()->updateCache(page))
+    if(ui->notes_widget->getCacheMap()->updateCache(page, priority))
         cacheThreadsRunning++;
-    if (previewCache->updateCache(page))
+    if (previewCache->updateCache(page, priority))
         cacheThreadsRunning++;
-    if (drawSlideCache != nullptr && drawSlideCache->updateCache(page))
+    if (drawSlideCache != nullptr && drawSlideCache->updateCache(page, priority))
         cacheThreadsRunning++;
-    if (previewCacheX != nullptr && previewCacheX->updateCache(page))
+    if (previewCacheX != nullptr && previewCacheX->updateCache(page, priority))
         cacheThreadsRunning++;
-    if (cacheThreadsRunning == 0)
+    // Keep submitting pages until all render threads have something to do.
+    if (cacheThreadsRunning >= 2*RenderPool::instance()->threadCount())
+        cacheTimer->stop();
+    else
         cacheTimer->start();
 }
 
@@ -901,7 +996,10 @@ void ControlScreen::setCacheNumber(int const number)
 
 void ControlScreen::cacheThreadFinished()
 {
-    if (--cacheThreadsRunning == 0)
+    // Jobs which were running while the cache processes were interrupted are not counted anymore.
+    if (cacheThreadsRunning > 0)
+        cacheThreadsRunning--;
+    if (cacheThreadsRunning < 2*RenderPool::instance()->threadCount() && !cacheTimer->isActive())
         cacheTimer->start();
 }
 
@@ -1302,6 +1400,12 @@ bool ControlScreen::handleKeyAction(KeyAction const action)
 #endif
         updateCache();
         break;
+    case KeyAction::PrintStatistics:
+#ifdef DEBUG_KEY_ACTIONS
+            qDebug() << "Print statistics event" << action;
+#endif
+        writeStatistics("-");
+        break;
 #ifdef EMBEDDED_APPLICATIONS_ENABLED
     case KeyAction::StartEmbeddedCurrentSlide:
 #ifdef DEBUG_KEY_ACTIONS
@@ -1653,6 +1757,16 @@ bool ControlScreen::handleKeyAction(KeyAction const action)
             qDebug() << "Save drawings event" << action;
 #endif
             QString const savePath = QFileDialog::getSaveFileName(this, "Save drawings");
+            if (!savePath.isEmpty())
+                presentationScreen->slide->getPathOverlay()->saveBinary(savePath, notes);
+        }
+        break;
+    case KeyAction::SaveDrawingsXML:
+        {
+#ifdef DEBUG_KEY_ACTIONS
+            qDebug() << "Save drawings event" << action;
+#endif
+            QString const savePath = QFileDialog::getSaveFileName(this, "Save drawings XML");
             if (!savePath.isEmpty())
                 presentationScreen->slide->getPathOverlay()->saveXML(savePath, notes);
         }
@@ -1662,9 +1776,10 @@ bool ControlScreen::handleKeyAction(KeyAction const action)
 #ifdef DEBUG_KEY_ACTIONS
             qDebug() << "Save drawings event" << action;
 #endif
-            QString const savePath = QFileDialog::getSaveFileName(this, "Save drawings compatibility (Xournal)");
+            QString const savePath = QFileDialog::getSaveFileName(this, "Save drawings compatibility (Xournal)", "", "Xournal++ files (*.xopp);;Uncompressed XML files (*.xml)");
+            // Files are compressed like in Xournal++ unless an uncompressed XML file is requested.
             if (!savePath.isEmpty())
-                presentationScreen->slide->getPathOverlay()->saveXournal(savePath);
+                presentationScreen->slide->getPathOverlay()->saveXournal(savePath, !savePath.endsWith(".xml", Qt::CaseInsensitive));
         }
         break;
     case KeyAction::SaveDrawingsUncompressed:
@@ -1731,10 +1846,7 @@ void ControlScreen::resizeEvent(QResizeEvent* event)
     // Update layout
     recalcLayout(currentPageNumber);
     oldSize = event->size();
-    first_cached = presentationScreen->getPageNumber();
-    last_cached = first_cached-1;
-    first_delete = 0;
-    last_delete = numberOfPages-1;
+    resetPrefetchOrder();
     ui->notes_widget->getCacheMap()->clearCache();
     previewCache->clearCache();
     if (previewCacheX != nullptr)
@@ -1754,10 +1866,7 @@ void ControlScreen::presentationResized()
 {
     // Stop rendering to cache and reset cached region.
     cacheTimer->stop();
-    first_cached = presentationScreen->getPageNumber();
-    last_cached = first_cached-1;
-    first_delete = 0;
-    last_delete = numberOfPages-1;
+    resetPrefetchOrder();
 
     // Adapt tool sizes.
     if (drawSlide != nullptr) {
@@ -1914,8 +2023,11 @@ void ControlScreen::showOverview()
     tocBox->hide();
     if (overviewBox->needsUpdate()) {
         cacheTimer->stop();
+        overviewBox->setSourceCache(presentationScreen->slide->getCacheMap());
         overviewBox->create(presentation, pagePart);
     }
+    else
+        overviewBox->requestMissing();
     if (!this->isActiveWindow())
         this->activateWindow();
     ui->notes_widget->hide();
@@ -1953,10 +2065,25 @@ void ControlScreen::setRenderer(QStringList const& command)
     return;
 }
 
+void ControlScreen::setCacheEncoding(CacheEncoding const presentationEncoding, CacheEncoding const controlEncoding)
+{
+    presentationScreen->slide->getCacheMap()->setEncoding(presentationEncoding);
+    this->controlEncoding = controlEncoding;
+    ui->notes_widget->getCacheMap()->setEncoding(controlEncoding);
+    previewCache->setEncoding(controlEncoding);
+    if (drawSlideCache != nullptr)
+        drawSlideCache->setEncoding(controlEncoding);
+    if (previewCacheX != nullptr)
+        previewCacheX->setEncoding(controlEncoding);
+}
+
 void ControlScreen::reloadFiles()
 {
     // Stop the cache management and wait until the cache threads finish.
     interruptCacheProcesses(10000);
+    // Finish remapping the cache after the last reload before the documents change again.
+    // Pages, of which the fingerprints have not been calculated yet, are treated as changed.
+    applyPageMappings(true);
 
     /// True if files have changed.
     bool change = false;
@@ -1964,7 +2091,11 @@ void ControlScreen::reloadFiles()
     if (notes->loadDocument()) {
         qInfo() << "Reloading notes file";
         change = true;
-        ui->notes_widget->clearAll();
+        // Cached pages are set aside until the fingerprints of the new pages have been
+        // calculated in the background. Then the unchanged pages are taken back to cache.
+        ui->notes_widget->getCacheMap()->holdPages();
+        notesRemapPending = true;
+        ui->notes_widget->clearAll(true);
         recalcLayout(currentPageNumber);
     }
     // Reload presentation file
@@ -1975,9 +2106,20 @@ void ControlScreen::reloadFiles()
         numberOfPages = presentation->getDoc()->numPages();
         if (unlimitedCache)
             maxCacheNumber = numberOfPages;
-        presentationScreen->updatedFile();
-        ui->current_slide->clearAll();
-        ui->next_slide->clearAll();
+        // Set cached pages and thumbnails aside until the unchanged pages are known.
+        presentationScreen->slide->getCacheMap()->holdPages();
+        previewCache->holdPages();
+        if (previewCacheX != nullptr)
+            previewCacheX->holdPages();
+        if (drawSlideCache != nullptr)
+            drawSlideCache->holdPages();
+        overviewBox->holdThumbnails();
+        heldAccess = lastAccess;
+        lastAccess.clear();
+        presentationRemapPending = true;
+        presentationScreen->updatedFile(true);
+        ui->current_slide->clearAll(true);
+        ui->next_slide->clearAll(true);
         // Hide TOC and overview and set them outdated
         showNotes();
         tocBox->setOutdated();
@@ -1986,10 +2128,7 @@ void ControlScreen::reloadFiles()
     }
     // If one of the two files has changed: Reset cache region and render pages on control screen.
     if (change) {
-        first_cached = currentPageNumber;
-        last_cached = first_cached-1;
-        first_delete = 0;
-        last_delete = numberOfPages-1;
+        resetPrefetchOrder();
         renderPage(currentPageNumber);
         ui->text_number_slides->setText(QString::number(numberOfPages));
         ui->text_current_slide->setNumberOfPages(numberOfPages);
@@ -1997,6 +2136,43 @@ void ControlScreen::reloadFiles()
     updateCache();
 }
 
+bool ControlScreen::applyPageMappings(bool const force)
+{
+    bool remapped = false;
+    if (notesRemapPending && (force || notes->getFingerprintThread()->isFinished())) {
+        ui->notes_widget->getCacheMap()->remapPages(notes->getPageMapping());
+        notesRemapPending = false;
+        remapped = true;
+    }
+    if (presentationRemapPending && (force || presentation->getFingerprintThread()->isFinished())) {
+        // Only keep cached pages and thumbnails, which have not changed.
+        // Drawings are connected to page labels and are therefore kept anyway.
+        QList<int> const& mapping = presentation->getPageMapping();
+        presentationScreen->slide->getCacheMap()->remapPages(mapping);
+        previewCache->remapPages(mapping);
+        if (previewCacheX != nullptr)
+            previewCacheX->remapPages(mapping);
+        if (drawSlideCache != nullptr)
+            drawSlideCache->remapPages(mapping);
+        overviewBox->remapPages(mapping);
+        for (int page=0; page<mapping.length(); page++) {
+            if (mapping[page] >= 0 && heldAccess.contains(mapping[page]) && !lastAccess.contains(page))
+                lastAccess[page] = heldAccess.value(mapping[page]);
+        }
+        heldAccess.clear();
+        presentationRemapPending = false;
+        remapped = true;
+    }
+    return remapped;
+}
+
+void ControlScreen::pageMappingReady()
+{
+    // Pages taken back to cache do not need to be rendered again.
+    if (applyPageMappings(false))
+        updateCache();
+}
+
 void ControlScreen::setKeyMap(QMap<quint32, QList<KeyAction>>* keymap)
 {
     delete this->keymap;
@@ -2027,10 +2203,10 @@ void ControlScreen::showDrawSlide()
 
         // Connect drawSlide to other widgets.
         // Copy paths from draw slide to presentation slide and vice versa when drawing on one of the slides.
-        // Copy paths after moving the mouse while drawing. This assumes that only the last path is changed or a new path is created.
-        connect(drawSlide->getPathOverlay(), &PathOverlay::pathsChangedQuick, presentationScreen->slide->getPathOverlay(), &PathOverlay::setPathsQuick);
-        connect(presentationScreen->slide->getPathOverlay(), &PathOverlay::pathsChangedQuick, drawSlide->getPathOverlay(), &PathOverlay::setPathsQuick);
-        // Copy all paths. This completely updates all paths after using the erasor.
+        // Send changes of the paths (new strokes, new nodes, erased and undone strokes) as operations, which are applied incrementally.
+        connect(drawSlide->getPathOverlay(), &PathOverlay::pathOperations, presentationScreen->slide->getPathOverlay(), &PathOverlay::applyOperations);
+        connect(presentationScreen->slide->getPathOverlay(), &PathOverlay::pathOperations, drawSlide->getPathOverlay(), &PathOverlay::applyOperations);
+        // Copy all paths. This completely updates all paths after loading drawings from a file.
         connect(drawSlide->getPathOverlay(), &PathOverlay::pathsChanged, presentationScreen->slide->getPathOverlay(), &PathOverlay::setPaths);
         connect(presentationScreen->slide->getPathOverlay(), &PathOverlay::pathsChanged, drawSlide->getPathOverlay(), &PathOverlay::setPaths);
         // Send pointer position (when using a pointer, torch or magnifier tool).
@@ -2077,16 +2253,11 @@ void ControlScreen::showDrawSlide()
     // drawSlide is drawn on top of the notes widget. It should thus have the same geometry.
     if (drawSlideCache == nullptr) {
         drawSlideCache = new CacheMap(presentation, pagePart, this);
+        drawSlideCache->setEncoding(controlEncoding);
         connect(drawSlideCache, &CacheMap::cacheSizeChanged, this, &ControlScreen::updateCacheSize);
         connect(drawSlideCache, &CacheMap::cacheThreadFinished, this, &ControlScreen::cacheThreadFinished);
     }
-    first_cached = currentPageNumber;
-    last_cached = currentPageNumber-1;
-    first_delete = 0;
-    last_delete = numberOfPages-1;
-#ifdef DEBUG_CACHE
-    qDebug() << "Reset cache region" << first_delete << first_cached << currentPageNumber << last_cached << last_delete;
-#endif
+    resetPrefetchOrder();
     drawSlide->overwriteCacheMap(drawSlideCache);
     // If notes slides have a different aspect ratio than presentation slides, then change preview cache to previewCacheX.
     // This cache is used because the geometry of the preview widgets will change.
@@ -2094,6 +2265,7 @@ void ControlScreen::showDrawSlide()
     if (std::abs(pressize.width()*notessize.height() - pressize.height()*notessize.width()) > 1e-2) {
         if (previewCacheX == nullptr) {
             previewCacheX = new CacheMap(presentation, pagePart, this);
+        previewCacheX->setEncoding(controlEncoding);
             connect(previewCacheX, &CacheMap::cacheSizeChanged, this, &ControlScreen::updateCacheSize);
             connect(previewCacheX, &CacheMap::cacheThreadFinished, this, &ControlScreen::cacheThreadFinished);
         }
@@ -2173,53 +2345,18 @@ void ControlScreen::interruptCacheProcesses(const unsigned long time)
 {
     cacheTimer->stop();
 
-    // Interrupt cache threads.
-    presentationScreen->slide->getCacheMap()->getCacheThread()->requestInterruption();
-    ui->notes_widget->getCacheMap()->getCacheThread()->requestInterruption();
-    if (previewCache != nullptr)
-        previewCache->getCacheThread()->requestInterruption();
-    if (previewCacheX != nullptr)
-        previewCacheX->getCacheThread()->requestInterruption();
-    if (drawSlideCache != nullptr)
-        drawSlideCache->getCacheThread()->requestInterruption();
-    SingleRenderer* singleRendererPresentation = presentationScreen->slide->getPathOverlay()->getEnlargedPageRenderer();
-    if (singleRendererPresentation != nullptr)
-        singleRendererPresentation->getCacheThread()->requestInterruption();
-    SingleRenderer* singleRendererDrawSlide = nullptr;
-    if (drawSlide != nullptr) {
-        singleRendererDrawSlide = drawSlide->getPathOverlay()->getEnlargedPageRenderer();
-        if (singleRendererDrawSlide != nullptr)
-            singleRendererDrawSlide->getCacheThread()->requestInterruption();
-    }
-
-    if (time != 0) {
-        if (previewCache != nullptr && !previewCache->getCacheThread()->wait(time))
-            qWarning() << "Cache thread previewCache not stopped after" << time << "ms";
-        if (previewCacheX != nullptr && !previewCacheX->getCacheThread()->wait(time))
-            qWarning() << "Cache thread previewCacheX not stopped after" << time << "ms";
-        if (!ui->notes_widget->getCacheMap()->getCacheThread()->wait(time))
-            qWarning() << "Cache thread notes not stopped after" << time << "ms";
-        if (drawSlideCache != nullptr && !drawSlideCache->getCacheThread()->wait(time))
-            qWarning() << "Cache thread draw slide not stopped after" << time << "ms";
-        if (!presentationScreen->slide->getCacheMap()->getCacheThread()->wait(time))
-            qWarning() << "Cache thread presentation not stopped after" << time << "ms";
-        if (singleRendererDrawSlide != nullptr && !singleRendererDrawSlide->getCacheThread()->wait(time))
-            qWarning() << "Cache thread enlarged page draw slide not stopped after" << time << "ms";
-        if (singleRendererPresentation != nullptr && !singleRendererPresentation->getCacheThread()->wait(time))
-            qWarning() << "Cache thread enlarged page presentation not stopped after" << time << "ms";
-        if (previewCache != nullptr)
-            previewCache->getCacheThread()->exit();
-        if (previewCacheX != nullptr)
-            previewCacheX->getCacheThread()->exit();
-        ui->notes_widget->getCacheMap()->getCacheThread()->exit();
-        if (drawSlideCache != nullptr)
-            drawSlideCache->getCacheThread()->exit();
-        presentationScreen->slide->getCacheMap()->getCacheThread()->exit();
-        if (singleRendererDrawSlide != nullptr)
-            singleRendererDrawSlide->getCacheThread()->exit();
-        if (singleRendererPresentation != nullptr)
-            singleRendererPresentation->getCacheThread()->exit();
+    // Drop the render jobs of this screen's caches, which have not been started yet.
+    // Pages requested for display (VisiblePriority) and jobs of other renderers (magnifier
+    // tiles, thumbnails) are kept: nobody would request them again.
+    for (auto const cache : {presentationScreen->slide->getCacheMap(), ui->notes_widget->getCacheMap(), previewCache, previewCacheX, drawSlideCache}) {
+        if (cache != nullptr)
+            RenderPool::instance()->cancel(cache, NextPriority);
     }
+    cacheThreadsRunning = 0;
+
+    // Wait until the running jobs are done.
+    if (time != 0 && !RenderPool::instance()->waitForDone(time))
+        qWarning() << "Render threads not stopped after" << time << "ms";
 }
 
 void ControlScreen::setToolForKey(quint32 const key, FullDrawTool const& tool)
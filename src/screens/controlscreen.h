@@ -22,6 +22,7 @@
 #include <QMainWindow>
 #include <QFileDialog>
 #include <QLabel>
+#include <QJsonObject>
 #include <QApplication>
 #include "../pdf/pdfdoc.h"
 #include "../gui/timer.h"
@@ -83,6 +84,8 @@ public:
     void setTocLevel(quint8 const level);
     void setOverviewColumns(quint8 const columns) {if (overviewBox != nullptr) overviewBox->setColumns(columns);}
     void setRenderer(QStringList const& command);
+    /// Set the format in which rendered pages are cached on the presentation and on the control screen.
+    void setCacheEncoding(CacheEncoding const presentationEncoding, CacheEncoding const controlEncoding);
     /// Set (overwrite) key bindings.
     void setKeyMap(QMap<quint32, QList<KeyAction>>* keymap);
     /// Add (key, action) to key bindings.
@@ -101,9 +104,15 @@ public:
     Timer* getTimer() {return ui->label_timer;}
     /// Allow external links.
     void allowExternalLinks();
+    /// Collect statistics about all caches and about rendering times in a JSON object.
+    QJsonObject const statistics() const;
+    /// Write statistics as JSON to the given file or to standard output if path is "-".
+    void writeStatistics(QString const& path) const;
 
     /// Load drawings from file (used only from main.cpp)
     void loadXML(QString const& filename) {presentationScreen->slide->getPathOverlay()->loadXML(filename, notes);}
+    /// Save the drawings of the presentation periodically (interval in ms) to filename.
+    void startAutosave(QString const& filename, int const interval) {presentationScreen->slide->getPathOverlay()->startAutosave(filename, notes, interval);}
 
     // Show or hide different widgets on the notes area.
     // This activates different modes: drawing, TOC, and overview mode.
@@ -139,14 +148,32 @@ private:
     void recalcLayout(int const pageNumber);
     /// Reload pdf files if they have been updated.
     void reloadFiles();
+    /// Take cached pages and thumbnails, which have not changed after reloading the files, back to cache.
+    /// If force is false, this only handles documents of which the fingerprints have been calculated.
+    /// Otherwise the calculation is stopped and pages without fingerprint are treated as changed.
+    /// Returns true if any cached pages have been remapped.
+    bool applyPageMappings(bool const force);
 #ifdef EMBEDDED_APPLICATIONS_ENABLED
     /// Start embedded applications on all slides.
     void startAllEmbeddedApplications();
 #endif
     /// Tell all cache processes to stop and wait up to <time> ms until each process is stopped.
     void interruptCacheProcesses(unsigned long const time = 0);
-    /// Free a page from cache. Should only be called from updateCacheStep.
-    bool freeCachePage(const int page);
+    /// Free a page from all CacheMaps. Should only be called from updateCacheStep.
+    void freeCachePage(const int page);
+    /// Order all pages by the urgency with which they should be cached, starting at the current page.
+    void resetPrefetchOrder();
+    /// Importance of page for prefetching, relative to the current page and navigation direction.
+    /// Larger values mean less important pages.
+    int prefetchRank(int const page) const;
+    /// Check whether a page is cached in all CacheMaps.
+    bool isPageCached(int const page) const;
+    /// Select a cached page, which should be deleted from cache, or return -1 if no page should be deleted.
+    /// Pages with prefetchRank <= protectedRank and the current presentation page are never selected.
+    int evictionCandidate(int const protectedRank) const;
+    /// Delete pages from cache until there is enough space for one more page.
+    /// Returns false if this is impossible without deleting pages with prefetchRank <= protectedRank.
+    bool freeCacheSpace(int const protectedRank);
 
     /// User interface (created from controlscreen.ui)
     Ui::ControlScreen* ui;
@@ -163,7 +190,7 @@ private:
     QTimer* cacheTimer = new QTimer(this);
 
     /// Cache given page on all slide widgets which can handle cache.
-    void cachePage(int const page);
+    void cachePage(int const page, RenderPriority const priority = LookAheadPriority);
 
     // Widgets shown above notes: TOC, overview, and drawSlide
     /// Widget showing the table of contents on the control screen.
@@ -185,6 +212,8 @@ private:
     int maxCacheNumber = 10;
     /// Maximum size of cache in bytes. Note that cache can get larger than this size in some situations.
     qint64 maxCacheSize = 104857600L;
+    /// Format of cached pages shown on the control screen.
+    CacheEncoding controlEncoding = PngEncoding;
     /// Cached preview slides for standard sidebar width.
     CacheMap* previewCache = nullptr;
     /// Cached preview slides for different sidebar width.
@@ -215,16 +244,25 @@ private:
     int cacheThreadsRunning = 0;
 
     // Variables used for cache management
-    /// All pages < first_delete are not saved in cache.
-    /// Usually this page will be deleted when cache size should be reduced.
-    int first_delete = 0;
-    /// All pages > last_delete are not saved in cache.
-    /// In some case this page will be deleted when cache size should be reduced.
-    int last_delete;
-    /// Beginning of the connected set of cached pages.
-    int first_cached = 0;
-    /// End of the connected set of cached pages.
-    int last_cached = -1;
+    /// Pages ordered by the urgency with which they should be cached. Set by resetPrefetchOrder.
+    QList<int> prefetchOrder;
+    /// Index in prefetchOrder of the next page, which should be cached.
+    int prefetchIndex = 0;
+    /// Last time (in units of accessCounter) at which each page has been shown.
+    /// Pages which have only been pre-rendered to cache are not contained.
+    QMap<int, quint64> lastAccess;
+    /// Counter which is incremented whenever a page is shown. Used for LRU eviction.
+    quint64 accessCounter = 0;
+    /// lastAccess of the previous version of the presentation, kept until the page mapping is known.
+    QMap<int, quint64> heldAccess;
+    /// The notes file has been reloaded, but its unchanged pages have not been taken back to cache.
+    bool notesRemapPending = false;
+    /// The presentation file has been reloaded, but its unchanged pages have not been taken back to cache.
+    bool presentationRemapPending = false;
+    /// Page number at the last call of updateCache. Used for detecting the navigation direction.
+    int lastCachedPageNumber = 0;
+    /// Navigation direction: 1 for forward, -1 for backward.
+    int navigationDirection = 1;
     /// Memory used by cache in bytes.
     qint64 cacheSize = 0;
     /// Allow external links
@@ -233,6 +271,8 @@ private:
 private slots:
     /// Select a page which should be rendered to cache and free cache space if necessary.
     void updateCacheStep();
+    /// Remap cached pages after the fingerprints of a reloaded document have been calculated.
+    void pageMappingReady();
 
 public slots:
     // TODO: Some of these functions are not used as slots. Tidy up!
@@ -131,12 +131,12 @@ void PresentationScreen::wheelEvent(QWheelEvent* event)
     event->accept();
 }
 
-void PresentationScreen::updatedFile()
+void PresentationScreen::updatedFile(bool const keepCache)
 {
 #ifdef DEBUG_RENDERING
     qDebug() << "update file";
 #endif
     numberOfPages = presentation->getDoc()->numPages();
-    slide->clearAll();
+    slide->clearAll(keepCache);
     slide->renderPage(slide->pageNumber(), false);
 }
@@ -36,7 +36,8 @@ public:
     ~PresentationScreen() override;
     void renderPage(int pageNumber = 0, bool const setDuration = true);
     int getPageNumber() const {return slide->pageNumber();}
-    void updatedFile();
+    /// Update after reloading the file. If keepCache is true, unchanged cached pages are kept.
+    void updatedFile(bool const keepCache = false);
     void setScrollDelta(int const scrollDelta) {this->scrollDelta=scrollDelta;}
     void setForceTouchpad() {forceIsTouchpad=true;}
 
@@ -23,7 +23,6 @@
 #include <QDataStream>
 #include "mediaslide.h"
 #include "../draw/drawpath.h"
-#include "../pdf/singlerenderer.h"
 #include "../draw/pathoverlay.h"
 
 class DrawSlide : public MediaSlide
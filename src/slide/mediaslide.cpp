@@ -70,14 +70,14 @@ MediaSlide::MediaSlide(QWidget* parent) : PreviewSlide(parent)
     connect(autostartTimer, &QTimer::timeout, this, &MediaSlide::startAllMultimedia);
 }
 
-void MediaSlide::clearAll()
+void MediaSlide::clearAll(bool const keepCache)
 {
     autostartTimer->stop();
 #ifdef EMBEDDED_APPLICATIONS_ENABLED
     autostartEmbeddedTimer->stop();
 #endif
     clearLists();
-    if (cache != nullptr)
+    if (cache != nullptr && !keepCache)
         cache->clearCache();
     qDeleteAll(cachedVideoWidgets);
     cachedVideoWidgets.clear();
@@ -89,6 +89,7 @@ void MediaSlide::clearAll()
     embedMap.clear();
 #endif
     page = nullptr;
+    requestedPage = -1;
     pixmap = QPixmap();
 }
 
@@ -38,7 +38,7 @@ public:
     ~MediaSlide() override {clearAll();}
     /// Clear all contents of the label.
     /// This function is called when the document is reloaded or the program is closed and everything should be cleaned up.
-    virtual void clearAll() override;
+    virtual void clearAll(bool const keepCache = false) override;
     /// Show page on this widget.
     void renderPage(int pageNumber, bool const hasDuration);
     /// Enabel or disable pre-loading of videos.
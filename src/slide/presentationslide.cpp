@@ -16,29 +16,42 @@
  * along with BeamerPresenter. If not, see <https://www.gnu.org/licenses/>.
  */
 
+#include <cstring>
+#include <QJsonArray>
+#include <QWindow>
+#include <QScreen>
 #include "presentationslide.h"
 
+/// Number of consecutive frames exceeding the frame interval, after which a transition is skipped.
+static int const maxSlowFrames = 3;
+/// Number of transitions kept in the statistics.
+static int const maxTransitionRecords = 32;
+/// Names of Poppler::PageTransition::Type used in the statistics.
+static char const* const transitionNames[] = {"replace", "split", "blinds", "box", "wipe", "dissolve", "glitter", "fly", "push", "cover", "uncover", "fade"};
+
 PresentationSlide::PresentationSlide(PdfDoc const*const document, PagePart const part, QWidget* parent) :
     DrawSlide(document, part, parent)
 {
     seed = static_cast<unsigned int>(std::hash<std::string>{}(doc->getPath().split('/').last().toStdString()));
-    connect(&timer, &QTimer::timeout, this, static_cast<void (PresentationSlide::*)()>(&PresentationSlide::repaint));
+    timer.setTimerType(Qt::PreciseTimer);
+    connect(&timer, &QTimer::timeout, this, &PresentationSlide::nextFrame);
     timeoutTimer->setSingleShot(true);
     connect(timeoutTimer, &QTimer::timeout, this, &PresentationSlide::timeoutSignal);
     remainTimer.setSingleShot(true);
     connect(&remainTimer, &QTimer::timeout, this, &PresentationSlide::endAnimation);
+    // Frames for the next transition are prepared when the slide and its drawings have not changed for this time.
+    prepareTimer.setSingleShot(true);
+    prepareTimer.setInterval(300);
+    connect(&prepareTimer, &QTimer::timeout, this, &PresentationSlide::prepareFrames);
 }
 
 PresentationSlide::~PresentationSlide()
 {
     timer.stop();
     remainTimer.stop();
+    prepareTimer.stop();
     timeoutTimer->stop();
     delete timeoutTimer;
-    if (glitter != nullptr) {
-        delete[] glitter;
-        glitter = nullptr;
-    }
 }
 
 void PresentationSlide::paintEvent(QPaintEvent*)
@@ -56,6 +69,9 @@ void PresentationSlide::paintEvent(QPaintEvent*)
             painter.drawPixmap(shiftx + width(), shifty, pixmap);
         else
             painter.drawPixmap(shiftx, shifty, pixmap);
+        // Drawing on the transparent overlay also repaints this widget. Prepare the frames again after changes.
+        if (transition_duration >= 0)
+            prepareTimer.start();
     }
 }
 
@@ -67,25 +83,21 @@ void PresentationSlide::endAnimation()
     stopAnimation();
     //pathOverlay->show();
     repaint();
-    if (glitter != nullptr) {
-        delete[] glitter;
-        glitter = nullptr;
-    }
+    glitterSteps.clear();
     emit sendAdaptPage();
     pathOverlay->updatePathCache();
 }
 
 void PresentationSlide::stopAnimation()
 {
+    finishTransitionRecord();
     timeoutTimer->stop();
     timer.stop();
     remainTimer.stop();
     if (!changes.isNull())
         changes = QPixmap();
-    if (!picinit.isNull())
-        picinit = QPixmap();
-    if (!picfinal.isNull())
-        picfinal = QPixmap();
+    imageInit = QImage();
+    imageFinal = QImage();
 }
 
 void PresentationSlide::setDuration()
@@ -109,47 +121,103 @@ void PresentationSlide::disableTransitions()
     timer.stop();
     remainTimer.stop();
     transition_duration = -1;
-    picinit = QPixmap();
-    picfinal = QPixmap();
     changes = QPixmap();
+    imageInit = QImage();
+    imageFinal = QImage();
+    frameBuffer = QImage();
+    prepareTimer.stop();
+    preparedFrames.clear();
 }
 
-void PresentationSlide::updateImages(int const oldPage)
+void PresentationSlide::prepareFrameBuffer()
 {
-    {
-        picinit = QPixmap(size());
-        QPainter painter;
-        painter.begin(&picinit);
-        if (shiftx > 0) {
-            painter.fillRect(0, 0, shiftx, height(), QBrush(parentWidget()->palette().base()));
-            painter.fillRect(shiftx + pixmap.width(), 0, shiftx+2, height(), QBrush(parentWidget()->palette().base()));
-        }
-        else if (shifty > 0) {
-            painter.fillRect(0, 0, width(), shifty, QBrush(parentWidget()->palette().base()));
-            painter.fillRect(0, shifty + pixmap.height(), width(), shifty+2, QBrush(parentWidget()->palette().base()));
-        }
-        painter.setRenderHint(QPainter::Antialiasing);
-        painter.drawPixmap(shiftx, shifty, getPixmap(oldPage));
-        pathOverlay->drawPaths(painter, doc->getLabel(oldPage), QRegion(rect()), true, false);
+    // imageInit and imageFinal are already RGB32 images, see composeFrame.
+    if (frameBuffer.size() == imageInit.size() && frameBuffer.format() == imageInit.format() && frameBuffer.bytesPerLine() == imageInit.bytesPerLine())
+        memcpy(frameBuffer.bits(), imageInit.constBits(), size_t(imageInit.bytesPerLine())*size_t(imageInit.height()));
+    else
+        frameBuffer = imageInit.copy();
+}
+
+QImage const PresentationSlide::composeFrame(int const page, QPixmap const& slide)
+{
+    // The slides are opaque. RGB32 images are copied to the screen without blending
+    // and are used directly by the transitions composited in frameBuffer.
+    QImage frame(size(), QImage::Format_RGB32);
+    QPainter painter;
+    painter.begin(&frame);
+    if (shiftx > 0) {
+        painter.fillRect(0, 0, shiftx, height(), QBrush(parentWidget()->palette().base()));
+        painter.fillRect(shiftx + slide.width(), 0, shiftx+2, height(), QBrush(parentWidget()->palette().base()));
     }
-    {
-        picfinal = QPixmap(size());
-        QPainter painter;
-        painter.begin(&picfinal);
-        if (shiftx > 0) {
-            painter.fillRect(0, 0, shiftx, height(), QBrush(parentWidget()->palette().base()));
-            painter.fillRect(shiftx + pixmap.width(), 0, shiftx+2, height(), QBrush(parentWidget()->palette().base()));
-        }
-        else if (shifty > 0) {
-            painter.fillRect(0, 0, width(), shifty, QBrush(parentWidget()->palette().base()));
-            painter.fillRect(0, shifty + pixmap.height(), width(), shifty+2, QBrush(parentWidget()->palette().base()));
+    else if (shifty > 0) {
+        painter.fillRect(0, 0, width(), shifty, QBrush(parentWidget()->palette().base()));
+        painter.fillRect(0, shifty + slide.height(), width(), shifty+2, QBrush(parentWidget()->palette().base()));
+    }
+    painter.setRenderHint(QPainter::Antialiasing);
+    painter.drawPixmap(shiftx, shifty, slide);
+    // The path cache of the overlay only contains the current page.
+    if (page == pageIndex)
+        pathOverlay->drawCachedPaths(painter, QRegion(rect()));
+    else
+        pathOverlay->drawPaths(painter, doc->getLabel(page), QRegion(rect()), true);
+    return frame;
+}
+
+quint32 PresentationSlide::pathsHash(int const page) const
+{
+    QMap<QString, QList<DrawPath*>> const& paths = pathOverlay->getPaths();
+    QMap<QString, QList<DrawPath*>>::const_iterator const it = paths.constFind(doc->getLabel(page));
+    if (it == paths.cend())
+        return 0;
+    quint32 hash = quint32(it->length());
+    for (auto const path : *it)
+        hash = path->getHash() + (hash << 6) + (hash >> 2);
+    return hash;
+}
+
+QImage const PresentationSlide::getFrame(int const page)
+{
+    for (auto const& frame : preparedFrames) {
+        if (frame.page == page && frame.size == size() && frame.pathsHash == pathsHash(page)) {
+#ifdef DEBUG_SLIDE_TRANSITIONS
+            qDebug() << "Using prepared frame of page" << page;
+#endif
+            return frame.image;
         }
-        painter.setRenderHint(QPainter::Antialiasing);
-        painter.drawPixmap(shiftx, shifty, pixmap);
-        if (pathOverlay->end_cache >= 0)
-            painter.drawPixmap(0, 0, pathOverlay->pixpaths);
-        pathOverlay->drawPaths(painter, page->label(), QRegion(rect()), false, false);
     }
+    if (page == pageIndex)
+        return composeFrame(page, pixmap);
+    // Never render a slide in the main thread during a slide change.
+    QPixmap const slide = cache == nullptr ? QPixmap() : cache->getCachedPixmap(page);
+    if (slide.isNull())
+        return QImage();
+    return composeFrame(page, slide);
+}
+
+void PresentationSlide::prepareFrames()
+{
+    if (transition_duration < 0 || page == nullptr || pixmap.isNull() || isShowingTransition())
+        return;
+    QList<PreparedFrame> frames;
+    // The current slide is the initial frame of the next transition.
+    frames.append({pageIndex, size(), pathsHash(pageIndex), getFrame(pageIndex)});
+    // The next slide is the final frame when going forward. It is only prepared if it has a transition,
+    // is already cached and has the same size as the current slide (then both slides have the same position).
+    int const next = pageIndex + 1;
+    if (next < doc->getDoc()->numPages() && cache != nullptr && cache->contains(next) && doc->getPageSize(next) == doc->getPageSize(pageIndex)) {
+        Poppler::Page const* const nextPage = doc->getPage(next);
+        Poppler::PageTransition const* const transition = nextPage == nullptr ? nullptr : nextPage->transition();
+        if (transition != nullptr && transition->type() != Poppler::PageTransition::Replace)
+            frames.append({next, size(), pathsHash(next), getFrame(next)});
+    }
+    preparedFrames = frames;
+}
+
+bool PresentationSlide::updateImages(int const oldPage)
+{
+    imageInit = getFrame(oldPage);
+    imageFinal = getFrame(pageIndex);
+    return !imageInit.isNull() && !imageFinal.isNull();
 }
 
 void PresentationSlide::animate(int const oldPageIndex) {
@@ -202,7 +270,12 @@ void PresentationSlide::animate(int const oldPageIndex) {
         remainTimer.start(0);
         return;
     }
-    updateImages(oldPageIndex);
+    // Skip the transition if the old slide is not cached anymore.
+    if (!updateImages(oldPageIndex)) {
+        transition_duration = 0;
+        remainTimer.start(0);
+        return;
+    }
     remainTimer.setInterval(transition_duration-2);
     switch (transition->type()) {
     case Poppler::PageTransition::Split:
@@ -260,12 +333,14 @@ void PresentationSlide::animate(int const oldPageIndex) {
 #ifdef DEBUG_SLIDE_TRANSITIONS
         qDebug () << "Transition dissolve";
 #endif
+        prepareFrameBuffer();
         paint = &PresentationSlide::paintDissolve;
         break;
     case Poppler::PageTransition::Glitter:
 #ifdef DEBUG_SLIDE_TRANSITIONS
         qDebug () << "Transition glitter";
 #endif
+        prepareFrameBuffer();
         initGlitter();
         paint = &PresentationSlide::paintGlitter;
         break;
@@ -276,13 +351,13 @@ void PresentationSlide::animate(int const oldPageIndex) {
 #endif
         QImage oldimg, newimg;
         if ((oldPageIndex < pageIndex) ^ (transition->direction() == Poppler::PageTransition::Outward)) {
-            oldimg = picinit.toImage();
-            newimg = picfinal.toImage();
+            oldimg = imageInit;
+            newimg = imageFinal;
         }
         else {
             // The names are confusing, but remember that this is just the same as the "normal" fly transition with old and new image interchanged.
-            newimg = picinit.toImage();
-            oldimg = picfinal.toImage();
+            newimg = imageInit;
+            oldimg = imageFinal;
         }
         if (oldimg.size() != newimg.size())
             break;
@@ -485,6 +560,7 @@ void PresentationSlide::animate(int const oldPageIndex) {
 #ifdef DEBUG_SLIDE_TRANSITIONS
         qDebug () << "Transition fade";
 #endif
+        prepareFrameBuffer();
         paint = &PresentationSlide::paintFade;
         break;
     default:
@@ -493,317 +569,453 @@ void PresentationSlide::animate(int const oldPageIndex) {
         return;
     }
     emit requestUpdateNotes(pageIndex, false);
+    // The frame clock runs at the refresh rate of the screen showing this slide.
+    QWindow const* const handle = window()->windowHandle();
+    QScreen const* const screen = handle == nullptr ? QGuiApplication::primaryScreen() : handle->screen();
+    qreal const rate = screen == nullptr ? 60. : screen->refreshRate();
+    frameInterval = rate > 1. ? qMax(1, qRound(1000./rate)) : 16;
+    currentRecord = {transition->type(), remainTimer.interval(), 0, 0, 0, false};
+    lastFrame = 0;
+    slowFrames = 0;
+    remaining = remainTimer.interval();
+    transitionClock.start();
     remainTimer.start();
-    timer.start(0);
+    timer.start(frameInterval);
+    nextFrame();
     //pathOverlay->hide();
 }
 
+void PresentationSlide::nextFrame()
+{
+    if (!transitionClock.isValid() || !remainTimer.isActive())
+        return;
+    qint64 const elapsed = transitionClock.elapsed();
+    if (elapsed >= remainTimer.interval()) {
+        endAnimation();
+        return;
+    }
+    // Count the frames, which should have been shown since the last frame.
+    if (currentRecord.frames > 0 && elapsed - lastFrame > (3*frameInterval)/2)
+        currentRecord.dropped += int((elapsed - lastFrame + frameInterval/2)/frameInterval) - 1;
+    lastFrame = elapsed;
+    currentRecord.elapsed = elapsed;
+    remaining = remainTimer.interval() - int(elapsed);
+    QElapsedTimer paintTimer;
+    paintTimer.start();
+    repaint();
+    currentRecord.frames++;
+    // If painting repeatedly takes longer than a frame, show the final slide instead of a stuttering transition.
+    if (paintTimer.elapsed() > frameInterval) {
+        if (++slowFrames >= maxSlowFrames) {
+#ifdef DEBUG_SLIDE_TRANSITIONS
+            qDebug() << "Skipping slow transition after" << currentRecord.frames << "frames";
+#endif
+            currentRecord.skipped = true;
+            endAnimation();
+        }
+    }
+    else
+        slowFrames = 0;
+}
+
+void PresentationSlide::finishTransitionRecord()
+{
+    if (!transitionClock.isValid())
+        return;
+    transitionClock.invalidate();
+    transitionRecords.append(currentRecord);
+    while (transitionRecords.length() > maxTransitionRecords)
+        transitionRecords.removeFirst();
+}
+
+QJsonObject const PresentationSlide::transitionStatistics() const
+{
+    QJsonObject object;
+    QJsonArray list;
+    int frames = 0, dropped = 0, skipped = 0;
+    qint64 elapsed = 0;
+    for (auto const& record : transitionRecords) {
+        QJsonObject entry;
+        int const type = record.type;
+        entry.insert("type", type >= 0 && type < int(sizeof(transitionNames)/sizeof(transitionNames[0])) ? transitionNames[type] : "unknown");
+        entry.insert("duration_ms", record.duration);
+        entry.insert("frames", record.frames);
+        entry.insert("dropped_frames", record.dropped);
+        entry.insert("fps", record.elapsed > 0 ? 1000.*(record.frames - 1)/record.elapsed : 0.);
+        entry.insert("skipped", record.skipped);
+        list.append(entry);
+        frames += record.frames;
+        dropped += record.dropped;
+        skipped += record.skipped;
+        elapsed += record.elapsed;
+    }
+    object.insert("count", transitionRecords.length());
+    object.insert("frame_interval_ms", frameInterval);
+    object.insert("frames", frames);
+    object.insert("dropped_frames", dropped);
+    object.insert("skipped", skipped);
+    // The first frame of each transition is shown at time 0.
+    object.insert("fps", elapsed > 0 ? 1000.*(frames - transitionRecords.length())/elapsed : 0.);
+    object.insert("last", list);
+    return object;
+}
+
 void PresentationSlide::paintWipeUp(QPainter& painter)
 {
-    int const split = shifty + remainTimer.remainingTime()*picheight/transition_duration;
-    painter.drawPixmap(0, split, picfinal, 0, split, -1, -1);
+    int const split = shifty + remaining*picheight/transition_duration;
+    painter.drawImage(0, split, imageFinal, 0, split, -1, -1);
     if (split > 0)
-        painter.drawPixmap(0, 0, picinit, 0, 0, -1, split);
+        painter.drawImage(0, 0, imageInit, 0, 0, -1, split);
 }
 
 void PresentationSlide::paintWipeDown(QPainter& painter)
 {
-    int const split = shifty + (transition_duration - remainTimer.remainingTime())*picheight/transition_duration;
-    painter.drawPixmap(0, split, picinit, 0, split, -1, -1);
+    int const split = shifty + (transition_duration - remaining)*picheight/transition_duration;
+    painter.drawImage(0, split, imageInit, 0, split, -1, -1);
     if (split > 0)
-        painter.drawPixmap(0, 0, picfinal, 0, 0, -1, split);
+        painter.drawImage(0, 0, imageFinal, 0, 0, -1, split);
 }
 
 void PresentationSlide::paintWipeLeft(QPainter& painter)
 {
-    int const split = shiftx + remainTimer.remainingTime()*picwidth/transition_duration;
-    painter.drawPixmap(split, 0, picfinal, split, 0, -1, -1);
+    int const split = shiftx + remaining*picwidth/transition_duration;
+    painter.drawImage(split, 0, imageFinal, split, 0, -1, -1);
     if (split > 0)
-        painter.drawPixmap(0, 0, picinit, 0, 0, split, -1);
+        painter.drawImage(0, 0, imageInit, 0, 0, split, -1);
 }
 
 void PresentationSlide::paintWipeRight(QPainter& painter)
 {
-    int const split = shiftx + (transition_duration - remainTimer.remainingTime())*picwidth/transition_duration;
-    painter.drawPixmap(split, 0, picinit, split, 0, -1, -1);
+    int const split = shiftx + (transition_duration - remaining)*picwidth/transition_duration;
+    painter.drawImage(split, 0, imageInit, split, 0, -1, -1);
     if (split > 0)
-        painter.drawPixmap(0, 0, picfinal, 0, 0, split, -1);
+        painter.drawImage(0, 0, imageFinal, 0, 0, split, -1);
 }
 
 void PresentationSlide::paintBlindsV(QPainter& painter)
 {
-    int width = (picwidth*(transition_duration - remainTimer.remainingTime()))/(n_blinds*transition_duration);
+    int width = (picwidth*(transition_duration - remaining))/(n_blinds*transition_duration);
     if (width < 1)
         width = 1;
-    painter.drawPixmap(0, 0, picinit);
+    painter.drawImage(0, 0, imageInit);
     int const n = this->width()*n_blinds/picwidth;
     for (int i=0; i<n; i++)
-        painter.drawPixmap(i*picwidth/n_blinds, 0, picfinal, i*picwidth/n_blinds, 0, width, -1);
+        painter.drawImage(i*picwidth/n_blinds, 0, imageFinal, i*picwidth/n_blinds, 0, width, -1);
 }
 
 void PresentationSlide::paintBlindsH(QPainter& painter)
 {
-    int height = (picheight*(transition_duration - remainTimer.remainingTime()))/(n_blinds*transition_duration);
+    int height = (picheight*(transition_duration - remaining))/(n_blinds*transition_duration);
     if (height < 1)
         height = 1;
-    painter.drawPixmap(0, 0, picinit);
+    painter.drawImage(0, 0, imageInit);
     int const n = this->height()*n_blinds/picheight;
     for (int i=0; i<n; i++)
-        painter.drawPixmap(0, i*picheight/n_blinds, picfinal, 0, i*picheight/n_blinds, -1, height);
+        painter.drawImage(0, i*picheight/n_blinds, imageFinal, 0, i*picheight/n_blinds, -1, height);
 }
 
 void PresentationSlide::paintBoxO(QPainter& painter)
 {
-    int const w = ((transition_duration - remainTimer.remainingTime())*picwidth)/transition_duration;
-    int const h = ((transition_duration - remainTimer.remainingTime())*picheight)/transition_duration;
-    painter.drawPixmap(0, 0, picinit);
+    int const w = ((transition_duration - remaining)*picwidth)/transition_duration;
+    int const h = ((transition_duration - remaining)*picheight)/transition_duration;
+    painter.drawImage(0, 0, imageInit);
     if (w != 0 && h != 0)
-        painter.drawPixmap((width()-w)/2, (height()-h)/2, picfinal, (width()-w)/2, (height()-h)/2, w, h);
+        painter.drawImage((width()-w)/2, (height()-h)/2, imageFinal, (width()-w)/2, (height()-h)/2, w, h);
 }
 
 void PresentationSlide::paintBoxI(QPainter& painter)
 {
-    int const w = ((transition_duration - remainTimer.remainingTime())*picwidth)/transition_duration;
-    int const h = ((transition_duration - remainTimer.remainingTime())*picheight)/transition_duration;
-    painter.drawPixmap(0, 0, picfinal);
+    int const w = ((transition_duration - remaining)*picwidth)/transition_duration;
+    int const h = ((transition_duration - remaining)*picheight)/transition_duration;
+    painter.drawImage(0, 0, imageFinal);
     if (w != picwidth && h != picheight)
-        painter.drawPixmap(shiftx+w/2, shifty+h/2, picinit, shiftx+w/2, shifty+h/2, picwidth-w, picheight-h);
+        painter.drawImage(shiftx+w/2, shifty+h/2, imageInit, shiftx+w/2, shifty+h/2, picwidth-w, picheight-h);
 }
 
 void PresentationSlide::paintSplitHO(QPainter& painter)
 {
-    int const h = ((transition_duration - remainTimer.remainingTime())*picheight)/transition_duration;
-    painter.drawPixmap(0, 0, picinit, 0, 0, -1, (height()-h)/2+1);
-    painter.drawPixmap(0, (height()+h)/2, picinit,  0, (height()+h)/2, -1, (height()-h)/2+1);
+    int const h = ((transition_duration - remaining)*picheight)/transition_duration;
+    painter.drawImage(0, 0, imageInit, 0, 0, -1, (height()-h)/2+1);
+    painter.drawImage(0, (height()+h)/2, imageInit,  0, (height()+h)/2, -1, (height()-h)/2+1);
     if (h > 0)
-        painter.drawPixmap(0, (height()-h)/2, picfinal, 0, (height()-h)/2, -1, h);
+        painter.drawImage(0, (height()-h)/2, imageFinal, 0, (height()-h)/2, -1, h);
 }
 
 void PresentationSlide::paintSplitVO(QPainter& painter)
 {
-    int const w = ((transition_duration - remainTimer.remainingTime())*picwidth)/transition_duration;
-    painter.drawPixmap(0, 0, picinit, 0, 0, (width()-w)/2+1, -1);
-    painter.drawPixmap((width()+w)/2, 0, picinit,  (width()+w)/2, 0, (width()-w)/2+1, -1);
+    int const w = ((transition_duration - remaining)*picwidth)/transition_duration;
+    painter.drawImage(0, 0, imageInit, 0, 0, (width()-w)/2+1, -1);
+    painter.drawImage((width()+w)/2, 0, imageInit,  (width()+w)/2, 0, (width()-w)/2+1, -1);
     if (w > 0)
-        painter.drawPixmap((width()-w)/2, 0, picfinal, (width()-w)/2, 0, w, -1);
+        painter.drawImage((width()-w)/2, 0, imageFinal, (width()-w)/2, 0, w, -1);
 }
 
 void PresentationSlide::paintSplitHI(QPainter& painter)
 {
-    int const h = remainTimer.remainingTime()*picheight/transition_duration;
-    painter.drawPixmap(0, 0, picfinal, 0, 0, -1, (height()-h)/2+1);
-    painter.drawPixmap(0, (height()+h)/2, picfinal, 0, (height()+h)/2, -1, (height()-h)/2+1);
+    int const h = remaining*picheight/transition_duration;
+    painter.drawImage(0, 0, imageFinal, 0, 0, -1, (height()-h)/2+1);
+    painter.drawImage(0, (height()+h)/2, imageFinal, 0, (height()+h)/2, -1, (height()-h)/2+1);
     if (h > 0)
-        painter.drawPixmap(0, (height()-h)/2, picinit,  0, (height()-h)/2, -1, h);
+        painter.drawImage(0, (height()-h)/2, imageInit,  0, (height()-h)/2, -1, h);
 }
 
 void PresentationSlide::paintSplitVI(QPainter& painter)
 {
-    int const w = remainTimer.remainingTime()*picwidth/transition_duration;
-    painter.drawPixmap(0, 0, picfinal, 0, 0, (width()-w)/2+1, -1);
-    painter.drawPixmap((width()+w)/2, 0, picfinal, (width()+w)/2, 0, (width()-w)/2+1, -1);
+    int const w = remaining*picwidth/transition_duration;
+    painter.drawImage(0, 0, imageFinal, 0, 0, (width()-w)/2+1, -1);
+    painter.drawImage((width()+w)/2, 0, imageFinal, (width()+w)/2, 0, (width()-w)/2+1, -1);
     if (w > 0)
-        painter.drawPixmap((width()-w)/2, 0, picinit,  (width()-w)/2, 0, w, -1);
+        painter.drawImage((width()-w)/2, 0, imageInit,  (width()-w)/2, 0, w, -1);
+}
+
+/// Blend two images of equal size and format (RGB32) to target: target = (1-alpha/256)*first + alpha/256*second.
+/// Red and blue (and alpha and green) channels are blended together in one 32 bit operation.
+/// The inner loop has no branches and can be vectorized by the compiler.
+static void blendImages(QImage const& first, QImage const& second, QImage& target, quint32 const alpha)
+{
+    quint32 const beta = 256 - alpha;
+    int const width = target.width();
+    for (int y=0; y<target.height(); y++) {
+        quint32 const* const a = reinterpret_cast<quint32 const*>(first.constScanLine(y));
+        quint32 const* const b = reinterpret_cast<quint32 const*>(second.constScanLine(y));
+        quint32* const t = reinterpret_cast<quint32*>(target.scanLine(y));
+        for (int x=0; x<width; x++) {
+            quint32 const rb = (((a[x] & 0x00ff00ffu)*beta + (b[x] & 0x00ff00ffu)*alpha) >> 8) & 0x00ff00ffu;
+            quint32 const ag = (((a[x] >> 8) & 0x00ff00ffu)*beta + ((b[x] >> 8) & 0x00ff00ffu)*alpha) & 0xff00ff00u;
+            t[x] = rb | ag;
+        }
+    }
 }
 
 void PresentationSlide::paintDissolve(QPainter& painter)
 {
-    painter.setOpacity(static_cast<double>(remainTimer.remainingTime())/transition_duration);
-    painter.drawPixmap(0, 0, picinit);
-    painter.setOpacity(static_cast<double>((transition_duration - remainTimer.remainingTime()))/transition_duration);
-    painter.drawPixmap(0, 0, picfinal);
+    if (frameBuffer.size() != imageFinal.size() || imageInit.size() != imageFinal.size()) {
+        painter.drawImage(0, 0, imageFinal);
+        return;
+    }
+    quint32 const alpha = quint32(qBound(0, 256*(transition_duration - remaining)/transition_duration, 256));
+    blendImages(imageInit, imageFinal, frameBuffer, alpha);
+    painter.drawImage(0, 0, frameBuffer);
 }
 
 void PresentationSlide::paintGlitter(QPainter& painter)
 {
-    if (glitter == nullptr)
+    if (glitterSteps.isEmpty() || frameBuffer.size() != imageFinal.size()) {
+        painter.drawImage(0, 0, imageFinal);
         return;
-    qint32 const n = width()*height()/glitterpixel, w = width()/glitterpixel;
-    qint16 const steps = qint16((nglitter*(transition_duration - remainTimer.remainingTime()))/transition_duration);
-    painter.drawPixmap(0, 0, picinit);
-    for (qint16 j=0; j<steps; j++) {
-        for (qint32 i=glitter[j]%nglitter; i<n; i+=nglitter) {
-            painter.drawPixmap(glitterpixel*(i%w), glitterpixel*(i/w), picfinal, glitterpixel*(i%w), glitterpixel*(i/w), glitterpixel, glitterpixel);
+    }
+    int const steps = (nglitter*(transition_duration - remaining))/transition_duration;
+    if (steps > glitterShown) {
+        // frameBuffer already shows all cells revealed in earlier frames.
+        // Copy the cells revealed since then in a single pass over the image.
+        int const columns = (frameBuffer.width() + glitterpixel - 1)/glitterpixel;
+        int const width = frameBuffer.width();
+        for (int y=0; y<frameBuffer.height(); y++) {
+            quint16 const* const cellSteps = glitterSteps.constData() + (y/glitterpixel)*columns;
+            quint32 const* const source = reinterpret_cast<quint32 const*>(imageFinal.constScanLine(y));
+            quint32* const target = reinterpret_cast<quint32*>(frameBuffer.scanLine(y));
+            for (int column=0; column<columns; column++) {
+                if (cellSteps[column] >= glitterShown && cellSteps[column] < steps) {
+                    int const x = column*glitterpixel;
+                    memcpy(target + x, source + x, sizeof(quint32)*size_t(qMin(int(glitterpixel), width - x)));
+                }
+            }
         }
+        glitterShown = steps;
     }
+    painter.drawImage(0, 0, frameBuffer);
 }
 
 void PresentationSlide::initGlitter()
 {
     unsigned int seed = this->seed + static_cast<unsigned int>(pageIndex+transition_duration);
-    if (glitter != nullptr)
-        delete[] glitter;
-    glitter = new quint16[nglitter];
+    if (nglitter == 0 || glitterpixel == 0) {
+        glitterSteps.clear();
+        return;
+    }
+    // Random order of the glitter steps.
+    QVector<quint16> order(nglitter);
     for (quint16 i=0; i<nglitter; i++)
-        glitter[i] = i;
-    std::shuffle(glitter, glitter+nglitter, std::default_random_engine(seed));
+        order[i] = i;
+    std::shuffle(order.begin(), order.end(), std::default_random_engine(seed));
+    // Cell i is revealed in step j with order[j] = i % nglitter.
+    QVector<quint16> stepOf(nglitter);
+    for (quint16 j=0; j<nglitter; j++)
+        stepOf[order[j]] = j;
+    int const columns = (width() + glitterpixel - 1)/glitterpixel;
+    int const rows = (height() + glitterpixel - 1)/glitterpixel;
+    glitterSteps.resize(columns*rows);
+    for (int i=0; i<glitterSteps.length(); i++)
+        glitterSteps[i] = stepOf[i % nglitter];
+    glitterShown = 0;
 }
 
 void PresentationSlide::setGlitterSteps(quint16 const number)
 {
-    if (glitter != nullptr) {
-        delete[] glitter;
-        glitter = nullptr;
-    }
+    glitterSteps.clear();
     nglitter = number;
 }
 
 void PresentationSlide::paintFlyInUp(QPainter& painter)
 {
-    int const split = ((transition_duration - remainTimer.remainingTime())*height())/transition_duration;
-    painter.drawPixmap(0, 0, picinit);
+    int const split = ((transition_duration - remaining)*height())/transition_duration;
+    painter.drawImage(0, 0, imageInit);
     if (split != 0)
         painter.drawPixmap(0, height()-split, changes, 0, 0, -1, split);
 }
 
 void PresentationSlide::paintFlyInDown(QPainter& painter)
 {
-    int const split = remainTimer.remainingTime()*height()/transition_duration;
-    painter.drawPixmap(0, 0, picinit);
+    int const split = remaining*height()/transition_duration;
+    painter.drawImage(0, 0, imageInit);
     painter.drawPixmap(0, 0, changes, 0, split, -1, -1);
 }
 
 void PresentationSlide::paintFlyInLeft(QPainter& painter)
 {
-    int const split = remainTimer.remainingTime()*width()/transition_duration;
-    painter.drawPixmap(0, 0, picinit);
+    int const split = remaining*width()/transition_duration;
+    painter.drawImage(0, 0, imageInit);
     painter.drawPixmap(split, 0, changes, 0, 0, -1, -1);
 }
 
 void PresentationSlide::paintFlyInRight(QPainter& painter)
 {
-    int const split = remainTimer.remainingTime()*width()/transition_duration;
-    painter.drawPixmap(0, 0, picinit);
+    int const split = remaining*width()/transition_duration;
+    painter.drawImage(0, 0, imageInit);
     painter.drawPixmap(0, 0, changes, split, 0, -1, -1);
 }
 
 void PresentationSlide::paintFlyOutUp(QPainter& painter)
 {
-    int const split = ((transition_duration - remainTimer.remainingTime())*height())/virtual_transition_duration;
-    painter.drawPixmap(0, 0, picfinal);
+    int const split = ((transition_duration - remaining)*height())/virtual_transition_duration;
+    painter.drawImage(0, 0, imageFinal);
     painter.drawPixmap(0, 0, changes, 0, split, -1, -1);
 }
 
 void PresentationSlide::paintFlyOutDown(QPainter& painter)
 {
-    int const split = ((transition_duration - remainTimer.remainingTime())*height())/virtual_transition_duration;
-    painter.drawPixmap(0, 0, picfinal);
+    int const split = ((transition_duration - remaining)*height())/virtual_transition_duration;
+    painter.drawImage(0, 0, imageFinal);
     painter.drawPixmap(0, split, changes, 0, 0, -1, -1);
 }
 
 void PresentationSlide::paintFlyOutRight(QPainter& painter)
 {
-    int const split = ((transition_duration - remainTimer.remainingTime())*width())/virtual_transition_duration;
-    painter.drawPixmap(0, 0, picfinal);
+    int const split = ((transition_duration - remaining)*width())/virtual_transition_duration;
+    painter.drawImage(0, 0, imageFinal);
     painter.drawPixmap(split, 0, changes, 0, 0, -1, -1);
 }
 
 void PresentationSlide::paintFlyOutLeft(QPainter& painter)
 {
-    int const split = ((transition_duration - remainTimer.remainingTime())*width())/virtual_transition_duration;
-    painter.drawPixmap(0, 0, picfinal);
+    int const split = ((transition_duration - remaining)*width())/virtual_transition_duration;
+    painter.drawImage(0, 0, imageFinal);
     painter.drawPixmap(0, 0, changes, split, 0, -1, -1);
 }
 
 void PresentationSlide::paintPushUp(QPainter& painter)
 {
-    int const split = remainTimer.remainingTime()*picheight/transition_duration;
+    int const split = remaining*picheight/transition_duration;
     if (split + shifty >= 0)
-        painter.drawPixmap(0, 0, picinit, 0, picheight-split, 0, split+shifty+1);
-    painter.drawPixmap(0, split+shifty, picfinal, 0, shifty, -1, -1);
+        painter.drawImage(0, 0, imageInit, 0, picheight-split, 0, split+shifty+1);
+    painter.drawImage(0, split+shifty, imageFinal, 0, shifty, -1, -1);
 }
 
 void PresentationSlide::paintPushDown(QPainter& painter)
 {
-    int const split = remainTimer.remainingTime()*picheight/transition_duration;
-    painter.drawPixmap(0, picheight-split, picinit, 0, 0, -1, -1);
+    int const split = remaining*picheight/transition_duration;
+    painter.drawImage(0, picheight-split, imageInit, 0, 0, -1, -1);
     if (split < picheight + shifty)
-        painter.drawPixmap(0, 0, picfinal, 0, split, -1, picheight+shifty-split);
+        painter.drawImage(0, 0, imageFinal, 0, split, -1, picheight+shifty-split);
 }
 
 void PresentationSlide::paintPushLeft(QPainter& painter)
 {
-    int const split = remainTimer.remainingTime()*picwidth/transition_duration;
+    int const split = remaining*picwidth/transition_duration;
     if (split + shiftx >= 0)
-        painter.drawPixmap(0, 0, picinit, picwidth-split, 0, split+shiftx+1, -1);
-    painter.drawPixmap(split+shiftx, 0, picfinal, shiftx, 0, -1, -1);
+        painter.drawImage(0, 0, imageInit, picwidth-split, 0, split+shiftx+1, -1);
+    painter.drawImage(split+shiftx, 0, imageFinal, shiftx, 0, -1, -1);
 }
 
 void PresentationSlide::paintPushRight(QPainter& painter)
 {
-    int const split = remainTimer.remainingTime()*picwidth/transition_duration;
-    painter.drawPixmap(picwidth-split, 0, picinit, 0, 0, -1, -1);
+    int const split = remaining*picwidth/transition_duration;
+    painter.drawImage(picwidth-split, 0, imageInit, 0, 0, -1, -1);
     if (shiftx+picwidth > split)
-        painter.drawPixmap(0, 0, picfinal, split, 0, picwidth+shiftx-split, -1);
+        painter.drawImage(0, 0, imageFinal, split, 0, picwidth+shiftx-split, -1);
 }
 
 void PresentationSlide::paintCoverUp(QPainter& painter)
 {
-    int const split = remainTimer.remainingTime()*picheight/transition_duration;
+    int const split = remaining*picheight/transition_duration;
     if (shifty+split > 0)
-        painter.drawPixmap(0, 0, picinit, 0, 0, -1, shifty+split);
-    painter.drawPixmap(0, shifty+split, picfinal, 0, shifty, -1, -1);
+        painter.drawImage(0, 0, imageInit, 0, 0, -1, shifty+split);
+    painter.drawImage(0, shifty+split, imageFinal, 0, shifty, -1, -1);
 }
 
 void PresentationSlide::paintCoverDown(QPainter& painter)
 {
-    int const split = remainTimer.remainingTime()*picheight/transition_duration;
-    painter.drawPixmap(0, shifty+picheight-split, picinit, 0, shifty+picheight-split, -1, -1);
+    int const split = remaining*picheight/transition_duration;
+    painter.drawImage(0, shifty+picheight-split, imageInit, 0, shifty+picheight-split, -1, -1);
     if (shifty+picheight > split)
-        painter.drawPixmap(0, 0, picfinal, 0, split, -1, shifty+picheight-split);
+        painter.drawImage(0, 0, imageFinal, 0, split, -1, shifty+picheight-split);
 }
 
 void PresentationSlide::paintCoverLeft(QPainter& painter)
 {
-    int const split = remainTimer.remainingTime()*picwidth/transition_duration;
+    int const split = remaining*picwidth/transition_duration;
     if (shiftx+split > 0)
-        painter.drawPixmap(0, 0, picinit, 0, 0, shiftx+split, -1);
-    painter.drawPixmap(shiftx+split, 0, picfinal, shiftx, 0, -1, -1);
+        painter.drawImage(0, 0, imageInit, 0, 0, shiftx+split, -1);
+    painter.drawImage(shiftx+split, 0, imageFinal, shiftx, 0, -1, -1);
 }
 
 void PresentationSlide::paintCoverRight(QPainter& painter)
 {
-    int const split = remainTimer.remainingTime()*picwidth/transition_duration;
-    painter.drawPixmap(shiftx+picwidth-split, 0, picinit, shiftx+picwidth-split, 0, -1, -1);
+    int const split = remaining*picwidth/transition_duration;
+    painter.drawImage(shiftx+picwidth-split, 0, imageInit, shiftx+picwidth-split, 0, -1, -1);
     if (shiftx+picwidth > split)
-        painter.drawPixmap(0, 0, picfinal, shiftx+split, 0, shiftx+picwidth-split, -1);
+        painter.drawImage(0, 0, imageFinal, shiftx+split, 0, shiftx+picwidth-split, -1);
 }
 
 void PresentationSlide::paintUncoverDown(QPainter& painter)
 {
-    int const split = remainTimer.remainingTime()*picheight/transition_duration;
-    painter.drawPixmap(0, shifty+picheight-split, picinit, 0, shifty, -1, -1);
+    int const split = remaining*picheight/transition_duration;
+    painter.drawImage(0, shifty+picheight-split, imageInit, 0, shifty, -1, -1);
     if (shifty+picheight > split)
-        painter.drawPixmap(0, 0, picfinal, 0, 0, -1, shifty+picheight-split);
+        painter.drawImage(0, 0, imageFinal, 0, 0, -1, shifty+picheight-split);
 }
 
 void PresentationSlide::paintUncoverUp(QPainter& painter)
 {
-    int const split = remainTimer.remainingTime()*picheight/transition_duration;
+    int const split = remaining*picheight/transition_duration;
     if (shifty+split > 0)
-        painter.drawPixmap(0, 0, picinit, 0, picheight-split, -1, shifty+split);
-    painter.drawPixmap(0, shifty+split, picfinal, 0, shifty+split, -1, -1);
+        painter.drawImage(0, 0, imageInit, 0, picheight-split, -1, shifty+split);
+    painter.drawImage(0, shifty+split, imageFinal, 0, shifty+split, -1, -1);
 }
 
 void PresentationSlide::paintUncoverRight(QPainter& painter)
 {
-    int const split = remainTimer.remainingTime()*picwidth/transition_duration;
-    painter.drawPixmap(shiftx+picwidth-split, 0, picinit, shiftx, 0, -1, -1);
+    int const split = remaining*picwidth/transition_duration;
+    painter.drawImage(shiftx+picwidth-split, 0, imageInit, shiftx, 0, -1, -1);
     if (shiftx+picwidth > split)
-        painter.drawPixmap(0, 0, picfinal, 0, 0, shiftx+picwidth-split, -1);
+        painter.drawImage(0, 0, imageFinal, 0, 0, shiftx+picwidth-split, -1);
 }
 
 void PresentationSlide::paintUncoverLeft(QPainter& painter)
 {
-    int const split = remainTimer.remainingTime()*picwidth/transition_duration;
+    int const split = remaining*picwidth/transition_duration;
     if (shiftx+split > 0)
-        painter.drawPixmap(0, 0, picinit, picwidth-split, 0, shiftx+split, -1);
-    painter.drawPixmap(shiftx+split, 0, picfinal, shiftx+split, 0, -1, -1);
+        painter.drawImage(0, 0, imageInit, picwidth-split, 0, shiftx+split, -1);
+    painter.drawImage(shiftx+split, 0, imageFinal, shiftx+split, 0, -1, -1);
 }
 
 void PresentationSlide::paintFade(QPainter& painter)
 {
-    painter.drawPixmap(0, 0, picinit);
-    painter.setOpacity(static_cast<double>((transition_duration - remainTimer.remainingTime()))/transition_duration);
-    painter.drawPixmap(0, 0, picfinal);
+    if (frameBuffer.size() != imageFinal.size() || imageInit.size() != imageFinal.size()) {
+        painter.drawImage(0, 0, imageFinal);
+        return;
+    }
+    quint32 const alpha = quint32(qBound(0, 256*(transition_duration - remaining)/transition_duration, 256));
+    blendImages(imageInit, imageFinal, frameBuffer, alpha);
+    painter.drawImage(0, 0, frameBuffer);
 }
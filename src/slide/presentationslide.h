@@ -20,6 +20,8 @@
 #define TRANSITIONWIDGET_H
 
 #include <random>
+#include <QElapsedTimer>
+#include <QJsonObject>
 #include <poppler/qt5/poppler-page-transition.h>
 #include "drawslide.h"
 
@@ -32,12 +34,50 @@ private:
     quint8 n_blinds = 8;
     quint16 picwidth;
     quint16 picheight;
+    /// Frame clock: triggers a new frame of a slide transition once per refresh interval of the screen.
     QTimer timer;
+    /// Ends the slide transition. Its interval is the duration of the transition.
     QTimer remainTimer;
+    /// Time since the start of the current transition.
+    QElapsedTimer transitionClock;
+    /// Remaining time of the transition (in ms) at the current frame. All paint functions use this value.
+    int remaining = 0;
+    /// Time between two frames in ms, given by the refresh rate of the screen.
+    int frameInterval = 16;
+    /// Time of the last frame since the start of the transition in ms.
+    qint64 lastFrame = 0;
+    /// Number of consecutive frames, which took longer than frameInterval to paint.
+    int slowFrames = 0;
+    /// Frame statistics of a single slide transition.
+    struct TransitionRecord {
+        /// Poppler::PageTransition::Type
+        int type;
+        /// Nominal duration in ms.
+        int duration;
+        /// Time from the first to the last frame in ms.
+        qint64 elapsed;
+        /// Number of painted frames.
+        int frames;
+        /// Number of frames, which were not shown in time.
+        int dropped;
+        /// The transition was ended early because painting was too slow.
+        bool skipped;
+    };
+    /// Statistics of the current transition.
+    TransitionRecord currentRecord;
+    /// Statistics of the last transitions.
+    QList<TransitionRecord> transitionRecords;
+    /// Show the next frame of the current transition. Called by timer.
+    void nextFrame();
+    /// Add the statistics of the current transition to transitionRecords.
+    void finishTransitionRecord();
     void (PresentationSlide::*paint)(QPainter&) = nullptr;
     QPixmap changes; // only for transition fly
     int virtual_transition_duration = 100; // only for transition fly
-    quint16* glitter = nullptr;
+    /// Step of the glitter transition in which each glitter pixel (cell) is revealed, row by row.
+    QVector<quint16> glitterSteps;
+    /// Number of glitter steps, which are already shown in frameBuffer.
+    int glitterShown = 0;
     quint16 nglitter = 167;
     quint16 glitterpixel = 30;
     unsigned int seed = 0;
@@ -45,20 +85,53 @@ private:
 protected:
     QTimer* const timeoutTimer = new QTimer(this);
     int minimumAnimationDelay = 50; // minimum frame time in ms
-    QPixmap picinit;
-    QPixmap picfinal;
+    /// Old and new slide (RGB32) for all transitions. Dissolve, fade and glitter composite them directly in frameBuffer.
+    QImage imageInit;
+    QImage imageFinal;
+    /// Frame of transitions composited pixel by pixel. This is reused for all transitions.
+    QImage frameBuffer;
+    /// Prepare frameBuffer from imageInit.
+    void prepareFrameBuffer();
+    /// Frame of a slide with borders and drawings, composited before it is needed in a transition.
+    struct PreparedFrame {
+        int page;
+        QSize size;
+        /// Hash of the drawings on the page when the frame was composited.
+        quint32 pathsHash;
+        /// RGB32 image, see composeFrame.
+        QImage image;
+    };
+    /// Prepared frames of the current and the next slide.
+    QList<PreparedFrame> preparedFrames;
+    /// Prepares frames for the next transition when the slide has not changed for a short time.
+    QTimer prepareTimer;
+    /// Composite the frame of page showing the slide image and the drawings.
+    /// The frame is an RGB32 image, which is used by transitions without conversion.
+    QImage const composeFrame(int const page, QPixmap const& slide);
+    /// Get the prepared frame of page if it is still valid or composite it now.
+    /// Returns an empty image if page is not the current page and is not cached.
+    QImage const getFrame(int const page);
+    /// Combined hash of all drawings on page. Used to detect changes in the drawings.
+    quint32 pathsHash(int const page) const;
+    /// Composite the frames of the current slide and the next slide for the next transition.
+    void prepareFrames();
     double duration = -1.; // duration of the current page in s
     void paintEvent(QPaintEvent*) override;
     void animate(int const oldPgaeIndex = -1) override;
     void endAnimation();
     void stopAnimation() override;
     void setDuration() override;
-    void updateImages(int const oldPage);
+    /// Set imageInit and imageFinal. Returns false if one of them is not available without rendering.
+    bool updateImages(int const oldPage);
 
 public:
     PresentationSlide(PdfDoc const*const document, PagePart const part, QWidget* parent=nullptr);
     ~PresentationSlide() override;
     bool isShowingTransition() const override {return remainTimer.interval() > 0 && remainTimer.isActive();}
+    /// Clear all data. Prepared transition frames are dropped because the document might have changed.
+    void clearAll(bool const keepCache = false) override {preparedFrames.clear(); DrawSlide::clearAll(keepCache);}
+    /// Frame rates and dropped frames of the last slide transitions as JSON object.
+    QJsonObject const transitionStatistics() const;
     QPixmap const& getCurrentPixmap() const {return pixmap;}
     void initGlitter();
     void setGlitterSteps(quint16 const number);
@@ -116,12 +116,56 @@ void PreviewSlide::basicRenderPage(int const pageNumber)
     qDebug() << "get pixmap?" << pageIndex << pageNumber << oldSize << size() << cache << this;
 #endif
     // Check whether the page number or the widget size changed. Then update pixmap if cache is available.
-    if ((pageIndex != pageNumber || oldSize != size() || pixmap.isNull()) && cache != nullptr)
-        pixmap = cache->getPixmap(pageNumber);
+    if ((pageIndex != pageNumber || oldSize != size() || pixmap.isNull()) && cache != nullptr) {
+        // A previously requested page is not visible anymore. Render it after the visible pages.
+        if (requestedPage >= 0 && requestedPage != pageNumber)
+            RenderPool::instance()->setPriority(cache, requestedPage, NextPriority);
+        if (!cache->contains(pageNumber)) {
+            // Don't render in the main thread. Instead, render the page with highest priority
+            // in the RenderPool and show it in receivePage when it is ready.
+            requestedPage = pageNumber;
+            connect(cache, &CacheMap::pageReady, this, &PreviewSlide::receivePage, Qt::UniqueConnection);
+            connect(cache, &CacheMap::pageDiscarded, this, &PreviewSlide::requestAgain, Qt::UniqueConnection);
+            cache->updateCache(pageNumber, VisiblePriority);
+        }
+        // updateCache can directly take the page from another cache with the same content.
+        if (cache->contains(pageNumber)) {
+            pixmap = cache->getPixmap(pageNumber);
+            requestedPage = -1;
+        }
+        else
+            pixmap = QPixmap();
+    }
     // Update size. This will later be used to check it the pixmap needs to be updated.
     oldSize = size();
 }
 
+void PreviewSlide::receivePage(int const page)
+{
+    // Only handle pages which were requested from the current cache.
+    if (sender() != cache || page != requestedPage)
+        return;
+    requestedPage = -1;
+    if (page != pageIndex)
+        return;
+#ifdef DEBUG_RENDERING
+    qDebug() << "received requested page" << page << this;
+#endif
+    pixmap = cache->getPixmap(page);
+    update();
+}
+
+void PreviewSlide::requestAgain(int const page)
+{
+    // The requested page was rendered before cache was cleared (e.g. after resizing).
+    if (sender() != cache || page != requestedPage)
+        return;
+    cache->updateCache(page, VisiblePriority);
+    // updateCache can directly take the page from another cache with the same content.
+    if (cache->contains(page))
+        receivePage(page);
+}
+
 void PreviewSlide::mouseReleaseEvent(QMouseEvent* event)
 {
     // Handle clicks on links.
@@ -254,10 +298,10 @@ void PreviewSlide::paintEvent(QPaintEvent*)
         painter.drawPixmap(shiftx, shifty, pixmap);
 }
 
-void PreviewSlide::clearAll()
+void PreviewSlide::clearAll(bool const keepCache)
 {
     // Clear cache (if it exists).
-    if (cache != nullptr)
+    if (cache != nullptr && !keepCache)
         cache->clearCache();
     // Delete all links and link positions.
     qDeleteAll(links);
@@ -265,6 +309,7 @@ void PreviewSlide::clearAll()
     linkPositions.clear();
     // Set page to nullptr.
     page = nullptr;
+    requestedPage = -1;
     // Clear pixmap.
     pixmap = QPixmap();
 }
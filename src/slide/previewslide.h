@@ -73,7 +73,8 @@ public:
 
     /// Clear all contents of the label.
     /// This function is called when the document is reloaded or the program is closed and everything should be cleaned up.
-    virtual void clearAll();
+    /// If keepCache is true, the cache is not cleared. This is used when unchanged pages are kept after reloading.
+    virtual void clearAll(bool const keepCache = false);
     virtual bool isPresentation() const {return false;}
 
 protected:
@@ -107,6 +108,8 @@ protected:
     QSize oldSize;
     /// Character used to split links to files into a file path and a list of arguments.
     QString urlSplitCharacter = "";
+    /// Page which was requested from cache with VisiblePriority and has not been rendered yet (-1 if none).
+    int requestedPage = -1;
 
     /// Disable external links by default.
     bool allowExternalLinks = false;
@@ -125,6 +128,12 @@ protected:
 
     void toAbsoluteCoordinates(QRectF& relative) const;
 
+protected slots:
+    /// Show a page which was requested in basicRenderPage as soon as it has been rendered to cache.
+    void receivePage(int const page);
+    /// Request a page, which was requested in basicRenderPage but discarded by the cache, again.
+    void requestAgain(int const page);
+
 signals:
     /// Send a new page number to ControlScreen and PresentationScreen. The new page will be shown.
     void sendNewPageNumber(int const pageNumber);